@@ -21,6 +21,7 @@
 
 #include <fstream>
 #include <string>
+#include <vector>
 #include <filesystem>
 #include <libconfig.h++>
 #include <boost/asio.hpp>
@@ -54,6 +55,7 @@ static struct argp_option options[] = {  // NOLINT
      0},
     {"tsi", 'T', "ID", 0, "The TSI to use for the FLUTE session (default: 16)", 0},
     {"output-path", 'o', "PATH", 0, "Directory to save received files", 0},
+    {"filter", 'f', "GLOB", 0, "Only receive files with a Content-Location matching this pattern (can be repeated)", 0},
     {nullptr, 0, nullptr, 0, nullptr, 0}};
 
 /**
@@ -69,6 +71,7 @@ struct ft_arguments {
   char **files;
   uint64_t tsi = 16;
   const char *output_path = nullptr;
+  std::vector<std::string> filters;
 };
 
 /**
@@ -99,6 +102,9 @@ static auto parse_opt(int key, char *arg, struct argp_state *state) -> error_t {
     case 'o':
       arguments->output_path = arg;
       break;
+    case 'f':
+      arguments->filters.emplace_back(arg);
+      break;
     default:
       return ARGP_ERR_UNKNOWN;
   }
@@ -158,6 +164,11 @@ auto main(int argc, char **argv) -> int {
         arguments.tsi,
         io);
 
+    // Only receive the wanted files, if filters are given
+    for (const auto &filter : arguments.filters) {
+      receiver.add_content_location_filter(filter);
+    }
+
     // Configure IPSEC, if enabled
     if (arguments.enable_ipsec)
     {
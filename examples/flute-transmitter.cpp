@@ -66,6 +66,11 @@ static struct argp_option options[] = {  // NOLINT
     {"new-api", 'n', nullptr, 0, "Use the new FileDescription API", 0},
     {"retransmit", 'R', "COUNT", 0, "Number of times to repeatedly transmit a file, implies -n option (default: 1)", 0},
     {"etags", 'e', nullptr, 0, "Enable generation of ETag values for each file, implies -n option (default: no ETags)", 0},
+    {"batch", 'b', "COUNT", 0, "Number of packets to pass to the socket in one send call (default: 1)", 0},
+    {"gso", 'G', nullptr, 0, "Use UDP segmentation offload for batches of packets, needs -b (default: off)", 0},
+    {"zerocopy", 'Z', nullptr, 0, "Send the packets with MSG_ZEROCOPY (default: off)", 0},
+    {"carousel", 'C', "MS", 0, "Repeat the files in a carousel, starting a round of each file at most every MS "
+     "milliseconds until -R rounds have been sent (or forever without -R), implies -n option", 0},
     {nullptr, 0, nullptr, 0, nullptr, 0}};
 
 /**
@@ -83,6 +88,10 @@ struct ft_arguments {
   uint32_t rate_limit = 1000;
   uint64_t tsi = 16;
   size_t retransmit_count = 1;
+  std::optional<std::chrono::milliseconds> carousel_interval;
+  unsigned send_batch_size = 1;
+  bool use_gso = false;
+  bool use_zerocopy = false;
   unsigned log_level = 2;        /**< log level */
   char **files;
 };
@@ -126,6 +135,19 @@ static auto parse_opt(int key, char *arg, struct argp_state *state) -> error_t {
     case 'n':
       arguments->new_api = true;
       break;
+    case 'b':
+      arguments->send_batch_size = static_cast<unsigned>(strtoul(arg, nullptr, 10));
+      break;
+    case 'G':
+      arguments->use_gso = true;
+      break;
+    case 'Z':
+      arguments->use_zerocopy = true;
+      break;
+    case 'C':
+      arguments->carousel_interval = std::chrono::milliseconds(strtoul(arg, nullptr, 10));
+      arguments->new_api = true;
+      break;
     case 'R':
       arguments->retransmit_count = static_cast<size_t>(strtoul(arg, nullptr, 10));
       arguments->new_api = true;
@@ -155,6 +177,17 @@ void print_version(FILE *stream, struct argp_state * /*state*/) {
           std::to_string(VERSION_PATCH).c_str());
 }
 
+/**
+ * Log the packet rate achieved since transmission started.
+ */
+static void log_statistics(const LibFlute::Transmitter &transmitter, std::chrono::steady_clock::time_point start)
+{
+  auto stats = transmitter.statistics();
+  auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  spdlog::info("Sent {} packets ({} bytes) in {} send calls, {:.0f} packets/s",
+      stats.packets_sent, stats.bytes_sent, stats.send_calls, seconds > 0 ? stats.packets_sent / seconds : 0.0);
+}
+
 static void send_with_new_api(struct ft_arguments &arguments)
 {
   struct fileEntry {
@@ -173,6 +206,12 @@ static void send_with_new_api(struct ft_arguments &arguments)
     if (arguments.use_gzip) {
       fd->set_compression(LibFlute::Transmitter::FileDescription::COMPRESSION_GZIP);
     }
+    if (arguments.carousel_interval) {
+      fd->set_carousel_interval(arguments.carousel_interval);
+    } else if (arguments.retransmit_count > 1) {
+      // Repeat the files back to back, the Transmitter keeps them ready for the next round
+      fd->set_carousel_interval(0ms);
+    }
     if (arguments.gen_etags) {
       std::array<unsigned char, SHA_DIGEST_LENGTH> digest;
       SHA1(reinterpret_cast<const unsigned char*>(fd->data()), fd->data_length(), digest.data());
@@ -198,16 +237,22 @@ static void send_with_new_api(struct ft_arguments &arguments)
   {
     transmitter.enable_ipsec(1, arguments.aes_key);
   }
+  transmitter.send_batch_size(arguments.send_batch_size);
+  transmitter.udp_gso(arguments.use_gso);
+  transmitter.zerocopy(arguments.use_zerocopy);
+  auto start = std::chrono::steady_clock::now();
 
   // Register a completion callback
   transmitter.register_completion_callback(
-        [&files, &arguments, &transmitter](uint32_t toi) -> void {
+        [&files, &arguments, &transmitter, &start](uint32_t toi) -> void {
           for (auto& f : files) {
             if (f.file->toi() == toi) {
               spdlog::info("{} (TOI {}) has been transmitted", f.file->file_entry().content_location, f.file->toi());
+              log_statistics(transmitter, start);
               f.transmitted_count++;
-              if (f.transmitted_count < arguments.retransmit_count) {
-		transmitter.send(f.file);
+              if (arguments.retransmit_count > 1 && f.transmitted_count == arguments.retransmit_count) {
+                // Take the file out of the carousel
+                transmitter.remove(toi);
               }
             }
           }
@@ -266,13 +311,18 @@ static void send_with_old_api(struct ft_arguments &arguments)
   {
     transmitter.enable_ipsec(1, arguments.aes_key);
   }
+  transmitter.send_batch_size(arguments.send_batch_size);
+  transmitter.udp_gso(arguments.use_gso);
+  transmitter.zerocopy(arguments.use_zerocopy);
+  auto start = std::chrono::steady_clock::now();
 
   // Register a completion callback
   transmitter.register_completion_callback(
-        [&files](uint32_t toi) -> void {
+        [&files, &transmitter, &start](uint32_t toi) -> void {
           for (auto& file : files) {
             if (file.toi == toi) {
               spdlog::info("{} (TOI {}) has been transmitted", file.location, file.toi);
+              log_statistics(transmitter, start);
               // could free() the buffer here
             }
           }
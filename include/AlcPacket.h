@@ -46,11 +46,72 @@ namespace LibFlute {
       */
       AlcPacket(uint16_t tsi, uint16_t toi, FecOti fec_oti, const std::vector<EncodingSymbol>& symbols, size_t max_size, uint32_t fdt_instance_id);
 
+     /**
+      *  Create an ALC packet that only signals the end of an object or of the session
+      *
+      *  The packet carries the FEC payload ID but no encoding symbols.
+      *
+      *  @param tsi Transport Stream Identifier
+      *  @param toi Transport Object Identifier
+      *  @param fec_oti OTI values
+      *  @param close_object Set the Close Object flag (B)
+      *  @param close_session Set the Close Session flag (A)
+      */
+      AlcPacket(uint16_t tsi, uint16_t toi, FecOti fec_oti, bool close_object, bool close_session);
+
      /**
       *  Default destructor.
       */
       ~AlcPacket();
 
+     /**
+      *  Get the size of the buffer needed to build an ALC packet
+      *
+      *  @param toi Transport Object Identifier
+      *  @param max_size Maximum payload size
+      *  @param ext_fti The packet carries an EXT_FTI header extension (always the case for the FDT)
+      *  @return The maximum packet size in bytes
+      */
+      static size_t max_size(uint16_t toi, size_t max_size, bool ext_fti = false);
+
+     /**
+      *  Build an ALC packet from encoding symbols into a caller provided buffer
+      *
+      *  This creates the same packet as the constructor without allocating any memory, so that the transmit path can
+      *  reuse its packet buffers.
+      *
+      *  @param buffer Buffer to write the packet to
+      *  @param buffer_size Size of the buffer, must be at least max_size()
+      *  @param tsi Transport Stream Identifier
+      *  @param toi Transport Object Identifier
+      *  @param fec_oti OTI values
+      *  @param symbols Vector of encoding symbols
+      *  @param max_size Maximum payload size
+      *  @param fdt_instance_id FDT instance ID (only relevant for FDT with TOI=0)
+      *  @return The size of the packet in bytes
+      */
+      static size_t build(char* buffer, size_t buffer_size, uint16_t tsi, uint16_t toi, const FecOti& fec_oti,
+          const std::vector<EncodingSymbol>& symbols, size_t max_size, uint32_t fdt_instance_id);
+
+     /**
+      *  Build only the headers of an ALC packet into a caller provided buffer
+      *
+      *  This writes the LCT header and the FEC payload ID for a packet starting with @p first_symbol. The encoding
+      *  symbol data is to be sent directly behind the headers, so that it does not have to be copied.
+      *
+      *  @param buffer Buffer to write the headers to
+      *  @param buffer_size Size of the buffer, must be at least max_size(toi, 0)
+      *  @param tsi Transport Stream Identifier
+      *  @param toi Transport Object Identifier
+      *  @param fec_oti OTI values
+      *  @param first_symbol First encoding symbol in the packet
+      *  @param fdt_instance_id FDT instance ID (only relevant for FDT with TOI=0)
+      *  @param ext_fti Signal @p fec_oti in an EXT_FTI header extension (always the case for the FDT)
+      *  @return The size of the headers in bytes
+      */
+      static size_t build_header(char* buffer, size_t buffer_size, uint16_t tsi, uint16_t toi, const FecOti& fec_oti,
+          const EncodingSymbol& first_symbol, uint32_t fdt_instance_id, bool ext_fti = false);
+
      /**
       *  Get the TSI
       */
@@ -66,6 +127,16 @@ namespace LibFlute {
       */
       const FecOti& fec_oti() const { return _fec_oti; };
 
+     /**
+      *  Check if the Close Object flag (B) is set
+      */
+      bool close_object() const { return _lct_header.close_object_flag; };
+
+     /**
+      *  Check if the Close Session flag (A) is set
+      */
+      bool close_session() const { return _lct_header.close_session_flag; };
+
      /**
       *  Get the LCT header length
       */
@@ -97,6 +168,9 @@ namespace LibFlute {
       size_t size() const { return _len; };
 
     private:
+      static size_t write_lct_header(char* buffer, uint16_t tsi, uint16_t toi, const FecOti& fec_oti,
+          uint32_t fdt_instance_id, bool ext_fti);
+
       uint64_t _tsi = 0;
       uint64_t _toi = 0;
 
@@ -0,0 +1,145 @@
+// libflute - FLUTE/ALC library
+//
+// Copyright (C) 2026 libflute contributors
+//
+// Licensed under the License terms and conditions for use, reproduction, and
+// distribution of 5G-MAG software (the “License”).  You may not use this file
+// except in compliance with the License.  You may obtain a copy of the License at
+// https://www.5g-mag.com/reference-tools.  Unless required by applicable law or
+// agreed to in writing, software distributed under the License is distributed on
+// an “AS IS” BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied.
+//
+// See the License for the specific language governing permissions and limitations
+// under the License.
+//
+#pragma once
+#include <boost/asio/thread_pool.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace LibFlute {
+  /**
+   *  Block parallel encoder for the gzip and deflate content encodings.
+   *
+   *  The content is split into blocks that are compressed independently on the encoder thread pool, in the way pigz
+   *  does it. Each block is primed with the 32 KiB of content in front of it as a dictionary and all but the last
+   *  block end with a sync flush on a byte boundary, so the compressed blocks concatenate into a single deflate
+   *  stream. The check value of the stream is combined from the check values of the blocks, and the result is a
+   *  regular gzip or zlib stream that any decoder accepts.
+   *
+   *  Compressed streams can be kept in a cache shared by all encoders, so that content sent again, in another
+   *  session or by another FileDescription, is only compressed once. See encode(const char*, size_t, const
+   *  std::string&).
+   */
+  class ContentEncoder {
+    public:
+     /**
+      *  Container format of the compressed stream
+      */
+      enum class Format {
+        GZIP,   //< gzip stream (RFC 1952), for the "gzip" content encoding
+        ZLIB    //< zlib stream (RFC 1950), for the "deflate" content encoding
+      };
+
+     /**
+      *  Default size of the blocks compressed in parallel
+      */
+      static constexpr size_t default_block_size = 128 * 1024;
+
+     /**
+      *  Constructor.
+      *
+      *  @param format Container format of the compressed stream
+      *  @param level zlib compression level, -1 for the zlib default
+      *  @param block_size Size of the blocks compressed in parallel
+      */
+      ContentEncoder(Format format, int level = -1, size_t block_size = default_block_size);
+
+     /**
+      *  Compress content
+      *
+      *  The blocks are shared out between the calling thread and the encoder thread pool, so this may also be called
+      *  from a task running on the pool.
+      *
+      *  @param data The content to compress
+      *  @param length Length of the content in bytes
+      *  @return The compressed stream
+      */
+      std::vector<char> encode(const char *data, size_t length) const;
+
+     /**
+      *  Compress content through the cache
+      *
+      *  The cache is keyed by the content digest and length, the format and the compression level. On a miss the
+      *  content is compressed and added to the cache, while a request for content that is being compressed on another
+      *  thread waits for that result. The least recently used entries are evicted once the compressed streams in the
+      *  cache exceed cache_limit().
+      *
+      *  @param data The content to compress
+      *  @param length Length of the content in bytes
+      *  @param digest Digest identifying the content, such as the base64 Content-MD5 of the FDT
+      *  @return The compressed stream, shared with the cache and other users of the same content
+      */
+      std::shared_ptr<const std::vector<char>> encode(const char *data, size_t length, const std::string &digest) const;
+
+     /**
+      *  Cache statistics
+      */
+      struct CacheStatistics {
+        uint64_t hits = 0;       //< Requests served from the cache, including those that waited for a compression
+        uint64_t misses = 0;     //< Requests that compressed the content
+        uint64_t evictions = 0;  //< Entries dropped to stay within the limit
+        size_t entries = 0;      //< Compressed streams in the cache
+        size_t bytes = 0;        //< Size of the compressed streams in the cache
+      };
+
+     /**
+      *  Get the cache statistics
+      *
+      *  @return A snapshot of the current statistics.
+      */
+      static CacheStatistics cache_statistics();
+
+     /**
+      *  Default size limit of the cache in bytes
+      */
+      static constexpr size_t default_cache_limit = 256 * 1024 * 1024;
+
+     /**
+      *  Get the size limit of the cache
+      *
+      *  @return The maximum size of the compressed streams kept in the cache in bytes.
+      */
+      static size_t cache_limit();
+
+     /**
+      *  Set the size limit of the cache
+      *
+      *  Streams larger than the limit are not cached, and 0 disables the cache. Streams in use by a File stay in memory
+      *  until the File is done with them, whether they are still in the cache or not.
+      *
+      *  @param bytes The maximum size of the compressed streams kept in the cache in bytes
+      */
+      static void cache_limit(size_t bytes);
+
+     /**
+      *  Get the encoder thread pool
+      *
+      *  The pool has a thread per core and is shared by all encoders. Transmitters also use it to prepare content
+      *  encoded files without holding up the io_context thread.
+      */
+      static boost::asio::thread_pool &thread_pool();
+
+    private:
+      struct Block;
+      void encode_block(const char *data, size_t length, size_t index, Block &block) const;
+
+      Format _format;
+      int _level;
+      size_t _block_size;
+  };
+};
@@ -0,0 +1,93 @@
+// libflute - FLUTE/ALC library
+//
+// Copyright (C) 2026 libflute contributors
+//
+// Licensed under the License terms and conditions for use, reproduction, and
+// distribution of 5G-MAG software (the “License”).  You may not use this file
+// except in compliance with the License.  You may obtain a copy of the License at
+// https://www.5g-mag.com/reference-tools.  Unless required by applicable law or
+// agreed to in writing, software distributed under the License is distributed on
+// an “AS IS” BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied.
+//
+// See the License for the specific language governing permissions and limitations
+// under the License.
+//
+#pragma once
+#include <boost/asio/thread_pool.hpp>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace LibFlute {
+  /**
+   *  Source of the content of a file that is read while the file is transmitted
+   *
+   *  A file sent from a ContentSource is not held in memory as a whole. The Transmitter reads it one source block at
+   *  a time, a bounded number of blocks ahead of the transmission (see Transmitter::source_read_ahead()), and releases
+   *  each block once it has been sent. This allows objects from pipes, sockets or generators to be sent with
+   *  constant memory.
+   *
+   *  The reads of a source are made one at a time on the thread_pool(), never concurrently. The offsets follow
+   *  each other in increasing order, unless the file is sent again from the start (a carousel round or a session
+   *  that is activated again), which reads it again from offset 0.
+   */
+  class ContentSource {
+    public:
+     /**
+      *  Default destructor.
+      */
+      virtual ~ContentSource() = default;
+
+     /**
+      *  Read content of the file
+      *
+      *  The read may be short, it is called again for the rest of the block. The call may block until content is
+      *  available.
+      *
+      *  @param offset Offset in the file of the content to read
+      *  @param buffer The buffer to read into
+      *  @param length The maximum number of bytes to read
+      *  @return The number of bytes read, 0 if there is no more content at @p offset
+      *
+      *  @throw const char*, std::exception If the content cannot be read. The file is removed from transmission.
+      */
+      virtual size_t read(uint64_t offset, char *buffer, size_t length) = 0;
+
+     /**
+      *  Get the source reader thread pool
+      *
+      *  The pool is shared by all sources, separate from the ContentEncoder pool so that a read blocking on a slow
+      *  source does not hold up compression.
+      */
+      static boost::asio::thread_pool &thread_pool();
+  };
+
+  /**
+   *  Content source reading from a file descriptor, such as a pipe or a socket
+   *
+   *  The content is read sequentially. A descriptor that cannot seek, like a pipe, can therefore only be sent once,
+   *  reading it again from the start fails.
+   */
+  class FdContentSource : public ContentSource {
+    public:
+     /**
+      *  Create a source for a file descriptor
+      *
+      *  @param fd The file descriptor to read from, positioned at the start of the content
+      *  @param close_fd Close the file descriptor when the source is destroyed
+      */
+      FdContentSource(int fd, bool close_fd = false);
+
+     /**
+      *  Destructor, closes the file descriptor if requested.
+      */
+      virtual ~FdContentSource();
+
+      size_t read(uint64_t offset, char *buffer, size_t length) override;
+
+    private:
+      int _fd;
+      bool _close_fd;
+      uint64_t _position = 0;  //< Offset of the next byte read from _fd
+  };
+};
@@ -35,6 +35,13 @@ namespace LibFlute {
        */
       static size_t to_payload(const std::vector<EncodingSymbol>&, char* encoded_data, size_t data_len, const FecOti& fec_oti, ContentEncoding encoding);
 
+      /**
+       *  Write the FEC payload ID for a packet starting with the given symbol to a packet payload buffer
+       *
+       *  @return The number of bytes written
+       */
+      static size_t to_payload_id(const EncodingSymbol& first_symbol, char* encoded_data, size_t data_len, const FecOti& fec_oti);
+
      /**
       *  Default constructor.
       *
@@ -82,6 +89,11 @@ namespace LibFlute {
       */
       size_t len() const { return _data_len; };
 
+     /**
+      *  Get the encoded data
+      */
+      const char* data() const { return _encoded_data; };
+
     private:
       uint32_t _id = 0;
       uint32_t _source_block_number = 0;
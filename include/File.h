@@ -16,14 +16,25 @@
 #pragma once
 #include <stddef.h>
 #include <stdint.h>
+#include <atomic>
 #include <map>
 #include <memory>
+#include <vector>
 #include "AlcPacket.h"
 #include "FileDeliveryTable.h"
 #include "EncodingSymbol.h"
 #include "Transmitter.h"
 
 namespace LibFlute {
+  /**
+   *  Counters of the read-ahead of mapped file content, shared by the files of a Transmitter
+   */
+  struct ReadAheadStatistics {
+    std::atomic<uint64_t> prefetched_bytes{0};  //< Bytes read into memory ahead of the transmission
+    std::atomic<uint64_t> prefetch_misses{0};   //< Source blocks reached by the transmission before they were read ahead
+    std::atomic<uint64_t> page_fault_stalls{0}; //< Pages of those blocks that were not in memory yet
+  };
+
   /**
    *  Represents a file being transmitted or received
    */
@@ -32,6 +43,9 @@ namespace LibFlute {
      /**
       *  Create a file from an FDT entry (used for reception)
       *
+      *  Only the FDT entry is kept at this point, the data buffer and source blocks are allocated when the first
+      *  encoding symbol is passed to put_symbol().
+      *
       *  @param entry FDT entry
       */
       File(LibFlute::FileDeliveryTable::FileEntry entry);
@@ -39,9 +53,17 @@ namespace LibFlute {
      /**
       *  Create a file from a Transmitter::FileDescription (used for transmission)
       *
+      *  If the file description has a ContentSource, reading the content starts straight away, see read_ahead. The
+      *  content of a mapped file is read into memory that many source blocks ahead of the block being sent, so that
+      *  sending it does not wait for storage.
+      *
       *  @param file_description Transmitter File Description
+      *  @param read_ahead Number of source blocks of content from a ContentSource that are held in memory at most, or
+      *                    of a mapped file that are read ahead of the transmission
+      *  @param statistics Counters to add the read-ahead of a mapped file to (optional)
       */
-      File(const std::shared_ptr<Transmitter::FileDescription> &file_description);
+      File(const std::shared_ptr<Transmitter::FileDescription> &file_description, size_t read_ahead = 4,
+          const std::shared_ptr<ReadAheadStatistics> &statistics = nullptr);
 
      /**
       *  Create a file from the given parameters (used for transmission)
@@ -71,8 +93,22 @@ namespace LibFlute {
 
      /**
       *  Write the data from an encoding symbol into the appropriate place in the buffer
+      *
+      *  The data buffer is allocated on the first call if this has not been done already.
+      *
+      *  @return true if the symbol was new, false if it had already been received (duplicate)
+      */
+      bool put_symbol(const EncodingSymbol& symbol);
+
+     /**
+      *  Allocate the data buffer and source blocks, if not already allocated
       */
-      void put_symbol(const EncodingSymbol& symbol);
+      void allocate();
+
+     /**
+      *  Check if the data buffer has been allocated
+      */
+      bool is_allocated() const { return _allocated; };
 
      /**
       *  Check if the file is complete
@@ -80,7 +116,7 @@ namespace LibFlute {
       bool complete() const { return _complete; };
 
      /**
-      *  Get the data buffer
+      *  Get the data buffer (nullptr if not allocated yet)
       */
       char* buffer() const { return _buffer; };
 
@@ -91,6 +127,8 @@ namespace LibFlute {
 
      /**
       *  Encode the buffer using the Content-Encoding
+      *
+      *  The content is compressed in blocks on the ContentEncoder thread pool.
       */
       void encode();
 
@@ -136,20 +174,66 @@ namespace LibFlute {
       */
       std::vector<EncodingSymbol> get_next_symbols(size_t max_size);
 
+     /**
+      *  Get the next encoding symbols that fit in max_size bytes into an existing vector
+      *
+      *  The vector is cleared first, its capacity is reused so that no memory is allocated once it has grown.
+      */
+      void get_next_symbols(size_t max_size, std::vector<EncodingSymbol>& symbols);
+
      /**
       *  Mark encoding symbols as completed
       */
       void mark_completed(const std::vector<EncodingSymbol>& symbols, bool success);
 
+     /**
+      *  Mark all encoding symbols as not sent, so that the file is transmitted again from the start
+      */
+      void restart();
+
+     /**
+      *  Check if the file is a growing object whose length is not known yet
+      */
+      bool growing() const { return _growing; };
+
+     /**
+      *  Set the final transfer length of a growing object
+      *
+      *  Symbols received past the end of the object are dropped.
+      *
+      *  @param transfer_length The transfer length, from the FDT or an EXT_FTI header extension
+      */
+      void finalize(uint64_t transfer_length);
+
+     /**
+      *  Check if packets of the file signal its FEC OTI in an EXT_FTI header extension
+      *
+      *  This is the case for a growing object once it has been finalized, so that receivers learn its length with the
+      *  next packet.
+      */
+      bool ext_fti() const { return _ext_fti; };
+
+     /**
+      *  Check if reading the content from the ContentSource of the file has failed
+      *
+      *  The file cannot be sent any further once this is the case.
+      */
+      bool failed() const;
+
+     /**
+      *  Get the number of source blocks of content from a ContentSource that are being read or held in memory
+      */
+      size_t buffered_blocks() const;
+
      /**
       *  Set the FDT instance ID
       */
-      void set_fdt_instance_id( uint16_t id) { _fdt_instance_id = id; };
+      void set_fdt_instance_id( uint32_t id) { _fdt_instance_id = id; };
 
      /**
       *  Get the FDT instance ID
       */
-      uint16_t fdt_instance_id() { return _fdt_instance_id; };
+      uint32_t fdt_instance_id() { return _fdt_instance_id; };
 
     private:
       void calculate_partitioning();
@@ -164,14 +248,31 @@ namespace LibFlute {
           bool queued = false;
         };
         std::map<uint16_t, Symbol> symbols; 
+        size_t nof_completed_symbols = 0;
+        std::vector<char> buffer;  //< Content of the block while it is held in memory, for content from a ContentSource
       };
 
-      void check_source_block_completion(SourceBlock& block);
+      void set_symbol_completed(SourceBlock& block, SourceBlock::Symbol& symbol, bool complete);
       void check_file_completion();
+      void rewind_send_cursor(std::map<uint16_t, SourceBlock>::iterator block,
+          std::map<uint16_t, SourceBlock::Symbol>::iterator symbol);
+      void grow();
+      bool load_block(std::map<uint16_t, SourceBlock>::iterator block);
+      void release_block(SourceBlock& block);
+      void check_prefetched(uint16_t block);
+      std::vector<std::pair<uint64_t, size_t>> block_extents() const;
 
       std::map<uint16_t, SourceBlock> _source_blocks; 
+      size_t _nof_completed_blocks = 0;
+
+      // Send cursor: the next symbol get_next_symbols() looks at
+      std::map<uint16_t, SourceBlock>::iterator _send_block = _source_blocks.end();
+      std::map<uint16_t, SourceBlock::Symbol>::iterator _send_symbol;
 
       bool _complete = false;;
+      bool _receiving = false;  //< Assembled from received symbols, rather than being transmitted
+      bool _growing = false;  //< Length not known yet, the object is a single source block that symbols are added to
+      bool _ext_fti = false;
 
       uint32_t _nof_source_symbols = 0;
       uint32_t _nof_source_blocks = 0;
@@ -181,6 +282,8 @@ namespace LibFlute {
 
       char* _buffer = nullptr;
       bool _own_buffer = false;
+      std::shared_ptr<const std::vector<char>> _encoded;  //< Content encoded data, _buffer points into it after encode()
+      bool _allocated = false;
       bool _been_encoded = false;
       bool _been_decoded = false;
 
@@ -188,8 +291,16 @@ namespace LibFlute {
       unsigned long _received_at;
       unsigned _access_count = 0;
 
-      uint16_t _fdt_instance_id = 0;
+      uint32_t _fdt_instance_id = 0;
 
       std::shared_ptr<Transmitter::FileDescription> _file_description;
+
+      struct SourceReader;
+      std::shared_ptr<SourceReader> _reader;  //< Reads content from a ContentSource ahead of the transmission
+      std::vector<std::vector<char>> _retired;  //< Blocks dropped by restart(), packets in flight may still use them
+
+      struct Prefetcher;
+      std::shared_ptr<Prefetcher> _prefetcher;  //< Reads a mapped file into memory ahead of the transmission
+      uint32_t _next_checked_block = 0;         //< First block not checked for having been prefetched in time
   };
 };
@@ -84,11 +84,17 @@ namespace LibFlute {
         } cache_control;
         std::string content_encoding;
         std::string etag;
+        bool growing;  //< The length is not known yet, it is signalled in EXT_FTI once the object is finalized
 
         bool operator==(const FileEntry &other) const;
         bool operator!=(const FileEntry &other) const { return !(*this == other); };
       };
 
+     /**
+      *  Get the expiry value (in seconds since the NTP epoch)
+      */
+      uint64_t expires() const { return _expires; };
+
      /**
       *  Set the expiry value
       */
@@ -106,9 +112,19 @@ namespace LibFlute {
 
      /**
       *  Serialize the FDT to an XML string
+      *
+      *  The XML of each File element is kept once it has been serialized, so serializing the FDT again after files
+      *  have been added or removed only serializes the new entries.
       */
       std::string to_string() const;
 
+     /**
+      *  Get the size of the serialized FDT
+      *
+      *  @return The length of the XML string to_string() returns.
+      */
+      size_t size() const;
+
      /**
       *  Get all current file entries
       */
@@ -126,6 +142,11 @@ namespace LibFlute {
       uint32_t _instance_id_sent;
 
       std::vector<FileEntry> _file_entries;
+      mutable std::vector<std::string> _file_elements; //< Serialized File elements of the first _file_entries
+      mutable size_t _file_elements_size = 0;          //< Total length of _file_elements
+
+      std::string root_element() const;
+      std::string file_element(const FileEntry &file) const;
       FecOti _global_fec_oti;
 
       uint64_t _expires;
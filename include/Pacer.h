@@ -0,0 +1,142 @@
+// libflute - FLUTE/ALC library
+//
+// Copyright (C) 2026 libflute contributors
+//
+// Licensed under the License terms and conditions for use, reproduction, and
+// distribution of 5G-MAG software (the “License”).  You may not use this file
+// except in compliance with the License.  You may obtain a copy of the License at
+// https://www.5g-mag.com/reference-tools.  Unless required by applicable law or
+// agreed to in writing, software distributed under the License is distributed on
+// an “AS IS” BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied.
+//
+// See the License for the specific language governing permissions and limitations
+// under the License.
+//
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+
+namespace LibFlute {
+  /**
+   *  Token bucket pacer for the transmit path.
+   *
+   *  Credit accumulates at the configured rate against a monotonic clock and is spent by the packets sent. The credit
+   *  may go negative by up to one send, which is then paid back before the next send is allowed, so the long term rate
+   *  does not depend on how accurately the sender is woken up. While the sender has packets waiting, a late wakeup is
+   *  caught up with a burst of up to max_catch_up worth of transmission. After the sender has been idle (see idle())
+   *  the burst is at most burst() bytes.
+   *
+   *  All methods take the current time as an optional parameter to allow the pacer to be driven by a simulated clock.
+   */
+  class Pacer {
+    public:
+      using clock = std::chrono::steady_clock;
+
+     /**
+      *  Default burst size in bytes (ten full size Ethernet frames)
+      */
+      static constexpr size_t default_burst = 15000;
+
+     /**
+      *  Longest wakeup delay of a sender with packets waiting that is caught up with
+      */
+      static constexpr std::chrono::milliseconds max_catch_up{50};
+
+     /**
+      *  Constructor.
+      *
+      *  @param rate Rate in bits per second, 0 = unlimited
+      *  @param burst Maximum credit in bytes that can build up while the sender is not sending
+      */
+      Pacer(uint64_t rate = 0, size_t burst = default_burst);
+
+     /**
+      *  Get the rate
+      *
+      *  @return The rate in bits per second, 0 = unlimited
+      */
+      uint64_t rate() const { return _rate; };
+
+     /**
+      *  Set the rate
+      *
+      *  @param rate The new rate in bits per second, 0 = unlimited
+      *  @param now The current time
+      *  @return This Pacer object.
+      */
+      Pacer &rate(uint64_t rate, clock::time_point now = clock::now());
+
+     /**
+      *  Get the burst size
+      *
+      *  @return The maximum credit in bytes
+      */
+      size_t burst() const { return _burst; };
+
+     /**
+      *  Set the burst size
+      *
+      *  @param burst The maximum credit in bytes
+      *  @return This Pacer object.
+      */
+      Pacer &burst(size_t burst);
+
+     /**
+      *  Check if the next packet can be sent
+      *
+      *  @param now The current time
+      *  @return `true` if there is no outstanding debt from previous sends
+      */
+      bool ready(clock::time_point now = clock::now());
+
+     /**
+      *  Account for bytes that have been sent
+      *
+      *  @param bytes The number of bytes sent
+      *  @param now The current time
+      */
+      void consume(size_t bytes, clock::time_point now = clock::now());
+
+     /**
+      *  Signal that the sender has nothing to send
+      *
+      *  The credit is limited to burst() bytes until the next consume(), so that packets queued after an idle period
+      *  do not go out in a long burst.
+      *
+      *  @param now The current time
+      */
+      void idle(clock::time_point now = clock::now());
+
+     /**
+      *  Get the time to wait until the next packet can be sent
+      *
+      *  @param now The current time
+      *  @return The time until ready() becomes `true`, zero if it already is
+      */
+      clock::duration wait_time(clock::time_point now = clock::now());
+
+     /**
+      *  Get the departure time of the next packet for kernel paced transmission
+      *
+      *  Departure times are spaced by the transmission time of each packet at the configured rate, independently of
+      *  the credit. Each call reserves the slot for a packet of @p bytes bytes.
+      *
+      *  @param bytes The size of the packet
+      *  @param now The current time
+      *  @return The time the packet should leave the host
+      */
+      clock::time_point departure_time(size_t bytes, clock::time_point now = clock::now());
+
+    private:
+      void refill(clock::time_point now);
+
+      uint64_t _rate;
+      size_t _burst;
+      double _credit = 0.0;                  //< Available credit in bytes, negative while paying back a send
+      bool _backlogged = false;              //< The sender has sent since it was last idle
+      clock::time_point _last_update;
+      clock::time_point _next_departure;
+  };
+};
@@ -16,9 +16,13 @@
 #pragma once
 #include <boost/asio.hpp>
 #include <boost/bind/bind.hpp>
+#include <chrono>
+#include <limits>
 #include <string>
 #include <map>
 #include <mutex>
+#include <regex>
+#include <vector>
 #include "File.h"
 #include "FileDeliveryTable.h"
 
@@ -35,6 +39,66 @@ namespace LibFlute {
       *  @returns shared_ptr to the received file
       */
       typedef std::function<void(std::shared_ptr<LibFlute::File>)> completion_callback_t;
+
+     /**
+      *  Per path reception statistics, see Statistics::paths
+      */
+      struct PathStatistics {
+        std::string iface;                  //< Local interface the path is received on
+        std::string address;                //< Multicast address of the path
+        uint64_t packets_received = 0;      //< Number of packets received on this path
+        uint64_t symbols_used = 0;          //< Number of symbols from this path that were new and went into a file
+        uint64_t symbols_duplicate = 0;     //< Number of symbols from this path that had already arrived on another path
+      };
+
+     /**
+      *  Reception statistics, see statistics()
+      */
+      struct Statistics {
+        uint64_t files_announced = 0;       //< Number of files taken from received FDTs for reception
+        uint64_t files_allocated = 0;       //< Number of files that received their first symbol and had their buffer allocated
+        uint64_t files_deferred = 0;        //< Number of current files still waiting for their first symbol
+        uint64_t deferred_bytes = 0;        //< Buffer memory currently saved by not allocating the deferred files
+        uint64_t never_allocated_bytes = 0; //< Buffer memory saved by files removed before any symbol arrived
+        uint64_t files_filtered = 0;        //< Number of FDT entries rejected by the reception filters
+        uint64_t packets_filtered = 0;      //< Number of packets dropped because their TOI was filtered out
+        uint64_t files_closed = 0;          //< Number of incomplete files released because the sender closed them
+        uint64_t sessions_closed = 0;       //< Number of times the sender closed the session
+        uint64_t files_rejected = 0;        //< Number of times a file was not received because of the admission limits
+        uint64_t packets_rate_limited = 0;  //< Number of packets dropped by the per source rate limits
+        uint64_t packets_invalid = 0;       //< Number of packets that could not be decoded
+        uint64_t symbols_duplicate = 0;     //< Number of symbols discarded because they had already been received
+        std::vector<PathStatistics> paths;  //< Statistics of each receive path, in the order they were given
+      };
+
+     /**
+      *  Admission limits to bound the memory and CPU used for reception, see admission_limits()
+      *
+      *  A value of 0 means no limit.
+      */
+      struct AdmissionLimits {
+        uint64_t max_file_size = 0;          //< Maximum transfer length in bytes of a file (including the FDT)
+        size_t max_concurrent_files = 0;     //< Maximum number of files being received at the same time
+        uint64_t max_source_packet_rate = 0; //< Maximum packets per second accepted from a single source address
+        uint64_t max_source_byte_rate = 0;   //< Maximum bytes per second accepted from a single source address
+      };
+
+     /**
+      *  Pattern syntax for the reception filters
+      */
+      enum PatternSyntax {
+        PATTERN_GLOB = 0, //< Shell style wildcard pattern using `*`, `?` and `[...]`
+        PATTERN_REGEX     //< ECMAScript regular expression
+      };
+
+     /**
+      *  A local interface and multicast address pair a session is received on
+      */
+      struct ReceivePath {
+        std::string iface;   //< Address of the (local) interface to receive on. 0.0.0.0 = any.
+        std::string address; //< Multicast address
+      };
+
      /**
       *  Default constructor.
       *
@@ -48,6 +112,28 @@ namespace LibFlute {
           short port, uint64_t tsi,
           boost::asio::io_context& io_context);
 
+     /**
+      *  Construct a receiver for a session that is sent redundantly over several paths
+      *
+      *  One socket is opened per path, and all of them feed the same reception state. Symbols are merged as they
+      *  arrive, so a file completes as soon as every symbol has been received on any of the paths, and losses on
+      *  one path are covered by the others without any switchover. Symbols that already arrived on another path
+      *  are discarded and counted as duplicates.
+      *
+      *  With more than one path, each socket is bound to the multicast address of its path, as a socket bound to the
+      *  address of an interface does not receive multicast traffic. The group is joined on the interface of the path,
+      *  and IP_MULTICAST_ALL is cleared where available so that each socket only receives its own group. A single path
+      *  is set up like the default constructor does.
+      *
+      *  @param paths Interface and multicast address pairs to receive the session on
+      *  @param port Target port
+      *  @param tsi TSI value of the session
+      *  @param io_context Boost io_context to run the socket operations in (must be provided by the caller)
+      */
+      Receiver( const std::vector<ReceivePath>& paths,
+          short port, uint64_t tsi,
+          boost::asio::io_context& io_context);
+
      /**
       *  Default destructor.
       */
@@ -85,23 +171,142 @@ namespace LibFlute {
       */
       void register_completion_callback(completion_callback_t cb) { _completion_cb = cb; };
 
+     /**
+      *  Add a Content-Location reception filter
+      *
+      *  Filters are evaluated when FDT entries are processed. Files that do not pass the filters never get a File
+      *  object and packets for them are dropped. If any Content-Location filters are set then a file is only received
+      *  if its Content-Location matches at least one of them. The pattern must match the whole Content-Location.
+      *
+      *  @param pattern The pattern to match the Content-Location against
+      *  @param syntax The syntax used by @p pattern (default: glob)
+      *  @return This Receiver object.
+      *
+      *  @throw std::regex_error If @p pattern is not a valid regular expression
+      */
+      Receiver &add_content_location_filter(const std::string& pattern, PatternSyntax syntax = PATTERN_GLOB);
+
+     /**
+      *  Add a Content-Type reception filter
+      *
+      *  If any Content-Type filters are set then a file is only received if its Content-Type matches at least one of
+      *  them.
+      *
+      *  @param pattern The pattern to match the Content-Type against
+      *  @param syntax The syntax used by @p pattern (default: glob)
+      *  @return This Receiver object.
+      *
+      *  @throw std::regex_error If @p pattern is not a valid regular expression
+      */
+      Receiver &add_content_type_filter(const std::string& pattern, PatternSyntax syntax = PATTERN_GLOB);
+
+     /**
+      *  Set the file size reception filter
+      *
+      *  Only files with a Content-Length (or Transfer-Length if no Content-Length is given) in the range
+      *  [@p min_size, @p max_size] will be received.
+      *
+      *  @param min_size The minimum file size in bytes
+      *  @param max_size The maximum file size in bytes
+      *  @return This Receiver object.
+      */
+      Receiver &file_size_filter(uint64_t min_size, uint64_t max_size = std::numeric_limits<uint64_t>::max());
+
+     /**
+      *  Remove all reception filters
+      *
+      *  @return This Receiver object.
+      */
+      Receiver &clear_filters();
+
+     /**
+      *  Get the admission limits
+      *
+      *  @return The current admission limits
+      */
+      const AdmissionLimits &admission_limits() const { return _limits; };
+
+     /**
+      *  Set the admission limits
+      *
+      *  The limits are checked before any buffer is allocated, so that a misconfigured or hostile sender cannot exhaust
+      *  the memory of the receiver. Files over the size limit are never received, files over the concurrency limit are
+      *  considered again when the next FDT instance arrives, and packets over the per source rate limits are dropped
+      *  before they are parsed. Dropped files and packets are counted in the statistics.
+      *
+      *  @param limits The new admission limits
+      *  @return This Receiver object.
+      */
+      Receiver &admission_limits(const AdmissionLimits& limits);
+
+     /**
+      *  Get the reception statistics
+      *
+      *  Files announced in the FDT only have their buffers allocated once the first symbol for them arrives. The
+      *  statistics report how much memory this is currently saving and has saved so far.
+      *
+      *  @return A snapshot of the current statistics
+      */
+      Statistics statistics();
+
       void stop() { _running = false; }
     private:
 
-      void handle_receive_from(const boost::system::error_code& error,
+      enum { max_length = 2048 };
+      struct Path {
+        Path(boost::asio::io_context& io_context) : socket(io_context) {};
+        boost::asio::ip::udp::socket socket;
+        boost::asio::ip::udp::endpoint sender_endpoint;
+        char data[max_length];
+        PathStatistics stats;
+      };
+
+      void start_receive(Path& path);
+      void handle_receive_from(Path& path, const boost::system::error_code& error,
           size_t bytes_recvd);
-      boost::asio::ip::udp::socket _socket;
-      boost::asio::ip::udp::endpoint _sender_endpoint;
+      std::map<uint64_t, std::shared_ptr<LibFlute::File>>::iterator erase_file(
+          std::map<uint64_t, std::shared_ptr<LibFlute::File>>::const_iterator it);
+      void handle_packet(Path& path, size_t bytes_recvd);
+      bool admit_from_source(const boost::asio::ip::address& source, size_t bytes);
+      void close_session();
+      void fdt_received(FileDeliveryTable& fdt);
+      void expire_fdt_instances();
+      void file_completed(uint64_t toi);
+      void start_file_reception(const FileDeliveryTable::FileEntry& file_entry);
+      void reapply_filters();
+      bool is_wanted(const FileDeliveryTable::FileEntry& entry) const;
+      static std::regex make_filter_regex(const std::string& pattern, PatternSyntax syntax);
 
-      enum { max_length = 2048 };
-      char _data[max_length];
+      std::vector<std::unique_ptr<Path>> _paths;
       uint64_t _tsi;
-      std::unique_ptr<LibFlute::FileDeliveryTable> _fdt;
+      struct Announcement {
+        FileDeliveryTable::FileEntry entry;
+        uint32_t fdt_instance_id;  //< The FDT instance that announced the file most recently
+        uint64_t expires;          //< Expiry of that instance
+      };
+      std::map<uint64_t, Announcement> _announced;  //< Files announced by the unexpired FDT instances, by TOI
+      std::map<uint32_t, uint64_t> _fdt_instances;  //< Expiry of the FDT instances that still announce a file, by ID
       std::map<uint64_t, std::shared_ptr<LibFlute::File>> _files;
       std::mutex _files_mutex;
-      std::string _mcast_address;
 
       completion_callback_t _completion_cb = nullptr;
+      Statistics _stats;
+
+      std::vector<std::regex> _content_location_filters;
+      std::vector<std::regex> _content_type_filters;
+      uint64_t _min_file_size = 0;
+      uint64_t _max_file_size = std::numeric_limits<uint64_t>::max();
+      std::map<uint64_t, unsigned long> _filtered_files; //< TOIs rejected by the filters and when that happened
+      std::map<uint64_t, unsigned long> _completed_files; //< TOIs of the files completed and when that happened
+
+      AdmissionLimits _limits;
+      struct SourceBucket {
+        double packets;
+        double bytes;
+        std::chrono::steady_clock::time_point last_update;
+      };
+      enum { max_tracked_sources = 1024 };
+      std::map<boost::asio::ip::address, SourceBucket> _source_buckets;
 
       bool _running = true;
   };
@@ -0,0 +1,125 @@
+// libflute - FLUTE/ALC library
+//
+// Copyright (C) 2026 libflute contributors
+//
+// Licensed under the License terms and conditions for use, reproduction, and
+// distribution of 5G-MAG software (the “License”).  You may not use this file
+// except in compliance with the License.  You may obtain a copy of the License at
+// https://www.5g-mag.com/reference-tools.  Unless required by applicable law or
+// agreed to in writing, software distributed under the License is distributed on
+// an “AS IS” BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied.
+//
+// See the License for the specific language governing permissions and limitations
+// under the License.
+//
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <vector>
+
+namespace LibFlute {
+  /**
+   *  Decides which of the queued objects the Transmitter sends the next packet from.
+   *
+   *  Objects are identified by their TOI. The Transmitter adds an object when it is queued and removes it again once
+   *  it has been transmitted or removed from the session. All methods are called with the file queue of the
+   *  Transmitter locked, so implementations do not need any locking of their own.
+   */
+  class Scheduler {
+    public:
+     /**
+      *  Priority the Transmitter uses for the FDT (TOI 0), so that receivers learn about an object before its packets
+      *  arrive.
+      */
+      static constexpr unsigned fdt_priority = ~0U;
+
+     /**
+      *  Function that sends the next packet of an object.
+      *
+      *  @param toi The TOI of the object to send a packet from
+      *  @return The number of bytes sent, 0 if the object has nothing to send at the moment
+      */
+      typedef std::function<size_t(uint32_t toi)> send_function_t;
+
+      virtual ~Scheduler() = default;
+
+     /**
+      *  Add an object, or update the parameters of an object that has already been added
+      *
+      *  @param toi The TOI of the object
+      *  @param priority Priority class of the object, higher classes are served first
+      *  @param weight Relative share of the object within its priority class
+      */
+      virtual void add(uint32_t toi, unsigned priority, unsigned weight) = 0;
+
+     /**
+      *  Remove an object
+      *
+      *  @param toi The TOI of the object
+      */
+      virtual void remove(uint32_t toi) = 0;
+
+     /**
+      *  Send the next packet
+      *
+      *  Calls @p send for the objects in scheduling order until one of them sends a packet.
+      *
+      *  @param send Function to send a packet from an object
+      *  @return The number of bytes sent, 0 if none of the objects had anything to send
+      */
+      virtual size_t schedule(const send_function_t &send) = 0;
+  };
+
+  /**
+   *  Scheduler with strict priority classes and deficit round robin within each class.
+   *
+   *  The highest priority class that has anything to send is always served first. Within a class the objects take
+   *  turns, and on each turn an object may send its weight times the quantum in bytes. The credit of an object may go
+   *  negative by up to one packet, which is paid back on its next turn, so the shares hold for any packet size. An
+   *  object that has nothing to send when its turn comes loses the rest of its credit for that turn.
+   */
+  class DeficitRoundRobinScheduler : public Scheduler {
+    public:
+     /**
+      *  Default quantum in bytes (one full size Ethernet frame)
+      */
+      static constexpr size_t default_quantum = 1500;
+
+     /**
+      *  Constructor.
+      *
+      *  @param quantum Bytes an object of weight 1 may send on each of its turns
+      */
+      DeficitRoundRobinScheduler(size_t quantum = default_quantum);
+
+     /**
+      *  Get the quantum
+      *
+      *  @return The bytes an object of weight 1 may send on each of its turns
+      */
+      size_t quantum() const { return _quantum; };
+
+      void add(uint32_t toi, unsigned priority, unsigned weight) override;
+      void remove(uint32_t toi) override;
+      size_t schedule(const send_function_t &send) override;
+
+    private:
+      struct Entry {
+        uint32_t toi;
+        unsigned weight;
+        int64_t deficit;       //< Bytes the object may still send on this turn, negative while paying back a packet
+        uint64_t stalled;      //< Last schedule() call in which the object had nothing to send
+      };
+      struct PriorityClass {
+        std::vector<Entry> entries;
+        size_t current = 0;    //< Index of the entry whose turn it is
+      };
+
+      size_t _quantum;
+      uint64_t _schedule_count = 0;
+      std::map<unsigned, PriorityClass, std::greater<unsigned>> _classes;
+  };
+};
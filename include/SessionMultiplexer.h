@@ -0,0 +1,359 @@
+// libflute - FLUTE/ALC library
+//
+// Copyright (C) 2026 libflute contributors
+//
+// Licensed under the License terms and conditions for use, reproduction, and
+// distribution of 5G-MAG software (the “License”).  You may not use this file
+// except in compliance with the License.  You may obtain a copy of the License at
+// https://www.5g-mag.com/reference-tools.  Unless required by applicable law or
+// agreed to in writing, software distributed under the License is distributed on
+// an “AS IS” BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied.
+//
+// See the License for the specific language governing permissions and limitations
+// under the License.
+//
+#pragma once
+#include <boost/asio.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "EncodingSymbol.h"
+#include "Pacer.h"
+#include "Scheduler.h"
+
+namespace LibFlute {
+
+  class File;
+  class Transmitter;
+
+  /**
+   *  Sends the packets of many FLUTE sessions through one socket and one rate limiter.
+   *
+   *  Each session is a Transmitter constructed on the multiplexer, with its own TSI, FDT, TOI space and file queue.
+   *  The multiplexer paces the combined traffic of all sessions to its rate limit and shares the transmission between
+   *  the sessions by their weights (see Transmitter::session_weight()) with a DeficitRoundRobinScheduler, so the total
+   *  egress rate holds however many sessions there are. A Transmitter constructed on its own owns a multiplexer
+   *  hosting just that session.
+   *
+   *  By default packets are built and sent on the thread running the io_context. With worker_threads() the packets
+   *  are built and sent by worker threads with a socket each, to spread the work over several cores.
+   *
+   *  All sessions must use destinations of the protocol the multiplexer was created for. They must be destroyed before
+   *  the multiplexer, and sessions must only be created or destroyed while the io_context is not running or from
+   *  within its thread.
+   */
+  class SessionMultiplexer {
+    public:
+     /**
+      *  Transmission statistics, see statistics()
+      */
+      struct Statistics {
+        uint64_t packets_sent = 0;   //< Number of ALC packets passed to the socket
+        uint64_t bytes_sent = 0;     //< Number of bytes passed to the socket, including any tunnel encapsulation
+        uint64_t send_calls = 0;     //< Number of socket send calls used for the ALC packets
+        uint64_t zerocopy_copied = 0; //< Number of packets sent with MSG_ZEROCOPY that the kernel copied after all
+        uint64_t prefetched_bytes = 0; //< Bytes of mapped files read into memory ahead of the transmission (per session)
+        uint64_t prefetch_misses = 0;  //< Source blocks of mapped files sent before they had been read (per session)
+        uint64_t page_fault_stalls = 0; //< Pages of those blocks that were not in memory, each stalls the sending
+                                        //< thread on a page fault (per session)
+      };
+
+     /**
+      *  Constructor.
+      *
+      *  @param io_context Boost io_context to run the socket operations in (must be provided by the caller)
+      *  @param rate_limit Transmit rate limit for all sessions together (in kbps)
+      *  @param protocol Protocol of the session destinations (default: IPv4)
+      */
+      SessionMultiplexer(boost::asio::io_context& io_context, uint32_t rate_limit,
+          const boost::asio::ip::udp &protocol = boost::asio::ip::udp::v4());
+
+     /**
+      *  Default destructor.
+      */
+      virtual ~SessionMultiplexer();
+
+     /**
+      * Get Maximum Bit Rate
+      *
+      * @return The maximum bit rate of all sessions together, 0 means no limit.
+      */
+      uint32_t rate_limit() const { return _rate_limit; };
+
+     /**
+      * Set Maximum Bit Rate
+      *
+      * Sets the MBR for the transmission of all sessions together. A value of 0 indicates no rate limit. Tunnelled
+      * packets are counted with their encapsulation headers, as they are passed to the socket.
+      *
+      * @param limit The new MBR to set.
+      * @return This SessionMultiplexer object.
+      */
+      SessionMultiplexer &rate_limit(uint32_t limit);
+
+     /**
+      * Get the pacing burst size
+      *
+      * @return The maximum number of bytes sent back to back to catch up after a late wakeup.
+      */
+      size_t pacing_burst() const { return _pacer.burst(); };
+
+     /**
+      * Set the pacing burst size
+      *
+      * @param bytes The new burst size in bytes.
+      * @return This SessionMultiplexer object.
+      * @see Transmitter::pacing_burst(size_t)
+      */
+      SessionMultiplexer &pacing_burst(size_t bytes);
+
+     /**
+      * Get the kernel pacing mode
+      *
+      * @return `true` if packets are sent with SO_TXTIME departure times.
+      */
+      bool txtime_pacing() const { return _txtime_pacing; };
+
+     /**
+      * Enable or disable kernel pacing
+      *
+      * @param enable `true` to enable kernel pacing.
+      * @return This SessionMultiplexer object.
+      * @see Transmitter::txtime_pacing(bool)
+      */
+      SessionMultiplexer &txtime_pacing(bool enable);
+
+     /**
+      * Get the send batch size
+      *
+      * @return The maximum number of packets passed to the socket in one send call.
+      */
+      unsigned send_batch_size() const { return _send_batch_size; };
+
+     /**
+      * Set the send batch size
+      *
+      * A batch may hold packets of several sessions.
+      *
+      * @param size The new batch size, a value of 0 is treated as 1.
+      * @return This SessionMultiplexer object.
+      * @see Transmitter::send_batch_size(unsigned)
+      */
+      SessionMultiplexer &send_batch_size(unsigned size);
+
+     /**
+      * Get the UDP segmentation offload mode
+      *
+      * @return `true` if UDP generic segmentation offload is enabled.
+      */
+      bool udp_gso() const { return _udp_gso; };
+
+     /**
+      * Enable or disable UDP segmentation offload
+      *
+      * A segmented send only spans packets for the same destination.
+      *
+      * @param enable `true` to enable segmentation offload.
+      * @return This SessionMultiplexer object.
+      * @see Transmitter::udp_gso(bool)
+      */
+      SessionMultiplexer &udp_gso(bool enable) { _udp_gso = enable; return *this; };
+
+     /**
+      * Get the zero copy mode
+      *
+      * @return `true` if packets are sent with MSG_ZEROCOPY.
+      */
+      bool zerocopy() const { return _zerocopy; };
+
+     /**
+      * Enable or disable zero copy transmission
+      *
+      * @param enable `true` to enable zero copy transmission.
+      * @return This SessionMultiplexer object.
+      * @see Transmitter::zerocopy(bool)
+      */
+      SessionMultiplexer &zerocopy(bool enable);
+
+     /**
+      * Get the number of worker threads
+      *
+      * @return The number of threads building and sending packets, 0 if that is done on the io_context thread.
+      */
+      unsigned worker_threads() const { return _worker_threads; };
+
+     /**
+      * Set the number of worker threads
+      *
+      * With worker threads, each thread has a socket of its own and takes turns with the other threads at picking the
+      * symbols for a batch of packets (see send_batch_size()) from the sessions. The headers and checksums of the batch
+      * are then built and the batch is sent in parallel with the other threads. Every object is always sent by the
+      * same thread, so the packets of an object leave in order, while different objects are sent in parallel. A
+      * single large object is therefore not sped up. While a new FDT instance is being sent, the other objects of its
+      * session wait for it, so that no packet overtakes the FDT instance describing its object. The rate limit applies
+      * to all threads together. The completion callbacks of the sessions are still called on the io_context thread.
+      *
+      * Zero copy transmission is not available with worker threads and is disabled when they are started.
+      *
+      * @param count The number of worker threads, 0 to send on the io_context thread (default)
+      * @return This SessionMultiplexer object.
+      */
+      SessionMultiplexer &worker_threads(unsigned count);
+
+     /**
+      * Get the transmission statistics
+      *
+      * @return A snapshot of the current statistics of all sessions together.
+      */
+      Statistics statistics() const;
+
+    private:
+      friend class Transmitter;
+
+      static constexpr size_t tunnel_headroom = 20 /* IP header */ + 8 /* UDP header */;
+      struct PacketBuffer {
+        Transmitter *session = nullptr;          //< Session the packet belongs to, unset once the session is gone
+        std::atomic<bool> dropped = false;       //< The session was removed before the packet was sent, it is not sent
+        bool control = false;                    //< Session control packet without symbols, built when it was queued
+        boost::asio::ip::udp::endpoint destination; //< Where to send the packet, the tunnel endpoint if tunnelled
+        std::shared_ptr<File> file;              //< File the symbols belong to
+        std::vector<EncodingSymbol> symbols;     //< Symbols carried in the packet
+        FecOti fec_oti = {};                     //< FEC OTI of the file when the symbols were taken
+        bool ext_fti = false;                    //< Signal fec_oti in an EXT_FTI header extension
+        std::vector<char> buffer;                //< Headroom for the tunnel headers followed by the ALC headers
+        size_t alc_size = 0;                     //< Size of the ALC packet, including the symbol data
+        bool encapsulated = false;               //< IP and UDP headers have been written into the headroom
+        boost::asio::ip::udp::endpoint inner_destination; //< Destination in the encapsulated headers
+        boost::asio::ip::address inner_source;   //< Source address in the encapsulated headers
+        std::vector<boost::asio::const_buffer> segments; //< Headers followed by the symbol data in the file buffer
+        Pacer::clock::time_point departure;      //< Departure time for kernel pacing
+        alignas(std::max_align_t) unsigned char handler_memory[256]; //< Completion handler storage for the send in flight
+        bool handler_memory_in_use = false;
+        uint32_t zerocopy_id = 0;                //< Notification ID of the MSG_ZEROCOPY send of the packet
+        PacketBuffer *next_in_flight = nullptr;  //< Next packet waiting for a zero copy completion
+
+        char *alc() { return buffer.data() + tunnel_headroom; };
+        size_t size() const { return encapsulated ? alc_size + tunnel_headroom : alc_size; };
+      };
+
+      struct SendBuffers;
+      /**
+       * Socket with the batch being sent through it
+       */
+      struct Lane {
+        Lane(boost::asio::io_context& io_context, const boost::asio::ip::udp &protocol, unsigned index);
+        ~Lane();
+
+        unsigned index;                          //< Index of the worker thread, 0 for the io_context thread
+        bool worker;                             //< Send results are handed to the io_context thread in completions
+        boost::asio::ip::udp::socket socket;
+        std::unique_ptr<SendBuffers> send_buffers;
+        std::vector<PacketBuffer*> batch;
+        size_t batch_sent = 0;                   //< Number of entries at the start of batch that have been sent
+        uint32_t batch_bytes = 0;
+        std::vector<std::pair<PacketBuffer*, bool>> completions; //< Packets sent by a worker and whether they went out
+      };
+      struct Worker {
+        Worker(const boost::asio::ip::udp &protocol, unsigned index) : lane(io_context, protocol, index) {};
+
+        boost::asio::io_context io_context;      //< Only owns the socket, never run
+        Lane lane;
+        std::thread thread;
+      };
+
+      uint32_t add_session(Transmitter *session, unsigned weight);
+      void remove_session(uint32_t id);
+      void session_weight(uint32_t id, unsigned weight);
+      void session_activated();
+      void session_deactivated();
+      void packets_queued();
+      void send_control_packet(PacketBuffer *packet);
+      bool sessions_sending() const;
+      void bind(const boost::asio::ip::address &address);
+      void setup_socket(boost::asio::ip::udp::socket &socket);
+      bool sends_object(uint32_t session_id, uint32_t toi) const;
+
+      PacketBuffer *allocate_packet();
+      void release_packet(PacketBuffer *packet);
+
+      void send_next_packet();
+      uint32_t send_single_packet();
+      PacketBuffer *next_packet();
+      void packet_sent(PacketBuffer *packet, bool success);
+      void packet_accepted(Lane &lane, PacketBuffer *packet, uint32_t zerocopy_id);
+      void packet_failed(Lane &lane, PacketBuffer *packet);
+      void fill_batch(Lane &lane);
+      bool flush_batch(Lane &lane);
+      void run_worker(Worker &worker);
+      void stop_workers();
+      void post(std::function<void()> handler);
+      void wait_zerocopy_completions();
+      void handle_zerocopy_completions();
+      bool zerocopy_completed(uint32_t first_id, uint32_t last_id, bool copied);
+
+      boost::asio::io_context& _io_context;
+      boost::asio::ip::udp _protocol;
+      std::optional<boost::asio::ip::address> _source_address;
+      Lane _lane;                   //< Socket of the io_context thread, also used for session control packets
+      boost::asio::steady_timer _send_timer;
+      bool _send_idle = false;      //< _send_timer polls for packets, there were none to send
+      std::atomic<bool> _wakeup_pending = false; //< packets_queued() is ending the idle poll
+      struct PendingHandlers {
+        std::mutex mutex;
+        std::condition_variable done;
+        unsigned running = 0;               //< Handlers posted to the io_context that are running
+        bool closed = false;                //< The SessionMultiplexer is gone, posted handlers are dropped
+      };
+      std::shared_ptr<PendingHandlers> _pending_handlers = std::make_shared<PendingHandlers>();
+
+      std::map<uint32_t, Transmitter*> _sessions;
+      std::mutex _sessions_mutex;
+      DeficitRoundRobinScheduler _session_scheduler; //< Shares the transmission between sessions, guarded by _sessions_mutex
+      uint32_t _next_session_id = 0;
+      std::deque<PacketBuffer*> _control_packets; //< Sent ahead of the files of all sessions, guarded by _sessions_mutex
+      bool _running = false;        //< At least one session is active and the send loop is running
+
+      uint32_t _rate_limit = 0;
+      Pacer _pacer;                 //< Guarded by _sessions_mutex while there are worker threads
+      bool _txtime_pacing = false;
+
+      std::vector<std::unique_ptr<Worker>> _workers;
+      std::atomic<unsigned> _worker_threads = 0;
+      std::condition_variable _workers_wakeup; //< Signalled with _sessions_mutex when the workers have to look again
+      bool _stop_workers = false;
+      const Lane *_filling = nullptr; //< Worker lane filling a batch, guarded by _sessions_mutex
+      unsigned _building = 0;       //< Workers building the packets of their batch, guarded by _sessions_mutex
+      std::condition_variable _building_done; //< Signalled with _sessions_mutex when a worker has built its batch
+
+      enum { max_gso_segments = 64, max_udp_payload = 65507, max_zerocopy_frags = 17 };
+      unsigned _send_batch_size = 1;
+      std::vector<std::unique_ptr<PacketBuffer>> _packet_pool; //< All packet buffers, reused once they have been sent
+      std::vector<PacketBuffer*> _free_packets;
+      std::mutex _pool_mutex;       //< Guards the packet pool, packets are built and released on different threads
+      bool _batch_blocked = false;  //< Waiting for the socket to become writable
+      std::atomic<bool> _udp_gso = false;
+
+      bool _zerocopy = false;
+      uint32_t _zerocopy_next_id = 0;             //< Notification ID of the next MSG_ZEROCOPY send
+      PacketBuffer *_zerocopy_head = nullptr;     //< Oldest packet waiting for a zero copy completion
+      PacketBuffer *_zerocopy_tail = nullptr;
+      bool _zerocopy_wait = false;                //< Waiting for completions on the socket error queue
+      bool _zerocopy_blocked = false;             //< Out of kernel memory for zero copy sends until completions arrive
+
+      std::atomic<uint64_t> _packets_sent = 0;
+      std::atomic<uint64_t> _bytes_sent = 0;
+      std::atomic<uint64_t> _send_calls = 0;
+      std::atomic<uint64_t> _zerocopy_copied = 0;
+  };
+
+} // end namespace LibFlute
@@ -17,25 +17,41 @@
 #pragma once
 #include <boost/asio.hpp>
 #include <boost/bind/bind.hpp>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <list>
 #include <queue>
+#include <set>
 #include <string>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <optional>
+#include <vector>
 //#include "File.h"
 #include "AlcPacket.h"
+#include "ContentSource.h"
 #include "FileDeliveryTable.h"
+#include "Scheduler.h"
+#include "SessionMultiplexer.h"
 
 namespace LibFlute {
 
   class File;
+  struct ReadAheadStatistics;
 
   /**
    *  FLUTE transmitter class. Construct an instance of this to send data through a FLUTE/ALC session.
    *
    *  The session can be active (sending packets) or inactive (sending of packets paused). This allows the FLUTE session to be
    *  suspended using the deactivate() method and later resumed using activate().
+   *
+   *  A Transmitter either sends through a socket and rate limiter of its own, or is one of many sessions hosted by a
+   *  SessionMultiplexer that share a socket and rate limiter.
    */
   class Transmitter {
     public:
@@ -95,6 +111,19 @@ namespace LibFlute {
         */
         FileDescription(const std::string &content_location, const char *data, size_t length);
 
+       /**
+        * Make a file description using content read from a source while the file is transmitted
+        *
+        * The content is not held in memory as a whole, the Transmitter reads it a few source blocks ahead of the
+        * transmission, see ContentSource. The length must be known up front as it is announced in the FDT. No MD5 is
+        * calculated for the content, and it cannot be compressed.
+        *
+        * @param content_location The URL to use as the content location in the FDT when sending the file
+        * @param source The source to read the file contents from
+        * @param length The length of the file contents in bytes
+        */
+        FileDescription(const std::string &content_location, const std::shared_ptr<ContentSource> &source, size_t length);
+
        /**
         * Make a file description without contents
         *
@@ -215,6 +244,16 @@ namespace LibFlute {
         */
         size_t data_length();
 
+       /**
+        * Is the content a memory mapping of a local file?
+        *
+        * Mapped content is only read from storage when its pages are first touched. The Transmitter reads it ahead of the
+        * transmission, see Transmitter::source_read_ahead().
+        *
+        * @return `true` if data() points to a mapping of the file given to the constructor or set_content()
+        */
+        bool is_mapped() const;
+
        /**
         * Set the compression algorithm
         *
@@ -274,6 +313,84 @@ namespace LibFlute {
         FileDescription &set_content(const std::vector<unsigned char> &data);
        /**@}*/
 
+       /**
+        * Change the file contents to content read from a source
+        *
+        * This will alter the contents associated with this file description and replace them with the content of the
+        * source, see FileDescription(const std::string&, const std::shared_ptr<ContentSource>&, size_t).
+        * This will reset the TOI.
+        *
+        * @param source The source to read the new file contents from
+        * @param length The length of the new file contents in bytes
+        * @return this file description
+        */
+        FileDescription &set_content(const std::shared_ptr<ContentSource> &source, size_t length);
+
+       /**
+        * Get the content source
+        *
+        * @return The source the file contents are read from, or nullptr if they are held in memory
+        */
+        const std::shared_ptr<ContentSource> &source() const { return _source; };
+
+       /**
+        * Make the file a growing object
+        *
+        * This replaces the contents of the file description with an empty buffer that content is added to using append(),
+        * for example the chunks of a media segment while the encoder is still writing it. The file can be sent before
+        * it is complete, its encoding symbols are sent as soon as they are filled. Once all the content has been added
+        * finalize() announces the final length and MD5 to the receivers.
+        *
+        * A growing object is sent as a single source block, so @p max_length can be at most 65536 times the encoding
+        * symbol length. Memory for the buffer is reserved up front, but is only used as content is added. Growing objects
+        * cannot be compressed.
+        * This will reset the TOI.
+        *
+        * @param max_length The maximum length in bytes the object can grow to
+        * @return this file description
+        * @see append()
+        * @see finalize()
+        */
+        FileDescription &set_growing(size_t max_length);
+
+       /**
+        * Add content to the end of a growing object
+        *
+        * This may be called while the Transmitter is sending the file, but not concurrently with finalize() or another
+        * append() for the same file.
+        *
+        * @param data The content to add
+        * @param length The length of the content to add
+        * @return this file description
+        * @see set_growing()
+        */
+        FileDescription &append(const char *data, size_t length);
+
+       /**
+        * Finish a growing object
+        *
+        * The content of the object is complete, its length and MD5 are set and announced with the remaining packets of
+        * the object and the next FDT instance.
+        *
+        * @return this file description
+        * @see set_growing()
+        */
+        FileDescription &finalize();
+
+       /**
+        * Is this a growing object that has not been finalized yet?
+        *
+        * @return `true` if content can still be added with append()
+        */
+        bool is_growing() const;
+
+       /**
+        * Get the maximum length of the file contents
+        *
+        * @return The maximum length a growing object can grow to, or the length of the contents for other files
+        */
+        size_t max_length() const;
+
        /**
         * Change the file content type
         *
@@ -316,6 +433,65 @@ namespace LibFlute {
         */
         const std::string &get_etag() const;
 
+       /**
+        *  Set the scheduling priority of the file
+        *
+        *  Files in a higher priority class are always sent before files in a lower one, so that small urgent files
+        *  are delivered with a bounded delay while bulk files continue in the background.
+        *
+        *  @param priority The priority class, higher values are sent first (default: 0)
+        *  @return this file description
+        */
+        FileDescription &set_priority(unsigned priority) { _priority = priority; return *this; };
+
+       /**
+        *  Get the scheduling priority of the file
+        *
+        *  @return The priority class of the file
+        */
+        unsigned get_priority() const { return _priority; };
+
+       /**
+        *  Set the scheduling weight of the file
+        *
+        *  Files in the same priority class share the transmission in proportion to their weights.
+        *
+        *  @param weight The relative share of the file, a value of 0 is treated as 1 (default: 1)
+        *  @return this file description
+        */
+        FileDescription &set_weight(unsigned weight) { _weight = weight; return *this; };
+
+       /**
+        *  Get the scheduling weight of the file
+        *
+        *  @return The relative share of the file within its priority class
+        */
+        unsigned get_weight() const { return _weight; };
+
+       /**
+        *  Set the carousel repetition interval
+        *
+        *  A file with a repetition interval is repeated by the Transmitter until it is removed with
+        *  Transmitter::remove(). A new round of the file is started at most once per @p interval, a zero interval
+        *  repeats the file back to back at the share of the transmission given by set_priority() and set_weight().
+        *  The packetisation state and the encoded contents are kept between rounds, and the FDT is only changed when
+        *  files join or leave the carousel.
+        *
+        *  @param interval The repetition interval, or std::nullopt to send the file once (default)
+        *  @return this file description
+        */
+        FileDescription &set_carousel_interval(const std::optional<std::chrono::milliseconds> &interval) {
+          _carousel_interval = interval;
+          return *this;
+        };
+
+       /**
+        *  Get the carousel repetition interval
+        *
+        *  @return The repetition interval, or std::nullopt if the file is sent once
+        */
+        const std::optional<std::chrono::milliseconds> &get_carousel_interval() const { return _carousel_interval; };
+
       protected:
         friend class Transmitter;
        /**
@@ -347,6 +523,8 @@ namespace LibFlute {
         void _free_file_data();
         void _calculate_file_entry();
 
+        struct GrowingContent;
+
         std::optional<uint64_t> _tsi; //< The last TSI this file was associated with
         FileDeliveryTable::FileEntry _file_entry; //< The FDT File entry values to use
         CompressionAlgorithm _compression_type;   //< The compression to apply to _data
@@ -354,16 +532,29 @@ namespace LibFlute {
         int _file_handle;                         //< The file handle of the open _filename
         const char *_data;                        //< The uncompressed file contents (may be mapped file)
         size_t _data_length;                      //< The length of the uncompressed file contents
+        unsigned _priority = 0;                   //< The scheduling priority class
+        unsigned _weight = 1;                     //< The scheduling weight within the priority class
+        std::optional<std::chrono::milliseconds> _carousel_interval; //< Repetition interval, unset to send once
+        std::shared_ptr<GrowingContent> _growing; //< Buffer of a growing object, shared by copies of the description
+        std::shared_ptr<ContentSource> _source;   //< Source the contents are read from while sending, if not in _data
       };
 
      /**
       *  Definition of a file transmission completion callback function that can be
       *  registered through ::register_completion_callback.
       *
+      *  For files in the carousel (see FileDescription::set_carousel_interval()) this is called at the end of every
+      *  round.
+      *
       *  @param toi TOI of the file that has completed transmission
       */
       typedef std::function<void(uint32_t)> completion_callback_t;
 
+     /**
+      *  Transmission statistics, see statistics()
+      */
+      using Statistics = SessionMultiplexer::Statistics;
+
      /**
       *  Constructor.
       *
@@ -403,6 +594,34 @@ namespace LibFlute {
           bool active = true,
           const std::optional<std::string>& source_address = std::nullopt);
 
+     /**
+      *  Constructor for a session hosted by a SessionMultiplexer.
+      *
+      *  Creates a Transmitter that sends through the socket of @p multiplexer, at a share of its rate limit given by
+      *  session_weight(). The parameters are as for the other constructor.
+      *
+      *  @param multiplexer The multiplexer to host the session, it must outlive the Transmitter
+      *  @param destination_address Target (multicast) address, if @p tunnel_endpoint is given then this is the encapsulated
+      *                             destination IP address
+      *  @param port Target port
+      *  @param tsi TSI value for the session
+      *  @param mtu Path MTU to size FLUTE packets for
+      *  @param tunnel_endpoint Tunnelling endpoint address (default: no tunnelling)
+      *  @param fdt_namespace Which XML namespace to use for the FDT (default: none)
+      *  @param active Start as active/inactive FLUTE session (default: active)
+      *  @param source_address Source address (default: automatically assign source address)
+      *
+      *  @throw boost::system::system_error When @p source_address is given a value and @p tunnel_endpoint has no value and the
+      *                            socket of @p multiplexer could not be bound to the address in @p source_address.
+      */
+      Transmitter( SessionMultiplexer& multiplexer,
+          const std::string& destination_address,
+          short port, uint64_t tsi, unsigned short mtu,
+          const std::optional<boost::asio::ip::udp::endpoint>& tunnel_endpoint = std::nullopt,
+          FdtNamespace fdt_namespace = FileDeliveryTable::FDT_NS_NONE,
+          bool active = true,
+          const std::optional<std::string>& source_address = std::nullopt);
+
      /**
       *  Default destructor.
       */
@@ -469,9 +688,12 @@ namespace LibFlute {
       *
       * Returns the maximum bit rate (MBR) value that the Transmitter is using. A 0 MBR means no limit.
       *
+      * The rate limit and the other transmission settings below up to statistics() belong to the SessionMultiplexer the
+      * Transmitter sends through, so for a hosted session they apply to all sessions of the multiplexer together.
+      *
       * @return The maximum bit rate.
       */
-      uint32_t rate_limit() const { return _rate_limit; };
+      uint32_t rate_limit() const { return _multiplexer->rate_limit(); };
 
      /**
       * Set Maximum Bit Rate
@@ -481,7 +703,248 @@ namespace LibFlute {
       * @param limit The new MBR to set.
       * @return This Transmitter object.
       */
-      Transmitter &rate_limit(uint32_t limit) { _rate_limit = limit; return *this; };
+      Transmitter &rate_limit(uint32_t limit) { _multiplexer->rate_limit(limit); return *this; };
+
+     /**
+      * Get the pacing burst size
+      *
+      * @return The maximum number of bytes sent back to back to catch up after a late wakeup.
+      */
+      size_t pacing_burst() const { return _multiplexer->pacing_burst(); };
+
+     /**
+      * Set the pacing burst size
+      *
+      * The rate limiter is a token bucket that is checked against a monotonic clock. Each wakeup of the transmitter
+      * sends packets until the credit is used up, so a wakeup that comes late because of timer slack is caught up with
+      * a short burst and the average rate is kept. This limits how large such a burst can get.
+      *
+      * @param bytes The new burst size in bytes.
+      * @return This Transmitter object.
+      */
+      Transmitter &pacing_burst(size_t bytes) { _multiplexer->pacing_burst(bytes); return *this; };
+
+     /**
+      * Get the kernel pacing mode
+      *
+      * @return `true` if packets are sent with SO_TXTIME departure times.
+      */
+      bool txtime_pacing() const { return _multiplexer->txtime_pacing(); };
+
+     /**
+      * Enable or disable kernel pacing
+      *
+      * When enabled, each packet of a batch is given a departure time with SO_TXTIME, spaced at the rate limit, so
+      * that the kernel spreads the batch out instead of sending it as a burst. This needs the fq queueing discipline
+      * on the outgoing interface and only applies when send_batch_size() is above 1. If the socket option cannot be
+      * set, kernel pacing stays disabled.
+      *
+      * @param enable `true` to enable kernel pacing.
+      * @return This Transmitter object.
+      */
+      Transmitter &txtime_pacing(bool enable) { _multiplexer->txtime_pacing(enable); return *this; };
+
+     /**
+      * Set the scheduler
+      *
+      * The scheduler decides which of the queued files each packet is sent from. The default is a
+      * DeficitRoundRobinScheduler, which sends the files of the highest priority class first and shares the
+      * transmission between the files of a class by their weights (see FileDescription::set_priority() and
+      * FileDescription::set_weight()). The FDT is scheduled with Scheduler::fdt_priority.
+      *
+      * @param scheduler The new scheduler, or `nullptr` to restore the default.
+      * @return This Transmitter object.
+      *
+      * @throw const char* If there are files queued for sending.
+      */
+      Transmitter &scheduler(std::unique_ptr<Scheduler> scheduler);
+
+     /**
+      * Get the send batch size
+      *
+      * @return The maximum number of packets passed to the socket in one send call.
+      */
+      unsigned send_batch_size() const { return _multiplexer->send_batch_size(); };
+
+     /**
+      * Set the send batch size
+      *
+      * With a batch size of 1 (the default) each packet is sent with its own asynchronous send operation. With a larger
+      * batch size up to that many packets are built on each transmission tick and passed to the socket with a single
+      * sendmmsg() call (or one send per packet where sendmmsg() is not available). The rate limiter paces whole batches,
+      * so a large batch with a low rate limit makes the traffic more bursty.
+      *
+      * @param size The new batch size, a value of 0 is treated as 1.
+      * @return This Transmitter object.
+      */
+      Transmitter &send_batch_size(unsigned size) { _multiplexer->send_batch_size(size); return *this; };
+
+     /**
+      * Get the UDP segmentation offload mode
+      *
+      * @return `true` if UDP generic segmentation offload is enabled.
+      */
+      bool udp_gso() const { return _multiplexer->udp_gso(); };
+
+     /**
+      * Enable or disable UDP segmentation offload
+      *
+      * When enabled, runs of equally sized packets within a batch are passed to the kernel as one large datagram with
+      * the UDP_SEGMENT option, and the kernel (or the network card) splits it into the individual packets. This only
+      * has an effect when send_batch_size() is above 1. If the kernel or the outgoing interface does not support
+      * segmentation offload, the mode is switched off again and the batches are sent as separate packets.
+      *
+      * @param enable `true` to enable segmentation offload.
+      * @return This Transmitter object.
+      */
+      Transmitter &udp_gso(bool enable) { _multiplexer->udp_gso(enable); return *this; };
+
+     /**
+      * Get the zero copy mode
+      *
+      * @return `true` if packets are sent with MSG_ZEROCOPY.
+      */
+      bool zerocopy() const { return _multiplexer->zerocopy(); };
+
+     /**
+      * Enable or disable zero copy transmission
+      *
+      * When enabled, packets are sent with MSG_ZEROCOPY so that the kernel transmits the symbol data straight from the
+      * file buffers instead of copying it into socket buffers. A packet, and the file it points into, is then only
+      * released when the kernel reports on the socket error queue that it has finished with the data, so packets are
+      * only counted as sent at that point. Packets are always sent through the batch path in this mode, even with a
+      * batch size of 1.
+      *
+      * Zero copy only pays off for large sends on network interfaces that support scatter-gather. Where the kernel has
+      * to copy the data after all, for example on the loopback interface, this is counted in
+      * Statistics::zerocopy_copied. If the socket option cannot be set, zero copy stays disabled.
+      *
+      * @param enable `true` to enable zero copy transmission.
+      * @return This Transmitter object.
+      */
+      Transmitter &zerocopy(bool enable) { _multiplexer->zerocopy(enable); return *this; };
+
+     /**
+      * Get the number of worker threads
+      *
+      * @return The number of threads building and sending packets, 0 if that is done on the io_context thread.
+      */
+      unsigned worker_threads() const { return _multiplexer->worker_threads(); };
+
+     /**
+      * Set the number of worker threads
+      *
+      * Spreads building and sending packets over several threads with a socket each, see
+      * SessionMultiplexer::worker_threads(). The packets of each object still leave in order, and completion callbacks
+      * are still invoked on the io_context thread.
+      *
+      * @param count The number of worker threads, 0 to send on the io_context thread (default)
+      * @return This Transmitter object.
+      */
+      Transmitter &worker_threads(unsigned count) { _multiplexer->worker_threads(count); return *this; };
+
+     /**
+      * Get the transmission statistics
+      *
+      * The packet and byte counts are those of this session, the send calls and zero copy counts those of the
+      * multiplexer.
+      *
+      * @return A snapshot of the current statistics.
+      */
+      Statistics statistics() const;
+
+     /**
+      * Get the session weight
+      *
+      * @return The share of the session in the transmission of its SessionMultiplexer.
+      */
+      unsigned session_weight() const { return _session_weight; };
+
+     /**
+      * Set the session weight
+      *
+      * The sessions of a SessionMultiplexer that have packets to send share its rate limit in proportion to their
+      * weights. A session that has nothing to send leaves its share to the others.
+      *
+      * @param weight The relative share of the session, a value of 0 is treated as 1 (default: 1)
+      * @return This Transmitter object.
+      */
+      Transmitter &session_weight(unsigned weight);
+
+     /**
+      * Get the FDT update window
+      *
+      * @return The time changes to the list of files are collected for before a new FDT instance is sent.
+      */
+      std::chrono::milliseconds fdt_update_window() const { return _fdt_update_window; };
+
+     /**
+      * Set the FDT update window
+      *
+      * Files that are added or removed are not announced one at a time. The changes are collected from the first one
+      * until the window has passed, and a single FDT instance with all of them is sent then, so that queueing many
+      * files builds one FDT instead of one per file. Files that are added wait for the FDT instance announcing them
+      * before they are transmitted. With a window of 0 (the default) the changes made before the io_context next gets
+      * to run are sent together.
+      *
+      * @param window The new update window.
+      * @return This Transmitter object.
+      */
+      Transmitter &fdt_update_window(std::chrono::milliseconds window) { _fdt_update_window = window; return *this; };
+
+     /**
+      * Get the FDT partition size
+      *
+      * @return The size in bytes at which the FDT is split into another partial FDT instance, 0 if it is not split.
+      */
+      size_t fdt_partition_size() const { return _fdt_partition_size; };
+
+     /**
+      * Set the FDT partition size
+      *
+      * A large FDT can be split into several partial FDT instances, each with its own instance ID and a part of the
+      * file entries. New entries are added to the last partial instance until its XML reaches this size, and then go
+      * to a new one. Only the partial instances that have changed are sent when files are added or removed, and on
+      * every FDT repeat the partial instances are sent one after the other. Receivers merge the partial instances, and
+      * can start receiving the files of each one as soon as it is complete instead of waiting for the whole FDT.
+      *
+      * The setting applies to entries added afterwards. A size of 0 (the default) keeps all entries in one instance.
+      *
+      * @param bytes The new partition size in bytes.
+      * @return This Transmitter object.
+      */
+      Transmitter &fdt_partition_size(size_t bytes) {
+        std::lock_guard<std::mutex> guard(_files_mutex);
+        _fdt_partition_size = bytes;
+        return *this;
+      };
+
+     /**
+      * Get the source read-ahead
+      *
+      * @return The number of source blocks of a file sent from a ContentSource that are held in memory at most.
+      */
+      size_t source_read_ahead() const { return _source_read_ahead; };
+
+     /**
+      * Set the source read-ahead
+      *
+      * The content of a file sent from a ContentSource is read one source block at a time on the
+      * ContentSource::thread_pool(), this many blocks ahead of the block being sent. A block is released once all of
+      * its packets have been sent, so the memory used is bounded by this number of blocks. A larger read-ahead keeps
+      * the transmission going when the source is slow to respond.
+      *
+      * The content of a mapped file (see FileDescription::is_mapped()) is read into memory on the same thread pool,
+      * this many blocks ahead of the block being sent, so that building packets does not wait for page faults on cold
+      * storage. Blocks that the transmission gets to before they have been read are counted in
+      * Statistics::prefetch_misses.
+      *
+      * The setting applies to files sent afterwards.
+      *
+      * @param blocks The number of blocks, a value of 0 is treated as 1 (default: 4)
+      * @return This Transmitter object.
+      */
+      Transmitter &source_read_ahead(size_t blocks) { _source_read_ahead = blocks ? blocks : 1; return *this; };
 
      /**
       * Get UDP Address for FLUTE session
@@ -589,11 +1052,56 @@ namespace LibFlute {
       *  If a file description is reused then the TOI of the previous use is reused. This allows resends or
       *  updates to existing files to be transmitted.
       *
+      *  Uncompressed contents are transmitted directly from the memory (or file mapping) of the file description,
+      *  without a copy. The contents must therefore not be changed with set_content() until the completion callback
+      *  for the file is called.
+      *
+      *  The file is announced in the next FDT instance, together with the other files added within the
+      *  fdt_update_window(), and transmitted after it.
+      *
+      *  If the file description has a carousel interval, the file is repeated until it is removed with remove(). To
+      *  change the contents of a file in the carousel, remove it and send it again.
+      *
+      *  Contents with a compression set (see FileDescription::set_compression()) are compressed on the ContentEncoder
+      *  thread pool, so this returns straight away. The file is added to the FDT and transmitted once it has been
+      *  compressed.
+      *
+      *  Contents of a file description with a ContentSource are read while the file is sent, see source_read_ahead().
+      *  If the source fails, the file is removed as with remove().
+      *
       *  @param file_description The file description object for the file to send
       *  @return TOI of the file.
       */
       uint16_t send(const std::shared_ptr<FileDescription> &file_description);
 
+     /**
+      *  Transmit a batch of files
+      *
+      *  Works like send(const std::shared_ptr<FileDescription>&) for each of the files, but the whole batch is
+      *  announced by a single new FDT instance. The FDT is only changed if all files of the batch can be queued: if a
+      *  file cannot be created, none of them are sent and the exception is passed on. If any of the files is to be
+      *  compressed, the batch is queued once all of its files have been compressed, and it is dropped if one of them
+      *  fails. Files of the batch that are removed before that are left out.
+      *
+      *  @param file_descriptions The file description objects for the files to send
+      *  @return TOIs of the files, in the order of @p file_descriptions.
+      *
+      *  @throw const char* If one of the files cannot be created
+      */
+      std::vector<uint16_t> send(const std::vector<std::shared_ptr<FileDescription>> &file_descriptions);
+
+     /**
+      *  Stop transmitting a file
+      *
+      *  The file is removed from the queue and the FDT, and a packet with the Close Object flag set is sent so that
+      *  receivers can release any state held for the partially received file. The completion callback is not called
+      *  for a removed file.
+      *
+      *  @param toi The TOI of the file to remove
+      *  @return `true` if the file was queued and has been removed
+      */
+      bool remove(uint32_t toi);
+
      /**
       *  Convenience function to get the current timestamp for expiry calculation
       *
@@ -613,6 +1121,8 @@ namespace LibFlute {
       *
       * If the Transmitter is currently deactivated then the state is set to active and the FLUTE stream will start transmitting.
       * Sending of packets will start or resume until the deactivate() method is called or this Transmitter is destroyed.
+      * As receivers release partially received files when the session is deactivated, any Files still in the queue will be
+      * transmitted again from the start.
       */
       void activate();
 
@@ -624,6 +1134,10 @@ namespace LibFlute {
       * if a File is currently being transmitted. If the application wishes for deactivation once Files have finished sending then
       * it should only deactivate() when the completion callback is called and number_of_files() equals 0 to ensure all Files have
       * been completely transmitted.
+      *
+      * A packet with the Close Session flag set is sent so that receivers can release the files they are still
+      * receiving. It is queued ahead of the files of the multiplexer and sent by its send loop, which therefore has to
+      * keep running until it has gone out.
       */
       void deactivate();
 
@@ -632,30 +1146,106 @@ namespace LibFlute {
       *
       * @return The number of files in the queue for sending.
       */
-      size_t number_of_files() { std::lock_guard<std::mutex> guard(_files_mutex); return _files.size(); };
+      size_t number_of_files() {
+        std::lock_guard<std::mutex> guard(_files_mutex);
+        return _files.size() + _unannounced.size();
+      };
 
     private:
-      void send_fdt();
-      void send_next_packet();
+      friend class SessionMultiplexer;
+      using PacketBuffer = SessionMultiplexer::PacketBuffer;
+
+      Transmitter( std::unique_ptr<SessionMultiplexer> own_multiplexer,
+          SessionMultiplexer *multiplexer,
+          const std::string& destination_address,
+          short port, uint64_t tsi, unsigned short mtu,
+          const std::optional<boost::asio::ip::udp::endpoint>& tunnel_endpoint,
+          FdtNamespace fdt_namespace,
+          bool active,
+          const std::optional<std::string>& source_address);
+
+      void send_fdt(bool changed_only = false);
+      void send_next_fdt_instance();
+      void queue_unannounced();
+      void fdt_add(const FileDeliveryTable::FileEntry &entry);
+      void fdt_remove(uint32_t toi);
+      void schedule_fdt_update();
+      void fdt_update_tick(const boost::system::error_code& error);
       void fdt_send_tick(const boost::system::error_code& error);
       void start_fdt_repeat_timer();
 
-      void file_transmitted(uint32_t toi);
+      void send_close_packet(uint32_t toi, bool close_session);
+
+      static constexpr size_t tunnel_headroom = SessionMultiplexer::tunnel_headroom;
+      PacketBuffer *next_packet();
+      PacketBuffer *next_packet(const std::shared_ptr<File> &file);
+      void build_packet(PacketBuffer *packet) const;
+      void set_addresses(PacketBuffer *packet) const;
+      void post(std::function<void()> handler);
+      PacketBuffer *next_scheduled_packet(uint32_t toi);
+      void packet_sent(PacketBuffer *packet, bool success);
+      const boost::asio::ip::udp::endpoint &send_endpoint() const {
+        return _tunnel_endpoint ? _tunnel_endpoint.value() : _endpoint;
+      };
+
+      void queue_files(const std::vector<std::shared_ptr<File>> &files,
+                       const std::vector<std::shared_ptr<FileDescription>> &file_descriptions);
+      void file_transmitted(const std::shared_ptr<File> &file);
+      bool start_carousel_round(uint32_t toi, const std::shared_ptr<File> &file);
 
       void handle_send_to(const boost::system::error_code& error);
+      std::unique_ptr<SessionMultiplexer> _own_multiplexer; //< Multiplexer of a Transmitter that is not hosted
+      SessionMultiplexer *_multiplexer;
+      uint32_t _session_id;
+      unsigned _session_weight = 1;
+
       boost::asio::ip::udp::endpoint _endpoint;
       std::optional<boost::asio::ip::address> _source_address;
-      boost::asio::ip::udp::socket _socket;
       boost::asio::io_context& _io_context;
-      boost::asio::deadline_timer _send_timer;
       boost::asio::deadline_timer _fdt_timer;
+      boost::asio::steady_timer _fdt_update_timer;
 
       uint64_t _tsi;
       uint16_t _mtu;
 
-      std::unique_ptr<FileDeliveryTable> _fdt;
+      struct FdtPartition {
+        std::unique_ptr<FileDeliveryTable> fdt;
+        uint32_t instance_id = 0;           //< FDT instance ID the partition was last sent with
+        bool changed = true;                //< Entries have been added or removed since it was last sent
+      };
+      std::list<FdtPartition> _fdt_partitions;  //< Partial FDT instances, guarded by _files_mutex
+      std::map<uint32_t, FdtPartition*> _fdt_partition_of; //< Partition of each TOI, guarded by _files_mutex
+      std::deque<FdtPartition*> _fdt_queue;     //< Partitions to send after the current one, guarded by _files_mutex
+      uint32_t _next_fdt_instance_id = 1;
+      size_t _fdt_partition_size = 0;
+      size_t _source_read_ahead = 4;
+      std::shared_ptr<ReadAheadStatistics> _read_ahead_statistics;  //< Shared with the files being sent
+      FdtNamespace _fdt_namespace;
       std::map<uint32_t, std::shared_ptr<File>> _files;
       std::mutex _files_mutex;
+      std::unique_ptr<Scheduler> _scheduler;  //< Picks the file to send each packet from, guarded by _files_mutex
+      struct CarouselObject {
+        std::chrono::steady_clock::duration interval; //< Minimum time between the starts of two rounds
+        std::chrono::steady_clock::time_point round_start;
+        bool round_complete = false;          //< Waiting for the next round to start
+      };
+      std::map<uint32_t, CarouselObject> _carousel; //< Files repeated in the carousel by TOI, guarded by _files_mutex
+      std::set<uint32_t> _encoding;         //< TOIs of files being compressed, guarded by _files_mutex
+      std::set<uint32_t> _failed_sources;   //< TOIs of files whose ContentSource failed, guarded by _files_mutex
+      struct UnannouncedFile {
+        std::shared_ptr<File> file;
+        std::shared_ptr<FileDescription> file_description; //< Not set for files sent from a buffer
+      };
+      std::vector<UnannouncedFile> _unannounced; //< Files waiting for the next FDT instance, guarded by _files_mutex
+      bool _fdt_update_pending = false;     //< An FDT update has been scheduled, guarded by _files_mutex
+      std::chrono::milliseconds _fdt_update_window{0};
+      struct PendingEncodes {
+        std::mutex mutex;
+        std::condition_variable done;
+        unsigned running = 0;               //< Files being compressed on the encoder thread pool and handlers running
+        bool closed = false;                //< The Transmitter is gone, compressed files and posted handlers are dropped
+      };
+      std::shared_ptr<PendingEncodes> _pending_encodes = std::make_shared<PendingEncodes>();
 
       unsigned _fdt_repeat_interval = 5;
       uint16_t _toi = 1;
@@ -666,11 +1256,13 @@ namespace LibFlute {
       completion_callback_t _completion_cb = nullptr;
       std::string _mcast_address;
 
-      uint32_t _rate_limit = 0;
       std::optional<boost::asio::ip::udp::endpoint> _tunnel_endpoint = std::nullopt;
       boost::asio::ip::address _tunnel_local_address;
 
-      bool _active;
+      std::atomic<bool> _active;  //< Also read by the worker threads of the multiplexer
+
+      std::atomic<uint64_t> _packets_sent = 0;
+      std::atomic<uint64_t> _bytes_sent = 0;
   };
 
 } // end namespace LibFlute
@@ -91,6 +91,10 @@ LibFlute::AlcPacket::AlcPacket(char* data, size_t len)
    _lct_header.tsi_flag +
    _lct_header.toi_flag;
 
+  if (_lct_header.lct_header_len < expected_header_len || header_length() > len) {
+    throw "Invalid LCT header length";
+  }
+
   size_t ext_header_len = (_lct_header.lct_header_len - expected_header_len) * 4;
   while (ext_header_len > 0) {
     auto ext_ptr = hdr_ptr;
@@ -104,7 +108,7 @@ LibFlute::AlcPacket::AlcPacket(char* data, size_t len)
       ext_ptr += 1; // Skip HEL
     }
 
-    if (ext_len > ext_header_len) {
+    if (ext_len == 0 || ext_len > ext_header_len) {
       throw "Header extension length exceeds remaining header length";
     }
 
@@ -159,30 +163,69 @@ LibFlute::AlcPacket::AlcPacket(char* data, size_t len)
 
 LibFlute::AlcPacket::AlcPacket(uint16_t tsi, uint16_t toi, LibFlute::FecOti fec_oti, const std::vector<LibFlute::EncodingSymbol>& symbols, size_t max_encoding_symbol_size, uint32_t fdt_instance_id)
   : _fec_oti(fec_oti)
+{
+  auto max_packet_length = max_size(toi, max_encoding_symbol_size);
+  _buffer = (char*)calloc(max_packet_length, sizeof(char));
+  _len = build(_buffer, max_packet_length, tsi, toi, _fec_oti, symbols, max_encoding_symbol_size, fdt_instance_id);
+}
+
+auto LibFlute::AlcPacket::max_size(uint16_t toi, size_t max_encoding_symbol_size, bool ext_fti) -> size_t
 {
   const size_t max_alc_header_size = 4;
   auto lct_header_len = 3;
-  if (toi == 0) { // Add extensions for FDT
-    lct_header_len += 5;
+  if (toi == 0) { // Add EXT_FDT for FDT
+    lct_header_len += 1;
   }
+  if (toi == 0 || ext_fti) {
+    lct_header_len += 4;
+  }
+  return max_encoding_symbol_size + lct_header_len * 4 + max_alc_header_size;
+}
 
-  auto max_packet_length = max_encoding_symbol_size +
-    lct_header_len * 4
-    + max_alc_header_size ;
+auto LibFlute::AlcPacket::build(char* buffer, size_t buffer_size, uint16_t tsi, uint16_t toi, const FecOti& fec_oti,
+    const std::vector<EncodingSymbol>& symbols, size_t max_encoding_symbol_size, uint32_t fdt_instance_id) -> size_t
+{
+  const size_t max_alc_header_size = 4;
 
-  _buffer = (char*)calloc(max_packet_length, sizeof(char));
+  if (buffer_size < max_size(toi, max_encoding_symbol_size)) {
+    throw "Buffer too small for ALC packet";
+  }
+  auto header_size = write_lct_header(buffer, tsi, toi, fec_oti, fdt_instance_id, false);
+  auto payload_size = EncodingSymbol::to_payload(symbols, buffer + header_size,
+      max_encoding_symbol_size + max_alc_header_size, fec_oti, ContentEncoding::NONE);
+  return header_size + payload_size;
+}
 
-  auto lct_header = (lct_header_t*)_buffer;
+auto LibFlute::AlcPacket::build_header(char* buffer, size_t buffer_size, uint16_t tsi, uint16_t toi,
+    const FecOti& fec_oti, const EncodingSymbol& first_symbol, uint32_t fdt_instance_id, bool ext_fti) -> size_t
+{
+  if (buffer_size < max_size(toi, 0, ext_fti)) {
+    throw "Buffer too small for ALC packet";
+  }
+  auto header_size = write_lct_header(buffer, tsi, toi, fec_oti, fdt_instance_id, ext_fti);
+  return header_size + EncodingSymbol::to_payload_id(first_symbol, buffer + header_size, buffer_size - header_size,
+      fec_oti);
+}
+
+auto LibFlute::AlcPacket::write_lct_header(char* buffer, uint16_t tsi, uint16_t toi, const FecOti& fec_oti,
+    uint32_t fdt_instance_id, bool ext_fti) -> size_t
+{
+  auto lct_header_len = 3;
+  if (toi == 0) { // Add EXT_FDT for FDT
+    lct_header_len += 1;
+  }
+  if (toi == 0 || ext_fti) {
+    lct_header_len += 4;
+  }
+  memset(buffer, 0, lct_header_len * 4);
+
+  auto lct_header = (lct_header_t*)buffer;
 
   lct_header->version = 1;
   lct_header->half_word_flag = 1;
   lct_header->lct_header_len = lct_header_len;
-  auto hdr_ptr = _buffer + 4;
-  auto payload_ptr = _buffer + 4 * lct_header_len;
+  auto hdr_ptr = buffer + 4;
 
-  auto payload_size = EncodingSymbol::to_payload(symbols, payload_ptr, max_encoding_symbol_size + max_alc_header_size, _fec_oti, ContentEncoding::NONE);
-  _len = 4 * lct_header_len + payload_size;
-  
   hdr_ptr += 4; // CCI = 0
   
   *((uint16_t*)hdr_ptr) = htons(tsi);
@@ -191,27 +234,61 @@ LibFlute::AlcPacket::AlcPacket(uint16_t tsi, uint16_t toi, LibFlute::FecOti fec_
   *((uint16_t*)hdr_ptr) = htons(toi);
   hdr_ptr += 2;
 
-  if (toi == 0) { // Add extensions for FDT
+  if (toi == 0) { // Add EXT_FDT for FDT
     *((uint8_t*)hdr_ptr) = EXT_FDT;
     hdr_ptr += 1;
     *((uint8_t*)hdr_ptr) = 1 << 4 | (fdt_instance_id & 0x000F0000) >> 16;
     hdr_ptr += 1;
     *((uint16_t*)hdr_ptr) = htons(fdt_instance_id & 0x0000FFFF);
     hdr_ptr += 2;
+  }
 
+  if (toi == 0 || ext_fti) {
     *((uint8_t*)hdr_ptr) = EXT_FTI;
     hdr_ptr += 1;
     *((uint8_t*)hdr_ptr) = 4; // HEL
     hdr_ptr += 1;
-    *((uint16_t*)hdr_ptr) = htons((_fec_oti.transfer_length & 0x00FF0000) >> 32);
+    // 48 bit transfer length
+    *((uint16_t*)hdr_ptr) = htons((fec_oti.transfer_length >> 32) & 0xFFFF);
     hdr_ptr += 2;
-    *((uint32_t*)hdr_ptr) = htonl(_fec_oti.transfer_length & 0x0000FFFF);
+    *((uint32_t*)hdr_ptr) = htonl(fec_oti.transfer_length & 0xFFFFFFFF);
     hdr_ptr += 4;
     hdr_ptr += 2; // reserved
-    *((uint16_t*)hdr_ptr) = htons(_fec_oti.encoding_symbol_length);
+    *((uint16_t*)hdr_ptr) = htons(fec_oti.encoding_symbol_length);
     hdr_ptr += 2;
-    *((uint32_t*)hdr_ptr) = htonl(_fec_oti.max_source_block_length);
+    *((uint32_t*)hdr_ptr) = htonl(fec_oti.max_source_block_length);
   }
+  return 4 * lct_header_len;
+}
+
+LibFlute::AlcPacket::AlcPacket(uint16_t tsi, uint16_t toi, LibFlute::FecOti fec_oti, bool close_object, bool close_session)
+  : _tsi(tsi)
+  , _toi(toi)
+  , _fec_oti(fec_oti)
+{
+  const size_t lct_header_len = 3;
+  const size_t fec_payload_id_len = 4;
+
+  _len = lct_header_len * 4 + fec_payload_id_len;
+  _buffer = (char*)calloc(_len, sizeof(char));
+
+  auto lct_header = (lct_header_t*)_buffer;
+  lct_header->version = 1;
+  lct_header->half_word_flag = 1;
+  lct_header->close_object_flag = close_object ? 1 : 0;
+  lct_header->close_session_flag = close_session ? 1 : 0;
+  lct_header->lct_header_len = lct_header_len;
+  std::memcpy(&_lct_header, _buffer, 4);
+
+  auto hdr_ptr = _buffer + 4;
+  hdr_ptr += 4; // CCI = 0
+
+  *((uint16_t*)hdr_ptr) = htons(tsi);
+  hdr_ptr += 2;
+
+  *((uint16_t*)hdr_ptr) = htons(toi);
+
+  // The FEC payload ID (SBN = 0, ESI = 0) follows the header without any encoding symbols
 }
 
 LibFlute::AlcPacket::~AlcPacket()
@@ -0,0 +1,311 @@
+// libflute - FLUTE/ALC library
+//
+// Copyright (C) 2026 libflute contributors
+//
+// Licensed under the License terms and conditions for use, reproduction, and
+// distribution of 5G-MAG software (the “License”).  You may not use this file
+// except in compliance with the License.  You may obtain a copy of the License at
+// https://www.5g-mag.com/reference-tools.  Unless required by applicable law or
+// agreed to in writing, software distributed under the License is distributed on
+// an “AS IS” BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied.
+//
+// See the License for the specific language governing permissions and limitations
+// under the License.
+//
+#include "ContentEncoder.h"
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <zlib.h>
+#include "spdlog/spdlog.h"
+
+namespace LibFlute {
+
+// Window of history a deflate stream may refer back to
+static constexpr size_t deflate_window = 32768;
+
+struct ContentEncoder::Block {
+  std::vector<char> data;
+  unsigned long check = 0;
+};
+
+namespace {
+
+using Stream = std::shared_ptr<const std::vector<char>>;
+
+struct CacheEntry {
+  std::shared_future<Stream> stream;
+  size_t size = 0;
+  bool ready = false;                        // Compressed, and counted in the cache size
+  std::list<std::string>::iterator lru;
+};
+
+struct Cache {
+  std::mutex mutex;
+  std::map<std::string, CacheEntry> entries;
+  std::list<std::string> lru;                // Keys, most recently used first
+  size_t limit = ContentEncoder::default_cache_limit;
+  ContentEncoder::CacheStatistics stats;
+
+  // Called with mutex locked
+  void remove(std::map<std::string, CacheEntry>::iterator it) {
+    if (it->second.ready) stats.bytes -= it->second.size;
+    lru.erase(it->second.lru);
+    entries.erase(it);
+  }
+
+  // Called with mutex locked
+  void evict() {
+    auto key = lru.end();
+    while (stats.bytes > limit && key != lru.begin()) {
+      --key;
+      auto it = entries.find(*key);
+      if (!it->second.ready) continue;  // Still being compressed
+      key = std::next(key);
+      remove(it);
+      stats.evictions++;
+    }
+  }
+};
+
+auto cache() -> Cache& {
+  static Cache cache;
+  return cache;
+}
+
+}  // namespace
+
+ContentEncoder::ContentEncoder(Format format, int level, size_t block_size)
+  : _format(format)
+  , _level(level)
+  , _block_size(block_size ? block_size : default_block_size)
+{
+}
+
+auto ContentEncoder::encode(const char *data, size_t length, const std::string &digest) const
+    -> std::shared_ptr<const std::vector<char>>
+{
+  auto &cache = LibFlute::cache();
+  if (digest.empty() || cache_limit() == 0) {
+    return std::make_shared<const std::vector<char>>(encode(data, length));
+  }
+
+  auto key = digest + "/" + std::to_string(length) + "/" + std::to_string(static_cast<int>(_format)) + "/" +
+      std::to_string(_level) + "/" + std::to_string(_block_size);
+  std::promise<Stream> promise;
+  std::shared_future<Stream> cached;
+  {
+    std::lock_guard<std::mutex> guard(cache.mutex);
+    auto it = cache.entries.find(key);
+    if (it != cache.entries.end()) {
+      cache.stats.hits++;
+      cache.lru.splice(cache.lru.begin(), cache.lru, it->second.lru);
+      cached = it->second.stream;
+    } else {
+      cache.stats.misses++;
+      cache.lru.push_front(key);
+      cache.entries.emplace(key, CacheEntry{promise.get_future().share(), 0, false, cache.lru.begin()});
+    }
+  }
+  if (cached.valid()) {
+    // Waits if another thread is still compressing the content
+    return cached.get();
+  }
+
+  Stream stream;
+  try {
+    stream = std::make_shared<const std::vector<char>>(encode(data, length));
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+    std::lock_guard<std::mutex> guard(cache.mutex);
+    auto it = cache.entries.find(key);
+    if (it != cache.entries.end()) cache.remove(it);
+    throw;
+  }
+  promise.set_value(stream);
+
+  std::lock_guard<std::mutex> guard(cache.mutex);
+  auto it = cache.entries.find(key);
+  if (it != cache.entries.end()) {
+    it->second.size = stream->size();
+    it->second.ready = true;
+    cache.stats.bytes += stream->size();
+    if (stream->size() > cache.limit) {
+      cache.remove(it);
+    } else {
+      cache.evict();
+    }
+  }
+  return stream;
+}
+
+auto ContentEncoder::cache_statistics() -> CacheStatistics
+{
+  auto &cache = LibFlute::cache();
+  std::lock_guard<std::mutex> guard(cache.mutex);
+  auto stats = cache.stats;
+  stats.entries = cache.entries.size();
+  return stats;
+}
+
+auto ContentEncoder::cache_limit() -> size_t
+{
+  auto &cache = LibFlute::cache();
+  std::lock_guard<std::mutex> guard(cache.mutex);
+  return cache.limit;
+}
+
+auto ContentEncoder::cache_limit(size_t bytes) -> void
+{
+  auto &cache = LibFlute::cache();
+  std::lock_guard<std::mutex> guard(cache.mutex);
+  cache.limit = bytes;
+  cache.evict();
+}
+
+auto ContentEncoder::thread_pool() -> boost::asio::thread_pool&
+{
+  static boost::asio::thread_pool pool(std::max(1U, std::thread::hardware_concurrency()));
+  return pool;
+}
+
+auto ContentEncoder::encode_block(const char *data, size_t length, size_t index, Block &block) const -> void
+{
+  auto start = index * _block_size;
+  auto size = std::min(_block_size, length - start);
+  bool last = start + size == length;
+  auto in = reinterpret_cast<const Bytef*>(data + start);
+
+  z_stream zs = {};
+  if (deflateInit2(&zs, _level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw "Failed to initialise deflate";
+  }
+  if (start > 0) {
+    // Back references may reach into the previous block, as they would in a single stream
+    auto dictionary = std::min(start, deflate_window);
+    deflateSetDictionary(&zs, in - dictionary, dictionary);
+  }
+
+  // A sync flush adds an empty stored block of up to 5 bytes after the bound for the data
+  block.data.resize(deflateBound(&zs, size) + 16);
+  zs.next_in = const_cast<Bytef*>(in);
+  zs.avail_in = size;
+  zs.next_out = reinterpret_cast<Bytef*>(block.data.data());
+  zs.avail_out = block.data.size();
+  auto result = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+  while (result == Z_OK && (last || zs.avail_in > 0 || zs.avail_out == 0)) {
+    // Ran out of output space after all
+    auto used = block.data.size() - zs.avail_out;
+    block.data.resize(block.data.size() * 2);
+    zs.next_out = reinterpret_cast<Bytef*>(block.data.data() + used);
+    zs.avail_out = block.data.size() - used;
+    result = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+  }
+  deflateEnd(&zs);
+  if (result != (last ? Z_STREAM_END : Z_OK)) {
+    throw "Failed to compress content";
+  }
+  block.data.resize(block.data.size() - zs.avail_out);
+
+  if (_format == Format::GZIP) {
+    block.check = crc32(crc32(0, Z_NULL, 0), in, size);
+  } else {
+    block.check = adler32(adler32(0, Z_NULL, 0), in, size);
+  }
+}
+
+auto ContentEncoder::encode(const char *data, size_t length) const -> std::vector<char>
+{
+  // The blocks are claimed one by one by the calling thread and the helpers on the pool. The caller never waits for
+  // a block that has not been claimed yet, so it finishes on its own if the pool is busy.
+  struct State {
+    std::atomic<size_t> next = 0;
+    std::vector<Block> blocks;
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t remaining;
+    const char *error = nullptr;
+  };
+  auto state = std::make_shared<State>();
+  auto blocks = std::max<size_t>(1, (length + _block_size - 1) / _block_size);
+  state->blocks.resize(blocks);
+  state->remaining = blocks;
+
+  auto work = [this, state, data, length, blocks]() {
+        for (auto index = state->next++; index < blocks; index = state->next++) {
+          const char *error = nullptr;
+          try {
+            encode_block(data, length, index, state->blocks[index]);
+          } catch (const char *e) {
+            error = e;
+          }
+          std::lock_guard<std::mutex> guard(state->mutex);
+          if (error) state->error = error;
+          if (--state->remaining == 0) state->done.notify_all();
+        }
+      };
+  auto helpers = std::min<size_t>(blocks - 1, std::max(1U, std::thread::hardware_concurrency()));
+  for (size_t i = 0; i < helpers; i++) {
+    boost::asio::post(thread_pool(), work);
+  }
+  work();
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&state]() { return state->remaining == 0; });
+  }
+  if (state->error) {
+    spdlog::error("Error compressing content: {}", state->error);
+    throw state->error;
+  }
+
+  // Header, the blocks and the trailer with the combined check value
+  size_t compressed = 0;
+  for (const auto& block : state->blocks) {
+    compressed += block.data.size();
+  }
+  std::vector<char> stream;
+  unsigned long check;
+  if (_format == Format::GZIP) {
+    stream.reserve(compressed + 18);
+    stream.insert(stream.end(), {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, 3});
+    check = crc32(0, Z_NULL, 0);
+  } else {
+    stream.reserve(compressed + 6);
+    stream.insert(stream.end(), {'\x78', '\x9c'});
+    check = adler32(0, Z_NULL, 0);
+  }
+  for (size_t i = 0; i < blocks; i++) {
+    const auto& block = state->blocks[i];
+    stream.insert(stream.end(), block.data.begin(), block.data.end());
+    auto size = std::min(_block_size, length - i * _block_size);
+    if (_format == Format::GZIP) {
+      check = crc32_combine(check, block.check, size);
+    } else {
+      check = adler32_combine(check, block.check, size);
+    }
+  }
+  if (_format == Format::GZIP) {
+    // CRC-32 and the length modulo 2^32, both little endian
+    for (auto value : {check, static_cast<unsigned long>(length)}) {
+      for (int shift = 0; shift < 32; shift += 8) {
+        stream.push_back(static_cast<char>((value >> shift) & 0xff));
+      }
+    }
+  } else {
+    // Adler-32, big endian
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      stream.push_back(static_cast<char>((check >> shift) & 0xff));
+    }
+  }
+  return stream;
+}
+
+} // End namespace LibFlute
@@ -0,0 +1,63 @@
+// libflute - FLUTE/ALC library
+//
+// Copyright (C) 2026 libflute contributors
+//
+// Licensed under the License terms and conditions for use, reproduction, and
+// distribution of 5G-MAG software (the “License”).  You may not use this file
+// except in compliance with the License.  You may obtain a copy of the License at
+// https://www.5g-mag.com/reference-tools.  Unless required by applicable law or
+// agreed to in writing, software distributed under the License is distributed on
+// an “AS IS” BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied.
+//
+// See the License for the specific language governing permissions and limitations
+// under the License.
+//
+#include "ContentSource.h"
+#include <errno.h>
+#include <unistd.h>
+#include <algorithm>
+#include <system_error>
+#include <thread>
+
+namespace LibFlute {
+
+auto ContentSource::thread_pool() -> boost::asio::thread_pool&
+{
+  // At least two threads, so that one source blocking on a pipe does not stop the others
+  static boost::asio::thread_pool pool(std::max(2U, std::thread::hardware_concurrency()));
+  return pool;
+}
+
+FdContentSource::FdContentSource(int fd, bool close_fd)
+  : _fd(fd)
+  , _close_fd(close_fd)
+{
+}
+
+FdContentSource::~FdContentSource()
+{
+  if (_close_fd && _fd >= 0) close(_fd);
+}
+
+auto FdContentSource::read(uint64_t offset, char *buffer, size_t length) -> size_t
+{
+  if (offset != _position) {
+    // Only possible for a descriptor that can seek
+    if (lseek(_fd, offset, SEEK_SET) < 0) {
+      throw "Content source cannot seek";
+    }
+    _position = offset;
+  }
+  ssize_t count;
+  do {
+    count = ::read(_fd, buffer, length);
+  } while (count < 0 && errno == EINTR);
+  if (count < 0) {
+    throw std::system_error(errno, std::generic_category(), "Could not read the content source");
+  }
+  _position += count;
+  return count;
+}
+
+} // end namespace LibFlute
@@ -32,6 +32,9 @@ auto LibFlute::EncodingSymbol::from_payload(char* encoded_data, size_t data_len,
   }
 
   if (fec_oti.encoding_id == FecScheme::CompactNoCode) {
+    if (data_len < 4) {
+      throw "Payload too short for the FEC payload ID";
+    }
     source_block_number = ntohs(*(uint16_t*)encoded_data);
     encoded_data += 2;
     encoding_symbol_id = ntohs(*(uint16_t*)encoded_data);
@@ -41,12 +44,16 @@ auto LibFlute::EncodingSymbol::from_payload(char* encoded_data, size_t data_len,
     throw "Only compact no-code FEC is supported";
   }
 
+  if (fec_oti.encoding_symbol_length == 0) {
+    throw "Encoding symbol length not known";
+  }
   int nof_symbols = std::ceil((float)data_len / (float)fec_oti.encoding_symbol_length);
   for (int i = 0; i < nof_symbols; i++) {
     if (fec_oti.encoding_id == FecScheme::CompactNoCode) {
       symbols.emplace_back(encoding_symbol_id, source_block_number, encoded_data, std::min(data_len, (size_t)fec_oti.encoding_symbol_length), fec_oti.encoding_id);
     }
     encoded_data += fec_oti.encoding_symbol_length;
+    data_len -= std::min(data_len, (size_t)fec_oti.encoding_symbol_length);
     encoding_symbol_id++;
   }
 
@@ -55,19 +62,9 @@ auto LibFlute::EncodingSymbol::from_payload(char* encoded_data, size_t data_len,
 
 auto LibFlute::EncodingSymbol::to_payload(const std::vector<EncodingSymbol>& symbols, char* encoded_data, size_t data_len, const FecOti& fec_oti, ContentEncoding encoding) -> size_t
 {
-  size_t len = 0;
-  auto ptr = encoded_data;
-  auto first_symbol = symbols.begin();
-  if (fec_oti.encoding_id == FecScheme::CompactNoCode && data_len >= 4) {
-    *((uint16_t*)ptr) = htons(first_symbol->source_block_number());
-    ptr += 2;
-    *((uint16_t*)ptr) = htons(first_symbol->id());
-    ptr += 2;
-    len += 4;
-    data_len -= 4;
-  } else {
-    throw "Only compact no-code FEC is supported";
-  }
+  size_t len = to_payload_id(symbols.front(), encoded_data, data_len, fec_oti);
+  auto ptr = encoded_data + len;
+  data_len -= len;
 
   for (const auto& symbol : symbols) {
     if (symbol.len() <= data_len) {
@@ -83,6 +80,16 @@ auto LibFlute::EncodingSymbol::to_payload(const std::vector<EncodingSymbol>& sym
   return len;
 }
 
+auto LibFlute::EncodingSymbol::to_payload_id(const EncodingSymbol& first_symbol, char* encoded_data, size_t data_len, const FecOti& fec_oti) -> size_t
+{
+  if (fec_oti.encoding_id == FecScheme::CompactNoCode && data_len >= 4) {
+    *((uint16_t*)encoded_data) = htons(first_symbol.source_block_number());
+    *((uint16_t*)(encoded_data + 2)) = htons(first_symbol.id());
+    return 4;
+  }
+  throw "Only compact no-code FEC is supported";
+}
+
 auto LibFlute::EncodingSymbol::decode_to(char* buffer, size_t max_length) const -> void {
   if (_fec_scheme == FecScheme::CompactNoCode) {
     if (_data_len <= max_length) {
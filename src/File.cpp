@@ -26,46 +26,219 @@
 #include <openssl/md5.h>
 #include <zlib.h>
 
+#include <boost/asio/post.hpp>
+#include <mutex>
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#include <unistd.h>
+
 #include "base64.h"
+#include "ContentEncoder.h"
+#include "ContentSource.h"
 #include "spdlog/spdlog.h"
 #include "Transmitter.h"
 #include "File.h"
 
 namespace LibFlute {
 
+// Reads the content of a file from its ContentSource, block by block and at most window blocks ahead of the
+// transmission. The reads run on the ContentSource thread pool, the File takes the blocks from ready as it sends them.
+struct File::SourceReader : std::enable_shared_from_this<File::SourceReader> {
+  std::shared_ptr<ContentSource> source;
+  size_t window;
+  std::vector<std::pair<uint64_t, size_t>> blocks;  //< Offset and length of each source block
+
+  std::mutex mutex;
+  std::map<uint16_t, std::vector<char>> ready;  //< Blocks that have been read, but not taken by the File yet
+  size_t nof_loaded = 0;      //< Blocks being read, ready or held by the File
+  size_t next_block = 0;
+  unsigned generation = 0;    //< Changed when the file is read again from the start, older reads are dropped
+  bool reading = false;
+  bool failed = false;
+  bool closed = false;        //< The File is gone
+
+  void start();
+  void run();
+};
+
+auto File::SourceReader::start() -> void
+{
+  // Called with the mutex held
+  if (reading || failed || closed || nof_loaded >= window || next_block >= blocks.size()) return;
+  reading = true;
+  boost::asio::post(ContentSource::thread_pool(), [reader = shared_from_this()]() { reader->run(); });
+}
+
+auto File::SourceReader::run() -> void
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!failed && !closed && nof_loaded < window && next_block < blocks.size()) {
+    auto number = next_block++;
+    auto [offset, length] = blocks[number];
+    auto current = generation;
+    nof_loaded++;
+    lock.unlock();
+
+    std::vector<char> data(length);
+    size_t filled = 0;
+    try {
+      while (filled < length) {
+        auto count = source->read(offset + filled, data.data() + filled, length - filled);
+        if (count == 0) {
+          spdlog::error("Content source ended early, at offset {}", offset + filled);
+          break;
+        }
+        filled += count;
+      }
+    } catch (const char *error) {
+      spdlog::error("Failed to read content source: {}", error);
+    } catch (const std::exception &error) {
+      spdlog::error("Failed to read content source: {}", error.what());
+    }
+
+    lock.lock();
+    // The counts have been reset if the file was restarted in the meantime
+    if (generation != current) continue;
+    if (filled < length) {
+      failed = true;
+      break;
+    }
+    ready[number] = std::move(data);
+  }
+  reading = false;
+}
+
+// Reads a mapped file into memory up to window source blocks ahead of the block being sent. The pages are touched on
+// the ContentSource thread pool, so that the page faults on cold storage are taken there and not by the thread
+// sending the packets.
+struct File::Prefetcher : std::enable_shared_from_this<File::Prefetcher> {
+  std::shared_ptr<Transmitter::FileDescription> file_description;  //< Keeps the mapping alive
+  const char *data;
+  size_t window;
+  std::vector<std::pair<uint64_t, size_t>> blocks;  //< Offset and length of each source block
+  std::shared_ptr<ReadAheadStatistics> statistics;
+
+  std::mutex mutex;
+  size_t next_block = 0;
+  size_t until = 0;           //< Blocks before this are to be read
+  unsigned generation = 0;    //< Changed when the file is sent again from the start
+  bool running = false;
+  std::atomic<size_t> prefetched{0};  //< Blocks before this have been read
+
+  void request(size_t block);
+  void run();
+};
+
+auto File::Prefetcher::request(size_t block) -> void
+{
+  std::lock_guard<std::mutex> guard(mutex);
+  until = std::max(until, std::min(blocks.size(), block + 1 + window));
+  if (running || next_block >= until) return;
+  running = true;
+  boost::asio::post(ContentSource::thread_pool(), [prefetcher = shared_from_this()]() { prefetcher->run(); });
+}
+
+auto File::Prefetcher::run() -> void
+{
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  std::unique_lock<std::mutex> lock(mutex);
+  while (next_block < until) {
+    auto number = next_block++;
+    auto current = generation;
+    auto [offset, length] = blocks[number];
+    lock.unlock();
+
+    // The mapping starts on a page boundary
+    auto first = offset - offset % page_size;
+#if HAVE_MMAP
+    // Have the kernel read the whole block at once, then wait for it page by page
+    madvise(const_cast<char*>(data + first), offset + length - first, MADV_WILLNEED);
+#endif
+    auto pages = static_cast<const volatile char*>(data);
+    char touched = 0;
+    for (auto page = first; page < offset + length; page += page_size) {
+      touched += pages[page];
+    }
+    (void)touched;
+    statistics->prefetched_bytes += length;
+
+    lock.lock();
+    if (generation == current) prefetched = number + 1;
+  }
+  running = false;
+}
+
 File::File(FileDeliveryTable::FileEntry entry)
-  : _meta( std::move(entry) )
+  : _receiving(true)
+  , _meta( std::move(entry) )
   , _received_at( time(nullptr) )
   , _file_description()
 {
   spdlog::debug("Creating File from FileEntry");
-  // Allocate a data buffer
-  spdlog::debug("Allocating buffer");
-  _buffer = (char*)malloc(_meta.fec_oti.transfer_length);
-  if (_buffer == nullptr)
-  {
-    throw "Failed to allocate file buffer";
+  // Reject FEC parameters that cannot be partitioned before anything is allocated
+  if (_meta.fec_oti.transfer_length > 0) {
+    if (_meta.fec_oti.encoding_symbol_length == 0 || _meta.fec_oti.max_source_block_length == 0) {
+      throw "Invalid FEC OTI for file";
+    }
+    // Compact No-Code FEC payload IDs have 16 bit SBN and ESI fields
+    auto nof_symbols = (_meta.fec_oti.transfer_length + _meta.fec_oti.encoding_symbol_length - 1) / _meta.fec_oti.encoding_symbol_length;
+    if (_meta.fec_oti.max_source_block_length > 0x10000 ||
+        nof_symbols > 0x10000ull * _meta.fec_oti.max_source_block_length) {
+      throw "Transfer length too large for the FEC scheme";
+    }
   }
-  _own_buffer = true;
-
-  this->calculate_partitioning();
-  this->create_blocks();
+  if (_meta.growing) {
+    // The length of a growing object is only known once it has been finalized, until then it is received into a single
+    // source block of the maximum length
+    if (_meta.fec_oti.encoding_symbol_length == 0 || _meta.fec_oti.max_source_block_length == 0 ||
+        _meta.fec_oti.max_source_block_length > 0x10000) {
+      throw "Invalid FEC OTI for growing file";
+    }
+    _growing = true;
+  }
+  // The data buffer and source blocks are allocated when the first symbol arrives, see allocate()
 }
 
-File::File(const std::shared_ptr<Transmitter::FileDescription> &file_description)
+File::File(const std::shared_ptr<Transmitter::FileDescription> &file_description, size_t read_ahead,
+    const std::shared_ptr<ReadAheadStatistics> &statistics)
   : _meta()
   , _file_description(file_description)
 {
   spdlog::debug("Creating File from FileDescription");
 
+  if (_file_description->source()) {
+    // The content is read while the file is sent and only held in memory a few source blocks at a time
+    _meta = _file_description->file_entry();
+    if (_meta.fec_oti.encoding_id != FecScheme::CompactNoCode) {
+      throw "Unsupported FEC scheme";
+    }
+    if (!_meta.content_encoding.empty()) {
+      throw "Content from a content source cannot be content encoded";
+    }
+    _meta.fec_oti.transfer_length = _file_description->data_length();
+    _reader = std::make_shared<SourceReader>();
+    _reader->source = _file_description->source();
+    _reader->window = std::max<size_t>(1, read_ahead);
+    _allocated = true;
+    calculate_partitioning();
+    create_blocks();
+
+    _reader->blocks = block_extents();
+    std::lock_guard<std::mutex> guard(_reader->mutex);
+    _reader->start();
+    return;
+  }
+
+  // Use the content of the FileDescription in place, it is kept alive by _file_description. Content encoding
+  // creates a new buffer, otherwise the symbols are sent straight from the FileDescription memory (or mapping).
   auto length = _file_description->data_length();
-  _buffer = (char*)malloc(length);
-  if (_buffer == nullptr)
+  _buffer = const_cast<char*>(_file_description->data());
+  if (_buffer == nullptr && length > 0)
   {
     throw "No data allocated";
   }
-  _own_buffer = true;
-  memcpy(_buffer, _file_description->data(), length);
+  _own_buffer = false;
   _meta = _file_description->file_entry();
 
   // for no-code
@@ -75,10 +248,41 @@ File::File(const std::shared_ptr<Transmitter::FileDescription> &file_description
     throw "Unsupported FEC scheme";
   }
 
+  _allocated = true;
+  if (_meta.growing) {
+    // Sent as a single source block, its symbols are added by grow() as the content is appended
+    if (!_meta.content_encoding.empty()) {
+      throw "Growing objects cannot be content encoded";
+    }
+    auto symbol_length = _meta.fec_oti.encoding_symbol_length;
+    if (symbol_length == 0 || _file_description->max_length() > 0x10000ull * symbol_length) {
+      throw "Maximum length of growing object too large for a single source block";
+    }
+    _meta.fec_oti.transfer_length = 0;
+    _meta.fec_oti.max_source_block_length =
+        std::max<size_t>(1, (_file_description->max_length() + symbol_length - 1) / symbol_length);
+    _growing = true;
+    _source_blocks[0];
+    restart();
+    grow();
+    return;
+  }
+
   encode();
 
   calculate_partitioning();
   create_blocks();
+
+  if (_file_description->is_mapped() && _buffer == _file_description->data() && !_source_blocks.empty()) {
+    // Sent straight from the mapping, which is only read from storage as it is touched
+    _prefetcher = std::make_shared<Prefetcher>();
+    _prefetcher->file_description = _file_description;
+    _prefetcher->data = _buffer;
+    _prefetcher->window = std::max<size_t>(1, read_ahead);
+    _prefetcher->blocks = block_extents();
+    _prefetcher->statistics = statistics ? statistics : std::make_shared<ReadAheadStatistics>();
+    _prefetcher->request(0);
+  }
 }
 
 File::File(uint32_t toi,
@@ -125,6 +329,7 @@ File::File(uint32_t toi,
     throw "Unsupported FEC scheme";
   }
 
+  _allocated = true;
   this->calculate_partitioning();
   this->create_blocks();
 }
@@ -132,6 +337,14 @@ File::File(uint32_t toi,
 File::~File()
 {
   spdlog::debug("Destroying File");
+  if (_reader) {
+    std::lock_guard<std::mutex> guard(_reader->mutex);
+    _reader->closed = true;
+  }
+  if (_prefetcher) {
+    std::lock_guard<std::mutex> guard(_prefetcher->mutex);
+    _prefetcher->until = 0;
+  }
   if (_own_buffer && _buffer != nullptr)
   {
     spdlog::debug("Freeing buffer");
@@ -139,41 +352,93 @@ File::~File()
   }
 }
 
-auto File::put_symbol( const EncodingSymbol& symbol ) -> void
+auto File::allocate() -> void
 {
-  if (symbol.source_block_number() > _source_blocks.size()) {
+  if (_allocated) return;
+
+  // Allocate a data buffer, a growing object gets room for its maximum length
+  size_t length = _growing ? (size_t)_meta.fec_oti.max_source_block_length * _meta.fec_oti.encoding_symbol_length
+                           : _meta.fec_oti.transfer_length;
+  spdlog::debug("Allocating buffer of {} bytes for TOI {}", length, _meta.toi);
+  _buffer = (char*)malloc(length);
+  if (_buffer == nullptr)
+  {
+    throw "Failed to allocate file buffer";
+  }
+  _own_buffer = true;
+  _allocated = true;
+
+  if (_growing) {
+    auto &block = _source_blocks[0];
+    auto symbol_length = _meta.fec_oti.encoding_symbol_length;
+    for (uint32_t i = 0; i < _meta.fec_oti.max_source_block_length; i++) {
+      block.symbols.emplace_hint(block.symbols.end(), i,
+          SourceBlock::Symbol{.data = _buffer + (size_t)i * symbol_length, .length = symbol_length});
+    }
+    restart();
+    return;
+  }
+  this->calculate_partitioning();
+  this->create_blocks();
+}
+
+auto File::put_symbol( const EncodingSymbol& symbol ) -> bool
+{
+  if (!_allocated) {
+    allocate();
+  }
+
+  auto block_it = _source_blocks.find(symbol.source_block_number());
+  if (block_it == _source_blocks.end()) {
     throw "Source Block number too high";
   } 
 
-  SourceBlock& source_block = _source_blocks[ symbol.source_block_number() ];
+  SourceBlock& source_block = block_it->second;
   
-  if (symbol.id() > source_block.symbols.size()) {
+  auto symbol_it = source_block.symbols.find(symbol.id());
+  if (symbol_it == source_block.symbols.end()) {
     throw "Encoding Symbol ID too high";
   } 
 
-  SourceBlock::Symbol& target_symbol = source_block.symbols[symbol.id()];
+  SourceBlock::Symbol& target_symbol = symbol_it->second;
 
   if (!target_symbol.complete) {
     symbol.decode_to(target_symbol.data, target_symbol.length);
-    target_symbol.complete = true;
-
-    check_source_block_completion(source_block);
-    check_file_completion();
+    set_symbol_completed(source_block, target_symbol, true);
+    return true;
   }
-
+  return false;
 }
 
-auto File::check_source_block_completion( SourceBlock& block ) -> void
+auto File::set_symbol_completed( SourceBlock& block, SourceBlock::Symbol& symbol, bool complete ) -> void
 {
-  block.complete = std::all_of(block.symbols.begin(), block.symbols.end(), [](const auto& symbol){ return symbol.second.complete; });
+  if (symbol.complete == complete) return;
+  symbol.complete = complete;
+
+  // Keep count of the completed symbols and blocks, so that completion is not found by scanning the whole file
+  if (complete) {
+    if (++block.nof_completed_symbols == block.symbols.size()) {
+      block.complete = true;
+      _nof_completed_blocks++;
+      if (_reader) release_block(block);
+      check_file_completion();
+    }
+  } else {
+    block.nof_completed_symbols--;
+    if (block.complete) {
+      block.complete = false;
+      _nof_completed_blocks--;
+      _complete = false;
+    }
+  }
 }
 
 auto File::check_file_completion() -> void
 {
-  _complete = std::all_of(_source_blocks.begin(), _source_blocks.end(), [](const auto& block){ return block.second.complete; });
+  _complete = !_growing && _nof_completed_blocks == _source_blocks.size();
 
-  if (_complete && !_meta.content_md5.empty() && _meta.content_encoding.empty()) {
-    //check MD5 sum if we haven't encoded the contents
+  if (_complete && _receiving && !_meta.content_md5.empty() && _meta.content_encoding.empty()) {
+    //check MD5 sum if we haven't encoded the contents, a transmitted file has nothing to check
     unsigned char md5[MD5_DIGEST_LENGTH];
     MD5((const unsigned char*)buffer(), length(), md5);
 
@@ -182,13 +447,7 @@ auto File::check_file_completion() -> void
       spdlog::debug("MD5 mismatch for TOI {}, discarding", _meta.toi);
  
       // MD5 mismatch, try again
-      for (auto& block : _source_blocks) {
-        for (auto& symbol : block.second.symbols) {
-          symbol.second.complete = false;
-        }
-        block.second.complete = false;
-      } 
-      _complete = false;
+      restart();
     }
   }
 }
@@ -205,8 +464,9 @@ auto File::calculate_partitioning() -> void
 
 auto File::create_blocks() -> void
 {
-  // Create the required source blocks and encoding symbols
-  auto buffer_ptr = _buffer;
+  // Create the required source blocks and encoding symbols. Without a buffer, the symbols get their data when the
+  // content of their block has been read from the ContentSource.
+  size_t offset = 0;
   size_t remaining_size = _meta.fec_oti.transfer_length;
   decltype(_nof_large_source_blocks) number = 0;
   while (remaining_size > 0) {
@@ -216,43 +476,64 @@ auto File::create_blocks() -> void
 
     for (decltype(block_length) i = 0; i < block_length; i++) {
       auto symbol_length = std::min(remaining_size, (size_t)_meta.fec_oti.encoding_symbol_length);
-      assert(buffer_ptr + symbol_length <= _buffer + _meta.fec_oti.transfer_length);
+      assert(offset + symbol_length <= _meta.fec_oti.transfer_length);
 
-      SourceBlock::Symbol symbol{.data = buffer_ptr, .length = symbol_length, .complete = false};
+      SourceBlock::Symbol symbol{.data = _buffer ? _buffer + offset : nullptr, .length = symbol_length, .complete = false};
       block.symbols[ symbol_id++ ] = symbol;
       
       remaining_size -= symbol_length;
-      buffer_ptr += symbol_length;
+      offset += symbol_length;
       
       if (remaining_size <= 0) break;
     }
     _source_blocks[number++] = block;
   }
+  restart();
 }
 
-auto File::get_next_symbols(size_t max_size) -> std::vector<EncodingSymbol> 
+auto File::get_next_symbols(size_t max_size) -> std::vector<EncodingSymbol>
 {
-  int nof_symbols = std::ceil((float)(max_size - 4) / (float)_meta.fec_oti.encoding_symbol_length);
-  auto cnt = 0;
   std::vector<EncodingSymbol> symbols;
-  
-  for (auto& block : _source_blocks) {
-    if (cnt >= nof_symbols) break;
-
-    if (!block.second.complete) {
-      for (auto& symbol : block.second.symbols) {
-        if (cnt >= nof_symbols) break;
-    
-        if (!symbol.second.complete && !symbol.second.queued) {
-          symbols.emplace_back(symbol.first, block.first, symbol.second.data, symbol.second.length, _meta.fec_oti.encoding_id);
-          symbol.second.queued = true;
-          cnt++;
+  get_next_symbols(max_size, symbols);
+  return symbols;
+}
+
+auto File::get_next_symbols(size_t max_size, std::vector<EncodingSymbol>& symbols) -> void
+{
+  // The symbols are sent from the file buffer as they are, so only as many as fit in max_size are taken
+  size_t size = 0;
+  symbols.clear();
+
+  if (_growing && _file_description) {
+    grow();
+  }
+
+  // All symbols before the send cursor are queued or complete, so the search continues from there
+  while (_send_block != _source_blocks.end()) {
+    auto& block = _send_block->second;
+    if (!block.complete) {
+      // Content from a ContentSource can only be sent once its block has been read
+      if (_reader && block.buffer.empty() && !load_block(_send_block)) return;
+      if (_prefetcher && _send_block->first >= _next_checked_block) {
+        check_prefetched(_send_block->first);
+      }
+      for (; _send_symbol != block.symbols.end(); ++_send_symbol) {
+        auto& symbol = _send_symbol->second;
+        if (!symbol.complete && !symbol.queued) {
+          // The FEC payload ID only carries the first SBN and ESI, a packet holds consecutive symbols of one block
+          if (!symbols.empty() && (size + symbol.length > max_size ||
+                symbols.back().source_block_number() != _send_block->first ||
+                symbols.back().id() + 1 != _send_symbol->first)) return;
+          symbols.emplace_back(_send_symbol->first, _send_block->first, symbol.data, symbol.length, _meta.fec_oti.encoding_id);
+          symbol.queued = true;
+          size += symbol.length;
         }
       }
     }
+    if (++_send_block != _source_blocks.end()) {
+      _send_symbol = _send_block->second.symbols.begin();
+    }
   }
-  return symbols;
-
 }
 
 auto File::mark_completed(const std::vector<EncodingSymbol>& symbols, bool success) -> void
@@ -263,59 +544,260 @@ auto File::mark_completed(const std::vector<EncodingSymbol>& symbols, bool succe
       auto sym = block->second.symbols.find(symbol.id());
       if (sym != block->second.symbols.end()) {
         sym->second.queued = false;
-        sym->second.complete = success;
+        // Packets sent before a restart() may be for a block that has been dropped since, it is sent again
+        if (_reader && sym->second.data == nullptr) continue;
+        set_symbol_completed(block->second, sym->second, success);
+
+        // Symbols that failed to send are picked up again
+        if (!success) {
+          rewind_send_cursor(block, sym);
+        }
       }
-      check_source_block_completion(block->second);
-      check_file_completion();
     }
   }
 }
 
+auto File::rewind_send_cursor(std::map<uint16_t, SourceBlock>::iterator block,
+    std::map<uint16_t, SourceBlock::Symbol>::iterator symbol) -> void
+{
+  // Moves the send cursor back to a symbol that has to be sent (again)
+  if (_send_block == _source_blocks.end() || block->first < _send_block->first ||
+      (block == _send_block && (_send_symbol == block->second.symbols.end() || symbol->first < _send_symbol->first))) {
+    _send_block = block;
+    _send_symbol = symbol;
+  }
+}
+
+auto File::grow() -> void
+{
+  // Adds the symbols that have been filled since the last call, only the last symbol of a finalized object may be
+  // shorter than the encoding symbol length
+  bool finalized = !_file_description->is_growing();
+  size_t length = _file_description->data_length();
+  auto block = _source_blocks.begin();
+  auto &symbols = block->second.symbols;
+  size_t symbol_length = _meta.fec_oti.encoding_symbol_length;
+  size_t offset = symbols.size() * symbol_length;
+  auto added = symbols.end();
+  while (offset < length && (finalized || length - offset >= symbol_length)) {
+    auto symbol = symbols.emplace_hint(symbols.end(), symbols.size(),
+        SourceBlock::Symbol{.data = _buffer + offset, .length = std::min(length - offset, symbol_length)});
+    if (added == symbols.end()) added = symbol;
+    offset += symbol->second.length;
+  }
+  if (added != symbols.end()) {
+    if (block->second.complete) {
+      block->second.complete = false;
+      _nof_completed_blocks--;
+    }
+    rewind_send_cursor(block, added);
+  }
+
+  if (finalized) {
+    _growing = false;
+    _ext_fti = true;
+    _meta.growing = false;
+    _meta.content_length = length;
+    _meta.content_md5 = _file_description->file_entry().content_md5;
+    _meta.fec_oti.transfer_length = length;
+    calculate_partitioning();
+    if (added == symbols.end() && !symbols.empty()) {
+      // Nothing new to send, the last symbol goes out again so that receivers get the length in EXT_FTI
+      auto last = std::prev(symbols.end());
+      if (!last->second.queued) {
+        set_symbol_completed(block->second, last->second, false);
+        rewind_send_cursor(block, last);
+      }
+    }
+    check_file_completion();
+  }
+}
+
+auto File::load_block(std::map<uint16_t, SourceBlock>::iterator block) -> bool
+{
+  std::lock_guard<std::mutex> guard(_reader->mutex);
+  auto ready = _reader->ready.find(block->first);
+  if (ready == _reader->ready.end()) {
+    _reader->start();
+    return false;
+  }
+  block->second.buffer = std::move(ready->second);
+  _reader->ready.erase(ready);
+  auto data = block->second.buffer.data();
+  for (auto& symbol : block->second.symbols) {
+    symbol.second.data = data;
+    data += symbol.second.length;
+  }
+  return true;
+}
+
+auto File::release_block(SourceBlock& block) -> void
+{
+  // All symbols of the block have been sent, its memory goes to the next block to read
+  if (block.buffer.empty()) return;
+  std::vector<char>().swap(block.buffer);
+  for (auto& symbol : block.symbols) {
+    symbol.second.data = nullptr;
+  }
+  std::lock_guard<std::mutex> guard(_reader->mutex);
+  _reader->nof_loaded--;
+  _reader->start();
+}
+
+auto File::check_prefetched(uint16_t block) -> void
+{
+  // Called once for each block the transmission gets to, the prefetcher is kept ahead of it
+  _next_checked_block = block + 1;
+  _prefetcher->request(block);
+  if (_prefetcher->prefetched > block) return;
+
+#if HAVE_MMAP
+  // Not read ahead in time, count the pages that sending the block has to wait for
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  auto [offset, length] = _prefetcher->blocks[block];
+  auto first = offset - offset % page_size;
+  std::vector<unsigned char> resident((offset + length - first + page_size - 1) / page_size);
+  if (mincore(const_cast<char*>(_buffer + first), offset + length - first, resident.data()) == 0) {
+    auto cold = std::count_if(resident.begin(), resident.end(), [](unsigned char page) { return !(page & 1); });
+    if (cold > 0) {
+      _prefetcher->statistics->prefetch_misses++;
+      _prefetcher->statistics->page_fault_stalls += cold;
+    }
+  }
+#endif
+}
+
+auto File::block_extents() const -> std::vector<std::pair<uint64_t, size_t>>
+{
+  std::vector<std::pair<uint64_t, size_t>> extents;
+  uint64_t offset = 0;
+  for (const auto& block : _source_blocks) {
+    size_t length = 0;
+    for (const auto& symbol : block.second.symbols) {
+      length += symbol.second.length;
+    }
+    extents.emplace_back(offset, length);
+    offset += length;
+  }
+  return extents;
+}
+
+auto File::failed() const -> bool
+{
+  if (!_reader) return false;
+  std::lock_guard<std::mutex> guard(_reader->mutex);
+  return _reader->failed;
+}
+
+auto File::buffered_blocks() const -> size_t
+{
+  if (!_reader) return 0;
+  std::lock_guard<std::mutex> guard(_reader->mutex);
+  return _reader->nof_loaded;
+}
+
+auto File::finalize(uint64_t transfer_length) -> void
+{
+  if (!_growing) return;
+  auto symbol_length = _meta.fec_oti.encoding_symbol_length;
+  if (transfer_length == 0 || transfer_length > (uint64_t)_meta.fec_oti.max_source_block_length * symbol_length) {
+    throw "Invalid transfer length for growing file";
+  }
+  _growing = false;
+  _meta.growing = false;
+  _meta.fec_oti.transfer_length = transfer_length;
+  if (_meta.content_encoding.empty()) {
+    _meta.content_length = transfer_length;
+  }
+  calculate_partitioning();
+  if (!_allocated) return;
+
+  // Drop the symbols past the end of the object, the last one may be shorter
+  auto &block = _source_blocks.begin()->second;
+  auto nof_symbols = (transfer_length + symbol_length - 1) / symbol_length;
+  if (nof_symbols < block.symbols.size()) {
+    block.symbols.erase(block.symbols.find(nof_symbols), block.symbols.end());
+  }
+  block.symbols.rbegin()->second.length = transfer_length - (nof_symbols - 1) * symbol_length;
+  block.nof_completed_symbols = std::count_if(block.symbols.begin(), block.symbols.end(),
+      [](const auto& symbol) { return symbol.second.complete; });
+  if (!block.complete && block.nof_completed_symbols == block.symbols.size()) {
+    block.complete = true;
+    _nof_completed_blocks++;
+  }
+  check_file_completion();
+}
+
+auto File::restart() -> void
+{
+  // Content from a ContentSource is read again from the start. The blocks held now are kept until the next restart,
+  // as packets in flight may still refer to them.
+  if (_reader) {
+    _retired.clear();
+  }
+  for (auto& block : _source_blocks) {
+    for (auto& symbol : block.second.symbols) {
+      symbol.second.complete = false;
+      symbol.second.queued = false;
+      if (_reader) symbol.second.data = nullptr;
+    }
+    block.second.complete = false;
+    block.second.nof_completed_symbols = 0;
+    if (!block.second.buffer.empty()) {
+      _retired.push_back(std::move(block.second.buffer));
+      block.second.buffer.clear();
+    }
+  }
+  _nof_completed_blocks = 0;
+  _complete = false;
+
+  if (_reader) {
+    std::lock_guard<std::mutex> guard(_reader->mutex);
+    _reader->generation++;
+    _reader->ready.clear();
+    _reader->nof_loaded = 0;
+    _reader->next_block = 0;
+    _reader->start();
+  }
+  if (_prefetcher) {
+    // The pages may have been dropped since the last round
+    {
+      std::lock_guard<std::mutex> guard(_prefetcher->mutex);
+      _prefetcher->generation++;
+      _prefetcher->next_block = 0;
+      _prefetcher->until = 0;
+      _prefetcher->prefetched = 0;
+    }
+    _next_checked_block = 0;
+    _prefetcher->request(0);
+  }
+
+  _send_block = _source_blocks.begin();
+  if (_send_block != _source_blocks.end()) {
+    _send_symbol = _send_block->second.symbols.begin();
+  }
+}
+
 auto File::encode() -> void
 {
   if (!_been_encoded && !_meta.content_encoding.empty()) {
     if (_meta.content_encoding == "gzip" || _meta.content_encoding=="deflate") {
-      auto decomp_buffer = _buffer;
-      bool own_decomp = _own_buffer;
-      std::shared_ptr<unsigned char> comp_buffer(new unsigned char[16384]);
-      z_stream zs = {
-        .next_in = reinterpret_cast<unsigned char*>(decomp_buffer),
-        .avail_in = static_cast<uint32_t>(_meta.content_length),
-        .next_out = comp_buffer.get(),
-        .avail_out = 16384
-      };
       spdlog::debug("Compressing contents with {}", _meta.content_encoding);
-
-      if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 | 16, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
-        _buffer = nullptr;
-        auto zstate = deflate(&zs, Z_FINISH);
-        size_t last_out = 0;
-        while (zstate == Z_OK) {
-          spdlog::debug("Part compressed: {} bytes", 16384-zs.avail_out);
-          _buffer = reinterpret_cast<char*>(realloc(_buffer, zs.total_out));
-          memcpy(_buffer+last_out, comp_buffer.get(), 16384-zs.avail_out);
-          last_out = zs.total_out;
-          _own_buffer = true;
-          zs.avail_out = 16384;
-          zs.next_out = comp_buffer.get();
-          zstate = inflate(&zs, Z_FINISH);
-        }
-        if (zstate==Z_STREAM_END) {
-          if (last_out != zs.total_out) {
-            spdlog::debug("Finish compress, last block is {} bytes. Total {} bytes", 16384-zs.avail_out, zs.total_out);
-            _buffer = reinterpret_cast<char*>(realloc(_buffer, zs.total_out));
-            memcpy(_buffer+last_out, comp_buffer.get(), 16384-zs.avail_out);
-            _own_buffer = true;
-          }
-          _meta.fec_oti.transfer_length = zs.total_out;
-        } else {
-          spdlog::error("Error compressing file {}: {}", _meta.toi, zs.msg);
-          throw zs.msg;
-        }
-        deflateEnd(&zs);
-
-        if (own_decomp) free(decomp_buffer);
+      // The deflate content encoding is a zlib stream, as expected by decode()
+      ContentEncoder encoder(_meta.content_encoding == "gzip" ? ContentEncoder::Format::GZIP
+                                                              : ContentEncoder::Format::ZLIB);
+      // Content with a digest goes through the encoder cache, so resending it does not compress it again
+      if (_meta.content_md5.empty()) {
+        _encoded = std::make_shared<const std::vector<char>>(encoder.encode(_buffer, _meta.content_length));
+      } else {
+        _encoded = encoder.encode(_buffer, _meta.content_length, _meta.content_md5);
       }
+      spdlog::debug("Compressed {} bytes to {} bytes", _meta.content_length, _encoded->size());
+
+      if (_own_buffer) free(_buffer);
+      _buffer = const_cast<char*>(_encoded->data());
+      _own_buffer = false;
+      _meta.fec_oti.transfer_length = _encoded->size();
     } else {
       spdlog::error("Unknown Content-Encoding {}", _meta.content_encoding);
       throw "Content-Encoding not known";
@@ -332,7 +814,7 @@ auto File::decode() -> void
     if (_meta.content_encoding == "gzip" || _meta.content_encoding=="deflate") {
       auto comp_buffer = _buffer;
       bool own_comp = _own_buffer;
-      std::shared_ptr<unsigned char> decomp_buffer(new unsigned char[16384]);
+      std::unique_ptr<unsigned char[]> decomp_buffer(new unsigned char[16384]);
       z_stream zs = {
 	.next_in = reinterpret_cast<unsigned char*>(comp_buffer),
 	.avail_in = static_cast<uint32_t>(_meta.fec_oti.transfer_length),
@@ -343,7 +825,7 @@ auto File::decode() -> void
 
       inflateInit2(&zs, 15 | ((_meta.content_encoding == "gzip")?16:0));
       _buffer = nullptr;
-      auto zstate = inflate(&zs, Z_FINISH);
+      auto zstate = inflate(&zs, Z_NO_FLUSH);
       size_t last_out = 0;
       while (zstate == Z_OK) {
         spdlog::debug("Part decompressed: {} bytes", 16384-zs.avail_out);
@@ -353,7 +835,7 @@ auto File::decode() -> void
         _own_buffer = true;
 	zs.avail_out = 16384;
         zs.next_out = decomp_buffer.get();
-	zstate = inflate(&zs, Z_FINISH);
+	zstate = inflate(&zs, Z_NO_FLUSH);
       }
       if (zstate==Z_STREAM_END) {
 	if (last_out != zs.total_out) {
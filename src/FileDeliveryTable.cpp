@@ -128,7 +128,7 @@ bool LibFlute::FileDeliveryTable::FileEntry::operator==(const LibFlute::FileDeli
          cache_control.no_cache == other.cache_control.no_cache && fec_oti == other.fec_oti &&
          cache_control.cache_expires == other.cache_control.cache_expires && content_location == other.content_location &&
          content_md5 == other.content_md5 && content_type == other.content_type && content_encoding == other.content_encoding &&
-         etag == other.etag;
+         etag == other.etag && growing == other.growing;
 }
 
 LibFlute::FileDeliveryTable::FileDeliveryTable(uint32_t instance_id, FecOti fec_oti, FdtNamespace fdt_namespace)
@@ -218,6 +218,7 @@ LibFlute::FileDeliveryTable::FileDeliveryTable(uint32_t instance_id, char* buffe
     // File optional attributes
     uint32_t content_length = 0;
     val = file_ns.findAttribute(file, "Content-Length", fdt_ns);
+    bool growing = (val == nullptr);
     if (val != nullptr) {
       content_length = strtoull(val->Value(), nullptr, 0);
     }
@@ -226,6 +227,7 @@ LibFlute::FileDeliveryTable::FileDeliveryTable(uint32_t instance_id, char* buffe
     val = file_ns.findAttribute(file, "Transfer-Length", fdt_ns);
     if (val != nullptr) {
       transfer_length = strtoull(val->Value(), nullptr, 0);
+      growing = false;
     } else {
       transfer_length = content_length;
     }
@@ -333,7 +335,8 @@ LibFlute::FileDeliveryTable::FileDeliveryTable(uint32_t instance_id, char* buffe
         cache_expires
       },
       content_encoding,
-      mbms2012_file_etag
+      mbms2012_file_etag,
+      growing  // Without a length in the FDT, the transfer length is signalled in EXT_FTI
     };
     _file_entries.push_back(fe);
   }
@@ -347,87 +350,120 @@ auto LibFlute::FileDeliveryTable::add(const FileEntry& fe) -> void
 
 auto LibFlute::FileDeliveryTable::remove(uint32_t toi) -> void
 {
-  for (auto it = _file_entries.cbegin(); it != _file_entries.cend();) {
-    if (it->toi == toi) {
-      it = _file_entries.erase(it);
+  for (size_t i = 0; i < _file_entries.size();) {
+    if (_file_entries[i].toi == toi) {
+      _file_entries.erase(_file_entries.begin() + i);
+      if (i < _file_elements.size()) {
+        _file_elements_size -= _file_elements[i].size();
+        _file_elements.erase(_file_elements.begin() + i);
+      }
     } else {
-      ++it;
+      ++i;
     }
   }
   if (_instance_id == _instance_id_sent) _instance_id++;
 }
 
 auto LibFlute::FileDeliveryTable::to_string() const -> std::string {
-  tinyxml2::XMLDocument doc;
-  doc.InsertFirstChild( doc.NewDeclaration() );
-  auto root = doc.NewElement("FDT-Instance");
+  auto xml = root_element();
+  if (_file_elements.empty()) {
+    xml += "/>\n";
+    return xml;
+  }
+  xml.reserve(size());
+  xml += ">";
+  for (const auto& element : _file_elements) {
+    xml += "\n";
+    xml += element;
+  }
+  xml += "\n</FDT-Instance>\n";
+  return xml;
+}
+
+auto LibFlute::FileDeliveryTable::size() const -> size_t {
+  auto length = root_element().size();
+  if (_file_elements.empty()) return length + 3;
+  return length + 1 + _file_elements_size + _file_elements.size() + 17;
+}
+
+auto LibFlute::FileDeliveryTable::root_element() const -> std::string {
+  // The root element is printed without its children, they are appended from the serialized File elements
+  tinyxml2::XMLPrinter printer;
+  printer.PushDeclaration("xml version=\"1.0\" encoding=\"UTF-8\"");
+  printer.OpenElement("FDT-Instance");
   switch (_fdt_namespace) {
     case FDT_NS_RFC3926:
       // RFC 3926 Section 3.4.2
-      root->SetAttribute("xmlns", "http://www.example.com/flute");
+      printer.PushAttribute("xmlns", "http://www.example.com/flute");
       break;
     case FDT_NS_DRAFT_2005:
       // 3GPP TS 26.346 Clause 7.2.10.1
-      root->SetAttribute("xmlns", "urn:IETF:metadata:2005:FLUTE:FDT");
+      printer.PushAttribute("xmlns", "urn:IETF:metadata:2005:FLUTE:FDT");
       break;
 //    case FDT_NS_RFC6726:  // FLUTE v2 - Will need other things implementing to use this
 //      // RFC 6726
-//      root->SetAttribute("xmlns", "urn:ietf:params:xml:ns:fdt");
+//      printer.PushAttribute("xmlns", "urn:ietf:params:xml:ns:fdt");
 //      break;
     case FDT_NS_3GPP_CONSOLIDATED_V2:
       // 3GPP TS 26.346 Clause L.6.1
-      root->SetAttribute("xmlns", "urn:3GPP:metadata:2022:FLUTE:FDT");
+      printer.PushAttribute("xmlns", "urn:3GPP:metadata:2022:FLUTE:FDT");
       break;
     default:
       break;
   }
-  root->SetAttribute("Expires", std::to_string(_expires).c_str());
-  root->SetAttribute("FEC-OTI-FEC-Encoding-ID", (unsigned)_global_fec_oti.encoding_id);
-  if (_global_fec_oti.instance_id) root->SetAttribute("FEC-OTI-FEC-Instance-ID", (unsigned)_global_fec_oti.instance_id);
-  root->SetAttribute("FEC-OTI-Maximum-Source-Block-Length", (unsigned)_global_fec_oti.max_source_block_length);
-  root->SetAttribute("FEC-OTI-Encoding-Symbol-Length", (unsigned)_global_fec_oti.encoding_symbol_length);
-  root->SetAttribute("xmlns:mbms2007", "urn:3GPP:metadata:2007:MBMS:FLUTE:FDT"); // 3GPP TS 26.346 Clause 7.2.10.2
-  root->SetAttribute("xmlns:mbms2012", "urn:3GPP:metadata:2012:MBMS:FLUTE:FDT"); // 3GPP TS 26.346 Clause 7.2.10.2
-  doc.InsertEndChild(root);
-
-  for (const auto& file : _file_entries) {
-    auto f = doc.NewElement("File");
-    f->SetAttribute("TOI", file.toi);
-    f->SetAttribute("Content-Location", file.content_location.c_str());
-    f->SetAttribute("Content-Length", file.content_length);
-    if (file.fec_oti.transfer_length) f->SetAttribute("Transfer-Length", file.fec_oti.transfer_length);
-    if (!file.content_md5.empty()) f->SetAttribute("Content-MD5", file.content_md5.c_str());
-    if (!file.content_encoding.empty()) f->SetAttribute("Content-Encoding", file.content_encoding.c_str());
-    if (!file.content_type.empty()) f->SetAttribute("Content-Type", file.content_type.c_str());
-    if (file.fec_oti.encoding_id != _global_fec_oti.encoding_id)
-      f->SetAttribute("FEC-OTI-FEC-Encoding-ID", (unsigned)file.fec_oti.encoding_id);
-    if (file.fec_oti.instance_id != 0 && file.fec_oti.instance_id != _global_fec_oti.instance_id)
-      f->SetAttribute("FEC-OTI-FEC-Instance-ID", (unsigned)file.fec_oti.instance_id);
-    if (file.fec_oti.max_source_block_length != 0 &&
-        file.fec_oti.max_source_block_length != _global_fec_oti.max_source_block_length)
-      f->SetAttribute("FEC-OTI-Maximum-Source-Block-Length", (unsigned)file.fec_oti.max_source_block_length);
-    if (file.fec_oti.encoding_symbol_length != 0 &&
-        file.fec_oti.encoding_symbol_length != _global_fec_oti.encoding_symbol_length)
-      f->SetAttribute("FEC-OTI-Encoding-Symbol-Length", (unsigned)file.fec_oti.encoding_symbol_length);
-    if (!file.etag.empty()) f->SetAttribute("mbms2012:File-ETag", file.etag.c_str());
-    if (file.cache_control.no_cache || file.cache_control.cache_expires) {
-      auto cc = doc.NewElement("mbms2007:Cache-Control");
-      if (file.cache_control.no_cache) {
-        auto noc = doc.NewElement("mbms2007:no-cache");
-        noc->SetText("true");
-        cc->InsertEndChild(noc);
-      } else {
-        auto exp = doc.NewElement("mbms2007:Expires");
-        exp->SetText(std::to_string(file.expires).c_str());
-        cc->InsertEndChild(exp);
-      }
-      f->InsertEndChild(cc);
-    }
-    root->InsertEndChild(f);
+  printer.PushAttribute("Expires", std::to_string(_expires).c_str());
+  printer.PushAttribute("FEC-OTI-FEC-Encoding-ID", (unsigned)_global_fec_oti.encoding_id);
+  if (_global_fec_oti.instance_id) printer.PushAttribute("FEC-OTI-FEC-Instance-ID", (unsigned)_global_fec_oti.instance_id);
+  printer.PushAttribute("FEC-OTI-Maximum-Source-Block-Length", (unsigned)_global_fec_oti.max_source_block_length);
+  printer.PushAttribute("FEC-OTI-Encoding-Symbol-Length", (unsigned)_global_fec_oti.encoding_symbol_length);
+  printer.PushAttribute("xmlns:mbms2007", "urn:3GPP:metadata:2007:MBMS:FLUTE:FDT"); // 3GPP TS 26.346 Clause 7.2.10.2
+  printer.PushAttribute("xmlns:mbms2012", "urn:3GPP:metadata:2012:MBMS:FLUTE:FDT"); // 3GPP TS 26.346 Clause 7.2.10.2
+
+  while (_file_elements.size() < _file_entries.size()) {
+    _file_elements.push_back(file_element(_file_entries[_file_elements.size()]));
+    _file_elements_size += _file_elements.back().size();
   }
+  return std::string(printer.CStr());
+}
 
+auto LibFlute::FileDeliveryTable::file_element(const FileEntry &file) const -> std::string {
+  tinyxml2::XMLDocument doc;
+  auto f = doc.NewElement("File");
+  f->SetAttribute("TOI", file.toi);
+  f->SetAttribute("Content-Location", file.content_location.c_str());
+  if (!file.growing) f->SetAttribute("Content-Length", file.content_length);
+  if (file.fec_oti.transfer_length) f->SetAttribute("Transfer-Length", file.fec_oti.transfer_length);
+  if (!file.content_md5.empty()) f->SetAttribute("Content-MD5", file.content_md5.c_str());
+  if (!file.content_encoding.empty()) f->SetAttribute("Content-Encoding", file.content_encoding.c_str());
+  if (!file.content_type.empty()) f->SetAttribute("Content-Type", file.content_type.c_str());
+  if (file.fec_oti.encoding_id != _global_fec_oti.encoding_id)
+    f->SetAttribute("FEC-OTI-FEC-Encoding-ID", (unsigned)file.fec_oti.encoding_id);
+  if (file.fec_oti.instance_id != 0 && file.fec_oti.instance_id != _global_fec_oti.instance_id)
+    f->SetAttribute("FEC-OTI-FEC-Instance-ID", (unsigned)file.fec_oti.instance_id);
+  if (file.fec_oti.max_source_block_length != 0 &&
+      file.fec_oti.max_source_block_length != _global_fec_oti.max_source_block_length)
+    f->SetAttribute("FEC-OTI-Maximum-Source-Block-Length", (unsigned)file.fec_oti.max_source_block_length);
+  if (file.fec_oti.encoding_symbol_length != 0 &&
+      file.fec_oti.encoding_symbol_length != _global_fec_oti.encoding_symbol_length)
+    f->SetAttribute("FEC-OTI-Encoding-Symbol-Length", (unsigned)file.fec_oti.encoding_symbol_length);
+  if (!file.etag.empty()) f->SetAttribute("mbms2012:File-ETag", file.etag.c_str());
+  if (file.cache_control.no_cache || file.cache_control.cache_expires) {
+    auto cc = doc.NewElement("mbms2007:Cache-Control");
+    if (file.cache_control.no_cache) {
+      auto noc = doc.NewElement("mbms2007:no-cache");
+      noc->SetText("true");
+      cc->InsertEndChild(noc);
+    } else {
+      auto exp = doc.NewElement("mbms2007:Expires");
+      exp->SetText(std::to_string(file.expires).c_str());
+      cc->InsertEndChild(exp);
+    }
+    f->InsertEndChild(cc);
+  }
+  doc.InsertEndChild(f);
 
-  tinyxml2::XMLPrinter printer;
+  // Printed at the depth of the children of the FDT-Instance element
+  tinyxml2::XMLPrinter printer(nullptr, false, 1);
   doc.Print(&printer);
   return std::string(printer.CStr());
 }
@@ -0,0 +1,102 @@
+// libflute - FLUTE/ALC library
+//
+// Copyright (C) 2026 libflute contributors
+//
+// Licensed under the License terms and conditions for use, reproduction, and
+// distribution of 5G-MAG software (the “License”).  You may not use this file
+// except in compliance with the License.  You may obtain a copy of the License at
+// https://www.5g-mag.com/reference-tools.  Unless required by applicable law or
+// agreed to in writing, software distributed under the License is distributed on
+// an “AS IS” BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied.
+//
+// See the License for the specific language governing permissions and limitations
+// under the License.
+//
+#include "Pacer.h"
+#include <algorithm>
+
+LibFlute::Pacer::Pacer(uint64_t rate, size_t burst)
+  : _rate(rate)
+  , _burst(burst)
+  , _last_update(clock::now())
+  , _next_departure(_last_update)
+{
+}
+
+auto LibFlute::Pacer::rate(uint64_t rate, clock::time_point now) -> Pacer&
+{
+  if (_rate) {
+    refill(now);
+  } else {
+    // Coming from unlimited, start without any credit or debt
+    _credit = 0.0;
+    _backlogged = false;
+    _last_update = now;
+    _next_departure = now;
+  }
+  _rate = rate;
+  return *this;
+}
+
+auto LibFlute::Pacer::burst(size_t burst) -> Pacer&
+{
+  _burst = burst;
+  _credit = std::min(_credit, static_cast<double>(_burst));
+  return *this;
+}
+
+auto LibFlute::Pacer::refill(clock::time_point now) -> void
+{
+  if (now <= _last_update) return;
+  double elapsed = std::chrono::duration<double>(now - _last_update).count();
+  _last_update = now;
+  auto limit = static_cast<double>(_burst);
+  if (_backlogged) {
+    // Packets are waiting, the time a late wakeup missed is made up for
+    limit = std::max(limit, std::chrono::duration<double>(max_catch_up).count() * _rate / 8.0);
+  }
+  _credit = std::min(limit, _credit + elapsed * _rate / 8.0);
+}
+
+auto LibFlute::Pacer::idle(clock::time_point now) -> void
+{
+  if (!_rate) return;
+  refill(now);
+  _backlogged = false;
+  _credit = std::min(static_cast<double>(_burst), _credit);
+}
+
+auto LibFlute::Pacer::ready(clock::time_point now) -> bool
+{
+  if (!_rate) return true;
+  refill(now);
+  return _credit >= 0.0;
+}
+
+auto LibFlute::Pacer::consume(size_t bytes, clock::time_point now) -> void
+{
+  if (!_rate) return;
+  refill(now);
+  _credit -= bytes;
+  _backlogged = true;
+}
+
+auto LibFlute::Pacer::wait_time(clock::time_point now) -> clock::duration
+{
+  if (!_rate) return clock::duration::zero();
+  refill(now);
+  if (_credit >= 0.0) return clock::duration::zero();
+  auto seconds = -_credit * 8.0 / _rate;
+  return std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(seconds)) + clock::duration(1);
+}
+
+auto LibFlute::Pacer::departure_time(size_t bytes, clock::time_point now) -> clock::time_point
+{
+  if (!_rate) return now;
+  auto departure = std::max(_next_departure, now);
+  _next_departure = departure + std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(bytes * 8.0 / _rate));
+  return departure;
+}
@@ -15,140 +15,302 @@
 //
 #include "Receiver.h"
 #include "AlcPacket.h"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <limits>
 #include <string>
 #include "spdlog/spdlog.h"
 #include "IpSec.h"
 
+// Seconds since the NTP epoch, the time base of the FDT Expires attribute
+static auto ntp_seconds() -> uint64_t
+{
+  return std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count() + 2'208'988'800;
+}
 
 LibFlute::Receiver::Receiver ( const std::string& iface, const std::string& address,
     short port, uint64_t tsi,
     boost::asio::io_context& io_context)
-    : _socket(io_context)
-    , _tsi(tsi)
-    , _mcast_address(address)
-{
-    boost::asio::ip::udp::endpoint listen_endpoint(
-        boost::asio::ip::make_address(iface), port);
-    _socket.open(listen_endpoint.protocol());
-    _socket.set_option(boost::asio::ip::multicast::enable_loopback(true));
-    _socket.set_option(boost::asio::ip::udp::socket::reuse_address(true));
-    _socket.set_option(boost::asio::socket_base::receive_buffer_size(16*1024*1024));
-    _socket.bind(listen_endpoint);
-
-    // Join the multicast group.
-    _socket.set_option(
-        boost::asio::ip::multicast::join_group(
-          boost::asio::ip::make_address(address)));
-
-    _socket.async_receive_from(
-        boost::asio::buffer(_data, max_length), _sender_endpoint,
-        boost::bind(&LibFlute::Receiver::handle_receive_from, this,
-          boost::asio::placeholders::error,
-          boost::asio::placeholders::bytes_transferred));
+    : Receiver({{iface, address}}, port, tsi, io_context)
+{
+}
+
+LibFlute::Receiver::Receiver ( const std::vector<ReceivePath>& paths,
+    short port, uint64_t tsi,
+    boost::asio::io_context& io_context)
+    : _tsi(tsi)
+{
+  if (paths.empty()) {
+    throw "At least one receive path is required";
+  }
+  // A single path is set up as it always was, the group is joined on the default interface
+  bool redundant = paths.size() > 1;
+
+  for (const auto& rp : paths) {
+    auto path = std::make_unique<Path>(io_context);
+    path->stats.iface = rp.iface;
+    path->stats.address = rp.address;
+
+    auto iface_address = boost::asio::ip::make_address(rp.iface);
+    auto group = boost::asio::ip::make_address(rp.address);
+    // Sockets bound to the address of an interface get no multicast traffic, the paths are bound to their group
+    boost::asio::ip::udp::endpoint listen_endpoint(redundant ? group : iface_address, port);
+    path->socket.open(listen_endpoint.protocol());
+    path->socket.set_option(boost::asio::ip::multicast::enable_loopback(true));
+    path->socket.set_option(boost::asio::ip::udp::socket::reuse_address(true));
+    path->socket.set_option(boost::asio::socket_base::receive_buffer_size(16*1024*1024));
+#ifdef IP_MULTICAST_ALL
+    if (redundant && listen_endpoint.protocol() == boost::asio::ip::udp::v4()) {
+      // Only deliver the groups joined on this socket, the other paths share the port
+      int multicast_all = 0;
+      setsockopt(path->socket.native_handle(), IPPROTO_IP, IP_MULTICAST_ALL, &multicast_all, sizeof(multicast_all));
+    }
+#endif
+    path->socket.bind(listen_endpoint);
+
+    // Join the multicast group, on the interface of the path if there is one
+    if (redundant && group.is_v4() && iface_address.is_v4() && !iface_address.is_unspecified()) {
+      path->socket.set_option(
+          boost::asio::ip::multicast::join_group(group.to_v4(), iface_address.to_v4()));
+    } else {
+      path->socket.set_option(
+          boost::asio::ip::multicast::join_group(group));
+    }
+
+    _paths.push_back(std::move(path));
+  }
+
+  for (auto& path : _paths) {
+    start_receive(*path);
+  }
 }
 
 auto LibFlute::Receiver::enable_ipsec(uint32_t spi, const std::string& key) -> void
 {
-  LibFlute::IpSec::enable_esp(spi, _mcast_address, LibFlute::IpSec::Direction::In, key);
+  std::vector<std::string> addresses;
+  for (const auto& path : _paths) {
+    if (std::find(addresses.begin(), addresses.end(), path->stats.address) == addresses.end()) {
+      addresses.push_back(path->stats.address);
+      LibFlute::IpSec::enable_esp(spi, path->stats.address, LibFlute::IpSec::Direction::In, key);
+    }
+  }
 }
 
-auto LibFlute::Receiver::handle_receive_from(const boost::system::error_code& error,
+auto LibFlute::Receiver::start_receive(Path& path) -> void
+{
+  path.socket.async_receive_from(
+      boost::asio::buffer(path.data, max_length), path.sender_endpoint,
+      boost::bind(&LibFlute::Receiver::handle_receive_from, this, std::ref(path),
+        boost::asio::placeholders::error,
+        boost::asio::placeholders::bytes_transferred));
+}
+
+auto LibFlute::Receiver::handle_receive_from(Path& path, const boost::system::error_code& error,
     size_t bytes_recvd) -> void
 {
   if (!_running) return;
 
   if (!error)
   {
-    spdlog::trace("Received {} bytes", bytes_recvd);
-    try {
-      auto alc = LibFlute::AlcPacket(_data, bytes_recvd);
+    spdlog::trace("Received {} bytes on {}", bytes_recvd, path.stats.address);
+    if (admit_from_source(path.sender_endpoint.address(), bytes_recvd)) {
+      handle_packet(path, bytes_recvd);
+    }
+
+    start_receive(path);
+  }
+  else
+  {
+    spdlog::error("receive_from error: {}", error.message());
+  }
+}
+
+auto LibFlute::Receiver::handle_packet(Path& path, size_t bytes_recvd) -> void
+{
+  char* data = path.data;
+  {
+    const std::lock_guard<std::mutex> lock(_files_mutex);
+    path.stats.packets_received++;
+  }
+
+  try {
+    auto alc = LibFlute::AlcPacket(data, bytes_recvd);
 
-      if (alc.tsi() == _tsi) {
+    if (alc.tsi() == _tsi && alc.close_session()) {
+      const std::lock_guard<std::mutex> lock(_files_mutex);
+      close_session();
+    } else if (alc.tsi() == _tsi) {
 
-        const std::lock_guard<std::mutex> lock(_files_mutex);
+      const std::lock_guard<std::mutex> lock(_files_mutex);
 
-        if (alc.toi() == 0 && (!_fdt || _fdt->instance_id() != alc.fdt_instance_id())) {
-          if (_files.find(alc.toi()) == _files.end()) {
-            FileDeliveryTable::FileEntry fe{0, "", static_cast<uint32_t>(alc.fec_oti().transfer_length), "", "", 0, alc.fec_oti()};
-            _files.emplace(alc.toi(), std::make_shared<LibFlute::File>(fe));
+      if (alc.toi() == 0) {
+        // Every repetition is received, it may refresh the expiry of the instance or come from a restarted sender
+        auto fdt_file = _files.find(0);
+        if (fdt_file != _files.end() && fdt_file->second->fdt_instance_id() != alc.fdt_instance_id()) {
+          // The sender has moved on to another (partial) FDT instance, this one is only complete on its next repeat
+          spdlog::debug("Dropping incomplete FDT instance {}", fdt_file->second->fdt_instance_id());
+          erase_file(fdt_file);
+        }
+        if (_files.find(alc.toi()) == _files.end()) {
+          FileDeliveryTable::FileEntry fe{0, "", static_cast<uint32_t>(alc.fec_oti().transfer_length), "", "", 0, alc.fec_oti()};
+          if (_limits.max_file_size && fe.fec_oti.transfer_length > _limits.max_file_size) {
+            spdlog::debug("Rejecting FDT of {} bytes, over the maximum file size", fe.fec_oti.transfer_length);
+            _stats.files_rejected++;
+          } else {
+            auto fdt = _files.emplace(alc.toi(), std::make_shared<LibFlute::File>(fe)).first;
+            fdt->second->set_fdt_instance_id(alc.fdt_instance_id());
           }
         }
+      }
 
-        if (_files.find(alc.toi()) != _files.end() && !_files[alc.toi()]->complete()) {
-          auto encoding_symbols = LibFlute::EncodingSymbol::from_payload(
-              _data + alc.header_length(),
-              bytes_recvd - alc.header_length(),
-              _files[alc.toi()]->fec_oti(),
-              alc.content_encoding());
+      if (_files.find(alc.toi()) != _files.end() && !_files[alc.toi()]->complete() &&
+          (alc.toi() != 0 || _files[alc.toi()]->fdt_instance_id() == alc.fdt_instance_id())) {
+        if (_files[alc.toi()]->growing() && alc.fec_oti().transfer_length) {
+          // The sender has finalized the growing object
+          _files[alc.toi()]->finalize(alc.fec_oti().transfer_length);
+        }
+        auto encoding_symbols = LibFlute::EncodingSymbol::from_payload(
+            data + alc.header_length(),
+            bytes_recvd - alc.header_length(),
+            _files[alc.toi()]->fec_oti(),
+            alc.content_encoding());
 
-          for (const auto& symbol : encoding_symbols) {
-            spdlog::debug("received TOI {} SBN {} ID {}", alc.toi(), symbol.source_block_number(), symbol.id() );
-            _files[alc.toi()]->put_symbol(symbol);
+        if (!encoding_symbols.empty() && !_files[alc.toi()]->is_allocated()) {
+          // first symbol for this file, its buffer gets allocated now
+          _stats.files_allocated++;
+        }
+        for (const auto& symbol : encoding_symbols) {
+          spdlog::debug("received TOI {} SBN {} ID {}", alc.toi(), symbol.source_block_number(), symbol.id() );
+          if (_files[alc.toi()]->put_symbol(symbol)) {
+            path.stats.symbols_used++;
+          } else {
+            // already received, possibly on another path
+            path.stats.symbols_duplicate++;
+            _stats.symbols_duplicate++;
           }
+        }
+
+        if (_files[alc.toi()]->complete()) {
+          file_completed(alc.toi());
 
-          auto file = _files[alc.toi()].get();
-          if (_files[alc.toi()]->complete()) {
-            for (auto it = _files.cbegin(); it != _files.cend();)
-            {
-              if (it->second.get() != file && it->second->meta().content_location == file->meta().content_location)
-              {
-                spdlog::debug("Replacing file with TOI {}", it->first);
-                it = _files.erase(it);
-              }
-              else
-              {
-                ++it;
-              }
-            }
-
-            file->decode();
-
-            spdlog::debug("File with TOI {} completed", alc.toi());
-            if (alc.toi() != 0 && _completion_cb) {
-              _completion_cb(_files[alc.toi()]);
-              _files.erase(alc.toi());
-            }
-
-            if (alc.toi() == 0) { // parse complete FDT
-              _fdt = std::make_unique<LibFlute::FileDeliveryTable>(
-                  alc.fdt_instance_id(), _files[alc.toi()]->buffer(), _files[alc.toi()]->length());
-
-              _files.erase(alc.toi());
-              for (const auto& file_entry : _fdt->file_entries()) {
-                // automatically receive all files in the FDT
-                if (_files.find(file_entry.toi) == _files.end()) {
-                  spdlog::debug("Starting reception for file with TOI {}: {} ({})", file_entry.toi,
-                      file_entry.content_location, file_entry.content_type);
-                  _files.emplace(file_entry.toi, std::make_shared<LibFlute::File>(file_entry));
-                }
-              }
-            }
+          if (alc.toi() == 0) { // parse complete FDT
+            LibFlute::FileDeliveryTable fdt(alc.fdt_instance_id(), _files[alc.toi()]->buffer(),
+                _files[alc.toi()]->length());
+            _files.erase(alc.toi());
+            fdt_received(fdt);
           }
-        } else {
-          spdlog::trace("Discarding packet for unknown or already completed file with TOI {}", alc.toi());
         }
+
+        if (alc.close_object()) {
+          // The sender will not send any more packets for this object
+          auto it = _files.find(alc.toi());
+          if (it != _files.end() && !it->second->complete()) {
+            spdlog::debug("File with TOI {} closed by sender before completion, releasing it", alc.toi());
+            erase_file(it);
+            _stats.files_closed++;
+          }
+        }
+      } else if (_filtered_files.find(alc.toi()) != _filtered_files.end()) {
+        _stats.packets_filtered++;
+        spdlog::trace("Discarding packet for filtered file with TOI {}", alc.toi());
       } else {
-        spdlog::warn("Discarding packet for unknown TSI {}", alc.tsi());
+        spdlog::trace("Discarding packet for unknown or already completed file with TOI {}", alc.toi());
       }
-    } catch (const std::exception &ex) {
-      spdlog::warn("Failed to decode ALC/FLUTE packet: {}", ex.what());
+    } else {
+      spdlog::warn("Discarding packet for unknown TSI {}", alc.tsi());
     }
-
-    _socket.async_receive_from(
-        boost::asio::buffer(_data, max_length), _sender_endpoint,
-        boost::bind(&LibFlute::Receiver::handle_receive_from, this,
-          boost::asio::placeholders::error,
-          boost::asio::placeholders::bytes_transferred));
+  } catch (const std::exception &ex) {
+    spdlog::warn("Failed to decode ALC/FLUTE packet: {}", ex.what());
+    const std::lock_guard<std::mutex> lock(_files_mutex);
+    _stats.packets_invalid++;
+  } catch (const char *ex) {
+    spdlog::warn("Failed to decode ALC/FLUTE packet: {}", ex);
+    const std::lock_guard<std::mutex> lock(_files_mutex);
+    _stats.packets_invalid++;
   }
-  else
+}
+
+auto LibFlute::Receiver::file_completed(uint64_t toi) -> void
+{
+  // Called with _files_mutex locked
+  auto file = _files[toi].get();
+  for (auto it = _files.cbegin(); it != _files.cend();)
   {
-    spdlog::error("receive_from error: {}", error.message());
+    if (it->second.get() != file && it->second->meta().content_location == file->meta().content_location)
+    {
+      spdlog::debug("Replacing file with TOI {}", it->first);
+      it = erase_file(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+
+  file->decode();
+
+  spdlog::debug("File with TOI {} completed", toi);
+  if (toi != 0) {
+    // Not received again when a later FDT instance announces it once more
+    _completed_files.emplace(toi, time(nullptr));
+  }
+  if (toi != 0 && _completion_cb) {
+    _completion_cb(_files[toi]);
+    _files.erase(toi);
+  }
+}
+
+auto LibFlute::Receiver::admit_from_source(const boost::asio::ip::address& source, size_t bytes) -> bool
+{
+  if (!_limits.max_source_packet_rate && !_limits.max_source_byte_rate) return true;
+
+  const std::lock_guard<std::mutex> lock(_files_mutex);
+  auto now = std::chrono::steady_clock::now();
+  auto it = _source_buckets.find(source);
+  if (it == _source_buckets.end()) {
+    if (_source_buckets.size() >= max_tracked_sources) {
+      // Forget sources that have been quiet for a while, their buckets would be full again anyway
+      for (auto b = _source_buckets.begin(); b != _source_buckets.end();) {
+        if (now - b->second.last_update > std::chrono::seconds(1)) {
+          b = _source_buckets.erase(b);
+        } else {
+          ++b;
+        }
+      }
+      if (_source_buckets.size() >= max_tracked_sources) {
+        _stats.packets_rate_limited++;
+        return false;
+      }
+    }
+    it = _source_buckets.emplace(source, SourceBucket{static_cast<double>(_limits.max_source_packet_rate),
+                                                      static_cast<double>(_limits.max_source_byte_rate), now}).first;
   }
+
+  // Refill the token buckets, each holds at most one second worth of traffic
+  auto &bucket = it->second;
+  double elapsed = std::chrono::duration<double>(now - bucket.last_update).count();
+  bucket.last_update = now;
+  bucket.packets = std::min(static_cast<double>(_limits.max_source_packet_rate),
+                            bucket.packets + elapsed * _limits.max_source_packet_rate);
+  bucket.bytes = std::min(static_cast<double>(_limits.max_source_byte_rate),
+                          bucket.bytes + elapsed * _limits.max_source_byte_rate);
+
+  if ((_limits.max_source_packet_rate && bucket.packets < 1.0) ||
+      (_limits.max_source_byte_rate && bucket.bytes < bytes)) {
+    spdlog::trace("Dropping packet from {}, over the source rate limit", source.to_string());
+    _stats.packets_rate_limited++;
+    return false;
+  }
+  bucket.packets -= 1.0;
+  bucket.bytes -= bytes;
+  return true;
 }
 
 auto LibFlute::Receiver::file_list() -> std::vector<std::shared_ptr<LibFlute::File>>
 {
+  const std::lock_guard<std::mutex> lock(_files_mutex);
   std::vector<std::shared_ptr<LibFlute::File>> files;
   for (auto& f : _files) {
     files.push_back(f.second);
@@ -163,11 +325,21 @@ auto LibFlute::Receiver::remove_expired_files(unsigned max_age) -> void
   {
     auto age = time(nullptr) - it->second->received_at();
     if ( it->second->meta().content_location != "bootstrap.multipart"  && age > max_age) {
-      it = _files.erase(it);
+      it = erase_file(it);
     } else {
       ++it;
     }
   }
+  for (auto* tois : {&_filtered_files, &_completed_files}) {
+    for (auto it = tois->cbegin(); it != tois->cend();)
+    {
+      if (time(nullptr) - it->second > max_age) {
+        it = tois->erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
 }
 
 auto LibFlute::Receiver::remove_file_with_content_location(const std::string& cl) -> void
@@ -176,9 +348,291 @@ auto LibFlute::Receiver::remove_file_with_content_location(const std::string& cl
   for (auto it = _files.cbegin(); it != _files.cend();)
   {
     if ( it->second->meta().content_location == cl) {
-      it = _files.erase(it);
+      it = erase_file(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+auto LibFlute::Receiver::add_content_location_filter(const std::string& pattern, PatternSyntax syntax) -> Receiver&
+{
+  const std::lock_guard<std::mutex> lock(_files_mutex);
+  _content_location_filters.push_back(make_filter_regex(pattern, syntax));
+  reapply_filters();
+  return *this;
+}
+
+auto LibFlute::Receiver::add_content_type_filter(const std::string& pattern, PatternSyntax syntax) -> Receiver&
+{
+  const std::lock_guard<std::mutex> lock(_files_mutex);
+  _content_type_filters.push_back(make_filter_regex(pattern, syntax));
+  reapply_filters();
+  return *this;
+}
+
+auto LibFlute::Receiver::file_size_filter(uint64_t min_size, uint64_t max_size) -> Receiver&
+{
+  const std::lock_guard<std::mutex> lock(_files_mutex);
+  _min_file_size = min_size;
+  _max_file_size = max_size;
+  reapply_filters();
+  return *this;
+}
+
+auto LibFlute::Receiver::clear_filters() -> Receiver&
+{
+  const std::lock_guard<std::mutex> lock(_files_mutex);
+  _content_location_filters.clear();
+  _content_type_filters.clear();
+  _min_file_size = 0;
+  _max_file_size = std::numeric_limits<uint64_t>::max();
+  reapply_filters();
+  return *this;
+}
+
+auto LibFlute::Receiver::make_filter_regex(const std::string& pattern, PatternSyntax syntax) -> std::regex
+{
+  if (syntax == PATTERN_REGEX) {
+    return std::regex(pattern);
+  }
+
+  // Translate the glob pattern into an equivalent regular expression
+  std::string re;
+  for (size_t i = 0; i < pattern.size(); i++) {
+    char c = pattern[i];
+    switch (c) {
+      case '*':
+        re += ".*";
+        break;
+      case '?':
+        re += '.';
+        break;
+      case '[': {
+        auto end = pattern.find(']', i + 2);
+        if (end == std::string::npos) {
+          re += "\\[";
+        } else {
+          auto set = pattern.substr(i + 1, end - i - 1);
+          if (set[0] == '!') set[0] = '^';
+          re += '[' + set + ']';
+          i = end;
+        }
+        break;
+      }
+      case '.': case '+': case '(': case ')': case '{': case '}':
+      case '^': case '$': case '|': case '\\': case ']':
+        re += '\\';
+        re += c;
+        break;
+      default:
+        re += c;
+        break;
+    }
+  }
+  return std::regex(re);
+}
+
+auto LibFlute::Receiver::is_wanted(const FileDeliveryTable::FileEntry& entry) const -> bool
+{
+  uint64_t size = entry.content_length ? entry.content_length : entry.fec_oti.transfer_length;
+  if (size < _min_file_size || size > _max_file_size) return false;
+
+  auto matches_any = [](const std::vector<std::regex>& filters, const std::string& value) {
+    if (filters.empty()) return true;
+    return std::any_of(filters.begin(), filters.end(),
+        [&value](const std::regex& re) { return std::regex_match(value, re); });
+  };
+  return matches_any(_content_location_filters, entry.content_location) &&
+         matches_any(_content_type_filters, entry.content_type);
+}
+
+auto LibFlute::Receiver::fdt_received(FileDeliveryTable& fdt) -> void
+{
+  // Called with _files_mutex locked
+  expire_fdt_instances();
+  auto instance = _fdt_instances.find(fdt.instance_id());
+  if (instance != _fdt_instances.end() && instance->second == fdt.expires()) {
+    // A repetition of an instance that has already been merged
+    return;
+  }
+
+  // Partial FDT instances are merged, a file is described by the most recent instance that announced it
+  for (const auto& file_entry : fdt.file_entries()) {
+    auto announced = _announced.find(file_entry.toi);
+    if (announced != _announced.end() && announced->second.expires > fdt.expires()) {
+      // Announced by a later instance already, this one was delayed
+      continue;
+    }
+    _announced.insert_or_assign(file_entry.toi, Announcement{file_entry, fdt.instance_id(), fdt.expires()});
+  }
+  _fdt_instances[fdt.instance_id()] = fdt.expires();
+
+  // Instances whose files have all been announced again by later ones are superseded
+  for (auto it = _fdt_instances.begin(); it != _fdt_instances.end();) {
+    auto id = it->first;
+    if (std::none_of(_announced.begin(), _announced.end(),
+          [id](const auto& announced) { return announced.second.fdt_instance_id == id; })) {
+      it = _fdt_instances.erase(it);
     } else {
       ++it;
     }
   }
+
+  for (const auto& file_entry : fdt.file_entries()) {
+    start_file_reception(file_entry);
+  }
+}
+
+auto LibFlute::Receiver::expire_fdt_instances() -> void
+{
+  // Called with _files_mutex locked
+  auto now = ntp_seconds();
+  for (auto it = _announced.begin(); it != _announced.end();) {
+    if (it->second.expires < now) {
+      it = _announced.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (auto it = _fdt_instances.begin(); it != _fdt_instances.end();) {
+    if (it->second < now) {
+      it = _fdt_instances.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+auto LibFlute::Receiver::start_file_reception(const FileDeliveryTable::FileEntry& file_entry) -> void
+{
+  // automatically receive the file if it is wanted, buffers are only allocated once the first symbol arrives
+  auto existing = _files.find(file_entry.toi);
+  if (existing != _files.end()) {
+    if (existing->second->growing() && !file_entry.growing) {
+      // A growing object that has been finalized, in case the packets with its length in EXT_FTI were lost
+      try {
+        existing->second->finalize(file_entry.fec_oti.transfer_length);
+        if (existing->second->complete()) file_completed(file_entry.toi);
+      } catch (const char *ex) {
+        spdlog::warn("Failed to finalize file with TOI {}: {}", file_entry.toi, ex);
+      }
+    }
+    return;
+  }
+  if (_filtered_files.find(file_entry.toi) != _filtered_files.end() ||
+      _completed_files.find(file_entry.toi) != _completed_files.end()) {
+    return;
+  }
+  if (!is_wanted(file_entry)) {
+    spdlog::debug("Ignoring filtered file with TOI {}: {} ({})", file_entry.toi,
+        file_entry.content_location, file_entry.content_type);
+    _filtered_files.emplace(file_entry.toi, time(nullptr));
+    _stats.files_filtered++;
+    return;
+  }
+  // A growing object can take up its maximum length
+  uint64_t length = file_entry.growing ?
+      (uint64_t)file_entry.fec_oti.max_source_block_length * file_entry.fec_oti.encoding_symbol_length :
+      file_entry.fec_oti.transfer_length;
+  if (_limits.max_file_size && length > _limits.max_file_size) {
+    spdlog::warn("Rejecting file with TOI {}: transfer length {} is over the maximum file size", file_entry.toi,
+        length);
+    _filtered_files.emplace(file_entry.toi, time(nullptr));
+    _stats.files_rejected++;
+    return;
+  }
+  if (_limits.max_concurrent_files) {
+    // Only files still being received count, not the FDT or completed files kept for the application
+    auto receiving = static_cast<size_t>(std::count_if(_files.begin(), _files.end(),
+        [](const auto& file) { return file.first != 0 && !file.second->complete(); }));
+    if (receiving >= _limits.max_concurrent_files) {
+      // Not remembered as filtered, the file will be considered again with the next FDT instance
+      spdlog::debug("Not receiving file with TOI {}: {} files already being received", file_entry.toi, receiving);
+      _stats.files_rejected++;
+      return;
+    }
+  }
+  try {
+    auto file = std::make_shared<LibFlute::File>(file_entry);
+    spdlog::debug("Starting reception for file with TOI {}: {} ({})", file_entry.toi,
+        file_entry.content_location, file_entry.content_type);
+    _files.emplace(file_entry.toi, file);
+    _stats.files_announced++;
+  } catch (const char *ex) {
+    spdlog::warn("Rejecting file with TOI {}: {}", file_entry.toi, ex);
+    _filtered_files.emplace(file_entry.toi, time(nullptr));
+    _stats.files_rejected++;
+  }
+}
+
+auto LibFlute::Receiver::admission_limits(const AdmissionLimits& limits) -> Receiver&
+{
+  const std::lock_guard<std::mutex> lock(_files_mutex);
+  _limits = limits;
+  _source_buckets.clear();
+  return *this;
+}
+
+auto LibFlute::Receiver::reapply_filters() -> void
+{
+  // Drop files that are no longer wanted and re-evaluate the ones filtered out before
+  for (auto it = _files.cbegin(); it != _files.cend();) {
+    if (it->first != 0 && !it->second->complete() && !is_wanted(it->second->meta())) {
+      spdlog::debug("Stopping reception for filtered file with TOI {}", it->first);
+      it = erase_file(it);
+    } else {
+      ++it;
+    }
+  }
+  _filtered_files.clear();
+  // Files of expired instances are no longer being sent
+  expire_fdt_instances();
+  for (const auto& announced : _announced) {
+    start_file_reception(announced.second.entry);
+  }
+}
+
+auto LibFlute::Receiver::close_session() -> void
+{
+  // Only the objects still being received are released, completed files stay until they expire or are removed
+  spdlog::debug("Session closed by sender, releasing incomplete files");
+  for (auto it = _files.cbegin(); it != _files.cend();) {
+    if (it->second->complete()) {
+      ++it;
+    } else {
+      it = erase_file(it);
+    }
+  }
+  _announced.clear();
+  _fdt_instances.clear();
+  _filtered_files.clear();
+  _completed_files.clear();
+  _stats.sessions_closed++;
+}
+
+auto LibFlute::Receiver::statistics() -> Statistics
+{
+  const std::lock_guard<std::mutex> lock(_files_mutex);
+  Statistics stats = _stats;
+  for (const auto& f : _files) {
+    if (!f.second->is_allocated()) {
+      stats.files_deferred++;
+      stats.deferred_bytes += f.second->meta().fec_oti.transfer_length;
+    }
+  }
+  for (const auto& path : _paths) {
+    stats.paths.push_back(path->stats);
+  }
+  return stats;
+}
+
+auto LibFlute::Receiver::erase_file(std::map<uint64_t, std::shared_ptr<LibFlute::File>>::const_iterator it)
+    -> std::map<uint64_t, std::shared_ptr<LibFlute::File>>::iterator
+{
+  if (!it->second->is_allocated()) {
+    // removed before any symbol arrived, the buffer was never needed
+    _stats.never_allocated_bytes += it->second->meta().fec_oti.transfer_length;
+  }
+  return _files.erase(it);
 }
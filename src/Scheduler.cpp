@@ -0,0 +1,87 @@
+// libflute - FLUTE/ALC library
+//
+// Copyright (C) 2026 libflute contributors
+//
+// Licensed under the License terms and conditions for use, reproduction, and
+// distribution of 5G-MAG software (the “License”).  You may not use this file
+// except in compliance with the License.  You may obtain a copy of the License at
+// https://www.5g-mag.com/reference-tools.  Unless required by applicable law or
+// agreed to in writing, software distributed under the License is distributed on
+// an “AS IS” BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied.
+//
+// See the License for the specific language governing permissions and limitations
+// under the License.
+//
+#include "Scheduler.h"
+#include <algorithm>
+
+LibFlute::DeficitRoundRobinScheduler::DeficitRoundRobinScheduler(size_t quantum)
+  : _quantum(quantum ? quantum : 1)
+{
+}
+
+auto LibFlute::DeficitRoundRobinScheduler::add(uint32_t toi, unsigned priority, unsigned weight) -> void
+{
+  if (!weight) weight = 1;
+  auto& entries = _classes[priority].entries;
+  auto it = std::find_if(entries.begin(), entries.end(), [toi](const Entry& entry) { return entry.toi == toi; });
+  if (it != entries.end()) {
+    it->weight = weight;
+    return;
+  }
+  // A change of priority class moves the object
+  remove(toi);
+  _classes[priority].entries.push_back({toi, weight, 0, 0});
+}
+
+auto LibFlute::DeficitRoundRobinScheduler::remove(uint32_t toi) -> void
+{
+  for (auto class_it = _classes.begin(); class_it != _classes.end(); ++class_it) {
+    auto& priority_class = class_it->second;
+    auto& entries = priority_class.entries;
+    auto it = std::find_if(entries.begin(), entries.end(), [toi](const Entry& entry) { return entry.toi == toi; });
+    if (it == entries.end()) continue;
+
+    size_t index = it - entries.begin();
+    entries.erase(it);
+    if (entries.empty()) {
+      _classes.erase(class_it);
+    } else if (index < priority_class.current || priority_class.current == entries.size()) {
+      // Keep the turn with the same object, or wrap around when the last object of the round was removed
+      priority_class.current = index < priority_class.current ? priority_class.current - 1 : 0;
+    }
+    return;
+  }
+}
+
+auto LibFlute::DeficitRoundRobinScheduler::schedule(const send_function_t &send) -> size_t
+{
+  _schedule_count++;
+  for (auto& class_m : _classes) {
+    auto& priority_class = class_m.second;
+    auto& entries = priority_class.entries;
+    size_t stalled = 0;
+    while (stalled < entries.size()) {
+      auto& entry = entries[priority_class.current];
+      if (entry.stalled != _schedule_count && entry.deficit > 0) {
+        auto bytes = send(entry.toi);
+        if (bytes) {
+          entry.deficit -= bytes;
+          return bytes;
+        }
+        // Nothing to send at the moment, an idle object does not keep its credit
+        entry.deficit = 0;
+        entry.stalled = _schedule_count;
+        stalled++;
+      }
+      // Turn of the next object, with a new quantum
+      priority_class.current = (priority_class.current + 1) % entries.size();
+      auto& next = entries[priority_class.current];
+      if (next.stalled != _schedule_count) {
+        next.deficit += static_cast<int64_t>(_quantum * next.weight);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,1014 @@
+// libflute - FLUTE/ALC library
+//
+// Copyright (C) 2026 libflute contributors
+//
+// Licensed under the License terms and conditions for use, reproduction, and
+// distribution of 5G-MAG software (the “License”).  You may not use this file
+// except in compliance with the License.  You may obtain a copy of the License at
+// https://www.5g-mag.com/reference-tools.  Unless required by applicable law or
+// agreed to in writing, software distributed under the License is distributed on
+// an “AS IS” BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied.
+//
+// See the License for the specific language governing permissions and limitations
+// under the License.
+//
+#include <errno.h>
+#include <limits.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#if HAVE_SO_TXTIME
+#include <linux/net_tstamp.h>
+#endif
+#if HAVE_MSG_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+#include <boost/bind/bind.hpp>
+
+#include "spdlog/spdlog.h"
+#include "File.h"
+#include "Transmitter.h"
+
+#include "SessionMultiplexer.h"
+
+namespace LibFlute {
+
+#if HAVE_SO_TXTIME
+static void set_txtime( struct cmsghdr *cmsg, Pacer::clock::time_point departure );
+#endif
+#if HAVE_UDP_SEGMENT
+static size_t page_count( const std::vector<boost::asio::const_buffer> &segments );
+#endif
+
+/**
+ *  Allocator for the completion handler of an asynchronous send, using storage in the packet buffer being sent so
+ *  that sending a packet does not allocate. Falls back to the heap if the handler does not fit or the storage is
+ *  already in use.
+ */
+template <typename T>
+class PacketHandlerAllocator {
+  public:
+    using value_type = T;
+
+    PacketHandlerAllocator(unsigned char *memory, size_t size, bool *in_use) noexcept
+      : _memory(memory), _size(size), _in_use(in_use) {}
+    template <typename U>
+    PacketHandlerAllocator(const PacketHandlerAllocator<U> &other) noexcept
+      : _memory(other._memory), _size(other._size), _in_use(other._in_use) {}
+
+    T *allocate(size_t n) {
+      if (!*_in_use && sizeof(T) * n <= _size && alignof(T) <= alignof(std::max_align_t)) {
+        *_in_use = true;
+        return reinterpret_cast<T*>(_memory);
+      }
+      return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T *p, size_t n) {
+      if (reinterpret_cast<unsigned char*>(p) == _memory) {
+        *_in_use = false;
+      } else {
+        std::allocator<T>().deallocate(p, n);
+      }
+    }
+
+    template <typename U>
+    bool operator==(const PacketHandlerAllocator<U> &other) const noexcept { return _memory == other._memory; }
+    template <typename U>
+    bool operator!=(const PacketHandlerAllocator<U> &other) const noexcept { return _memory != other._memory; }
+
+  private:
+    template <typename> friend class PacketHandlerAllocator;
+    unsigned char *_memory;
+    size_t _size;
+    bool *_in_use;
+};
+
+/**
+ *  Buffer sequence over the segments of a packet buffer that is cheap to copy into an asynchronous send
+ */
+class PacketSegments {
+  public:
+    using value_type = boost::asio::const_buffer;
+    using const_iterator = const boost::asio::const_buffer*;
+
+    explicit PacketSegments(const std::vector<boost::asio::const_buffer> &segments)
+      : _begin(segments.data()), _end(segments.data() + segments.size()) {}
+
+    const_iterator begin() const { return _begin; }
+    const_iterator end() const { return _end; }
+
+  private:
+    const_iterator _begin;
+    const_iterator _end;
+};
+
+/**
+ *  Send completion handler that allocates from a PacketHandlerAllocator
+ */
+template <typename Handler>
+class PacketSendHandler {
+  public:
+    using allocator_type = PacketHandlerAllocator<Handler>;
+
+    PacketSendHandler(const allocator_type &allocator, Handler handler)
+      : _allocator(allocator), _handler(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept { return _allocator; }
+    void operator()(const boost::system::error_code &error, std::size_t bytes_transferred) {
+      _handler(error, bytes_transferred);
+    }
+
+  private:
+    allocator_type _allocator;
+    Handler _handler;
+};
+
+/**
+ * Scratch space for the system calls of the batch send path, kept to avoid allocations per batch
+ */
+struct SessionMultiplexer::SendBuffers {
+  std::vector<struct iovec> iov;
+#if HAVE_SENDMMSG
+  std::vector<struct mmsghdr> msgs;
+#endif
+  std::vector<char> control;
+};
+
+SessionMultiplexer::Lane::Lane(boost::asio::io_context& io_context, const boost::asio::ip::udp &protocol,
+                               unsigned index)
+    : index(index)
+    , worker(false)
+    , socket(io_context, protocol)
+    , send_buffers(std::make_unique<SendBuffers>())
+{
+}
+
+SessionMultiplexer::Lane::~Lane() = default;
+
+SessionMultiplexer::SessionMultiplexer(boost::asio::io_context& io_context, uint32_t rate_limit,
+                                       const boost::asio::ip::udp &protocol)
+    : _io_context(io_context)
+    , _protocol(protocol)
+    , _lane(io_context, protocol, 0)
+    , _send_timer(io_context)
+    , _rate_limit(rate_limit)
+    , _pacer(rate_limit * 1000ULL)
+{
+  setup_socket(_lane.socket);
+}
+
+SessionMultiplexer::~SessionMultiplexer()
+{
+  stop_workers();
+  // Handlers still queued on the io_context are dropped, those running must be done with this SessionMultiplexer
+  std::unique_lock<std::mutex> lock(_pending_handlers->mutex);
+  _pending_handlers->closed = true;
+  _pending_handlers->done.wait(lock, [this]() { return _pending_handlers->running == 0; });
+}
+
+auto SessionMultiplexer::rate_limit(uint32_t limit) -> SessionMultiplexer&
+{
+  std::lock_guard<std::mutex> guard(_sessions_mutex);
+  _rate_limit = limit;
+  _pacer.rate(limit * 1000ULL);
+  return *this;
+}
+
+auto SessionMultiplexer::pacing_burst(size_t bytes) -> SessionMultiplexer&
+{
+  std::lock_guard<std::mutex> guard(_sessions_mutex);
+  _pacer.burst(bytes);
+  return *this;
+}
+
+auto SessionMultiplexer::post(std::function<void()> handler) -> void
+{
+  // Posted from any thread, the handler is not run if the SessionMultiplexer is destroyed before it gets to run
+  boost::asio::post(_io_context, [pending = _pending_handlers, handler = std::move(handler)]() {
+        {
+          std::lock_guard<std::mutex> guard(pending->mutex);
+          if (pending->closed) return;
+          pending->running++;
+        }
+        handler();
+        std::lock_guard<std::mutex> guard(pending->mutex);
+        pending->running--;
+        pending->done.notify_all();
+      });
+}
+
+auto SessionMultiplexer::setup_socket(boost::asio::ip::udp::socket &socket) -> void
+{
+  socket.set_option(boost::asio::ip::multicast::enable_loopback(true));
+  socket.set_option(boost::asio::ip::udp::socket::reuse_address(true));
+  if (_source_address) {
+    socket.bind(boost::asio::ip::udp::endpoint(_source_address.value(), 0));
+  }
+#if HAVE_SO_TXTIME
+  if (_txtime_pacing) {
+    struct sock_txtime txtime = {};
+    txtime.clockid = CLOCK_MONOTONIC; // the clock of std::chrono::steady_clock
+    setsockopt(socket.native_handle(), SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime));
+  }
+#endif
+}
+
+auto SessionMultiplexer::add_session(Transmitter *session, unsigned weight) -> uint32_t
+{
+  std::lock_guard<std::mutex> guard(_sessions_mutex);
+  auto id = _next_session_id++;
+  _sessions.insert({id, session});
+  _session_scheduler.add(id, 0, weight);
+  return id;
+}
+
+auto SessionMultiplexer::remove_session(uint32_t id) -> void
+{
+  {
+    std::unique_lock<std::mutex> lock(_sessions_mutex);
+    auto it = _sessions.find(id);
+    if (it == _sessions.end()) return;
+    auto session = it->second;
+    _sessions.erase(it);
+    _session_scheduler.remove(id);
+    // Workers may still be building packets of the session
+    _building_done.wait(lock, [this]() { return _building == 0; });
+
+    // Packets of the session still waiting in the batch of a lane are dropped by flush_batch(), those in flight are
+    // released on completion. Its control packets are still sent, they close the session or its objects.
+    std::lock_guard<std::mutex> pool_guard(_pool_mutex);
+    for (auto& packet : _packet_pool) {
+      if (packet->session == session) {
+        packet->session = nullptr;
+        packet->dropped = !packet->control;
+      }
+    }
+  }
+  session_deactivated();
+}
+
+auto SessionMultiplexer::session_weight(uint32_t id, unsigned weight) -> void
+{
+  std::lock_guard<std::mutex> guard(_sessions_mutex);
+  if (_sessions.count(id)) {
+    _session_scheduler.add(id, 0, weight);
+  }
+}
+
+auto SessionMultiplexer::session_activated() -> void
+{
+  {
+    std::lock_guard<std::mutex> guard(_sessions_mutex);
+    if (_running) return;
+    _running = true;
+  }
+  if (_worker_threads) {
+    _workers_wakeup.notify_all();
+    return;
+  }
+  // Any packets left over from before the send loop stopped are rebuilt when the files restart
+  while (_lane.batch_sent < _lane.batch.size()) {
+    release_packet(_lane.batch[_lane.batch_sent++]);
+  }
+  _lane.batch.clear();
+  _lane.batch_sent = 0;
+  if (_zerocopy_head) {
+    wait_zerocopy_completions();
+  }
+  send_next_packet();
+}
+
+auto SessionMultiplexer::sessions_sending() const -> bool
+{
+  // Called with _sessions_mutex locked
+  if (!_control_packets.empty()) return true;
+  for (const auto& session_m : _sessions) {
+    if (session_m.second->_active) return true;
+  }
+  return false;
+}
+
+auto SessionMultiplexer::session_deactivated() -> void
+{
+  {
+    std::lock_guard<std::mutex> guard(_sessions_mutex);
+    if (!_running) return;
+    // The send loop only runs while a session is active or has control packets queued, idle workers wait for
+    // session_activated()
+    if (sessions_sending()) return;
+    _running = false;
+  }
+  _send_timer.cancel();
+  if (_batch_blocked || _zerocopy_wait) {
+    // Waits for zero copy completions are cancelled as well, session_activated() starts them again
+    _lane.socket.cancel();
+    _batch_blocked = false;
+    _zerocopy_blocked = false;
+    _zerocopy_wait = false;
+  }
+}
+
+auto SessionMultiplexer::packets_queued() -> void
+{
+  // Called by the sessions when they queue files, on any thread and with their files locked. The send loop is
+  // woken straight away rather than at the end of its idle poll, which would leave a gap in a paced transmission.
+  if (_worker_threads) {
+    _workers_wakeup.notify_all();
+    return;
+  }
+  if (_wakeup_pending.exchange(true)) return;
+  post([this]() {
+        _wakeup_pending = false;
+        if (_send_idle) {
+          // The handler of the poll runs send_next_packet() now
+          _send_timer.cancel();
+        }
+      });
+}
+
+auto SessionMultiplexer::send_control_packet(PacketBuffer *packet) -> void
+{
+  // Called by an active session, the send loop is running
+  {
+    std::lock_guard<std::mutex> guard(_sessions_mutex);
+    _control_packets.push_back(packet);
+  }
+  packets_queued();
+}
+
+auto SessionMultiplexer::bind(const boost::asio::ip::address &address) -> void
+{
+  // Several sessions may ask for the same source address
+  if (_source_address == address) return;
+  _lane.socket.bind(boost::asio::ip::udp::endpoint(address, 0));
+  for (auto& worker : _workers) {
+    worker->lane.socket.bind(boost::asio::ip::udp::endpoint(address, 0));
+  }
+  _source_address = address;
+}
+
+auto SessionMultiplexer::sends_object(uint32_t session_id, uint32_t toi) const -> bool
+{
+  // Objects are spread over the workers, and each object always goes through the same worker to keep its order
+  if (!_filling) return true;
+  return (toi + session_id * 7919U) % _workers.size() == _filling->index;
+}
+
+auto SessionMultiplexer::txtime_pacing(bool enable) -> SessionMultiplexer&
+{
+#if HAVE_SO_TXTIME
+  if (enable) {
+    struct sock_txtime txtime = {};
+    txtime.clockid = CLOCK_MONOTONIC; // the clock of std::chrono::steady_clock
+    if (setsockopt(_lane.socket.native_handle(), SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)) < 0) {
+      spdlog::warn("Kernel pacing is not available: {}", strerror(errno));
+      enable = false;
+    }
+    for (auto& worker : _workers) {
+      setsockopt(worker->lane.socket.native_handle(), SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime));
+    }
+  }
+  _txtime_pacing = enable;
+#else
+  if (enable) {
+    spdlog::warn("Kernel pacing is not supported on this platform");
+  }
+#endif
+  return *this;
+}
+
+auto SessionMultiplexer::send_batch_size(unsigned size) -> SessionMultiplexer&
+{
+  _send_batch_size = size ? size : 1;
+  return *this;
+}
+
+auto SessionMultiplexer::zerocopy(bool enable) -> SessionMultiplexer&
+{
+#if HAVE_MSG_ZEROCOPY
+  if (enable && _worker_threads) {
+    spdlog::warn("Zero copy transmission is not available with worker threads");
+    return *this;
+  }
+  int value = enable ? 1 : 0;
+  if (setsockopt(_lane.socket.native_handle(), SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value)) < 0) {
+    if (enable) {
+      spdlog::warn("Zero copy transmission is not available: {}", strerror(errno));
+    }
+    enable = false;
+  }
+  _zerocopy = enable;
+#else
+  if (enable) {
+    spdlog::warn("Zero copy transmission is not supported on this platform");
+  }
+#endif
+  return *this;
+}
+
+auto SessionMultiplexer::worker_threads(unsigned count) -> SessionMultiplexer&
+{
+  stop_workers();
+  if (count && _zerocopy) {
+    spdlog::warn("Zero copy transmission is not available with worker threads, disabling it");
+    zerocopy(false);
+  }
+  for (unsigned i = 0; i < count; i++) {
+    _workers.push_back(std::make_unique<Worker>(_protocol, i));
+    auto &lane = _workers.back()->lane;
+    lane.worker = true;
+    setup_socket(lane.socket);
+  }
+  _worker_threads = count;
+  for (auto& worker : _workers) {
+    worker->thread = std::thread(&SessionMultiplexer::run_worker, this, std::ref(*worker));
+  }
+  if (!count && _running) {
+    // Back to sending on the io_context thread
+    post([this]() { send_next_packet(); });
+  }
+  return *this;
+}
+
+auto SessionMultiplexer::stop_workers() -> void
+{
+  if (_workers.empty()) return;
+  {
+    std::lock_guard<std::mutex> guard(_sessions_mutex);
+    _stop_workers = true;
+  }
+  _workers_wakeup.notify_all();
+  for (auto& worker : _workers) {
+    worker->thread.join();
+  }
+  _workers.clear();
+  _worker_threads = 0;
+  _stop_workers = false;
+}
+
+auto SessionMultiplexer::statistics() const -> Statistics
+{
+  Statistics stats;
+  stats.packets_sent = _packets_sent;
+  stats.bytes_sent = _bytes_sent;
+  stats.send_calls = _send_calls;
+  stats.zerocopy_copied = _zerocopy_copied;
+  return stats;
+}
+
+auto SessionMultiplexer::allocate_packet() -> PacketBuffer*
+{
+  std::lock_guard<std::mutex> guard(_pool_mutex);
+  if (_free_packets.empty()) {
+    _packet_pool.push_back(std::make_unique<PacketBuffer>());
+    return _packet_pool.back().get();
+  }
+  auto packet = _free_packets.back();
+  _free_packets.pop_back();
+  return packet;
+}
+
+auto SessionMultiplexer::release_packet(PacketBuffer *packet) -> void
+{
+  packet->session = nullptr;
+  packet->dropped = false;
+  packet->control = false;
+  packet->file.reset();
+  std::lock_guard<std::mutex> guard(_pool_mutex);
+  _free_packets.push_back(packet);
+}
+
+auto SessionMultiplexer::next_packet() -> PacketBuffer*
+{
+  // Called with _sessions_mutex locked
+  if (!_control_packets.empty()) {
+    auto packet = _control_packets.front();
+    _control_packets.pop_front();
+    return packet;
+  }
+  PacketBuffer *packet = nullptr;
+  _session_scheduler.schedule([this, &packet](uint32_t id) -> size_t {
+        packet = _sessions[id]->next_packet();
+        return packet ? packet->size() : 0;
+      });
+  if (packet && !_filling) {
+    // Workers build their packets once they have left the lock
+    packet->session->build_packet(packet);
+  }
+  return packet;
+}
+
+auto SessionMultiplexer::packet_sent(PacketBuffer *packet, bool success) -> void
+{
+  if (success) {
+    _packets_sent++;
+    _bytes_sent += packet->size();
+  }
+  if (packet->session) {
+    packet->session->packet_sent(packet, success);
+  }
+  release_packet(packet);
+}
+
+auto SessionMultiplexer::packet_accepted(Lane &lane, PacketBuffer *packet, uint32_t zerocopy_id) -> void
+{
+  if (lane.worker) {
+    lane.completions.emplace_back(packet, true);
+    return;
+  }
+  if (!_zerocopy) {
+    // The socket has its own copy of the data
+    packet_sent(packet, true);
+    return;
+  }
+  // The kernel still references the packet and file data until the completion for the send arrives
+  packet->zerocopy_id = zerocopy_id;
+  packet->next_in_flight = nullptr;
+  if (_zerocopy_tail) {
+    _zerocopy_tail->next_in_flight = packet;
+  } else {
+    _zerocopy_head = packet;
+  }
+  _zerocopy_tail = packet;
+  wait_zerocopy_completions();
+}
+
+auto SessionMultiplexer::packet_failed(Lane &lane, PacketBuffer *packet) -> void
+{
+  if (lane.worker) {
+    lane.completions.emplace_back(packet, false);
+    return;
+  }
+  packet_sent(packet, false);
+}
+
+auto SessionMultiplexer::wait_zerocopy_completions() -> void
+{
+  if (_zerocopy_wait) return;
+  // Completions are queued on the socket error queue, which signals an error condition on the socket
+  _zerocopy_wait = true;
+  _lane.socket.async_wait(boost::asio::socket_base::wait_error,
+      [this](const boost::system::error_code& error) {
+        if (error) return;
+        _zerocopy_wait = false;
+        handle_zerocopy_completions();
+      });
+}
+
+auto SessionMultiplexer::handle_zerocopy_completions() -> void
+{
+  bool released = false;
+#if HAVE_MSG_ZEROCOPY
+  for (;;) {
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+    struct msghdr msg = {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(_lane.socket.native_handle(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) continue;
+      struct sock_extended_err err;
+      memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+      if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) continue;
+      // Each notification covers a range of send IDs
+      if (zerocopy_completed(err.ee_info, err.ee_data, err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)) {
+        released = true;
+      }
+    }
+  }
+#endif
+  if (_zerocopy_head) {
+    wait_zerocopy_completions();
+  }
+  if (released && _zerocopy_blocked) {
+    _zerocopy_blocked = false;
+    send_next_packet();
+  }
+}
+
+auto SessionMultiplexer::zerocopy_completed(uint32_t first_id, uint32_t last_id, bool copied) -> bool
+{
+  bool released = false;
+  PacketBuffer *previous = nullptr;
+  auto packet = _zerocopy_head;
+  while (packet) {
+    auto next = packet->next_in_flight;
+    if (static_cast<uint32_t>(packet->zerocopy_id - first_id) <= static_cast<uint32_t>(last_id - first_id)) {
+      if (previous) {
+        previous->next_in_flight = next;
+      } else {
+        _zerocopy_head = next;
+      }
+      if (_zerocopy_tail == packet) {
+        _zerocopy_tail = previous;
+      }
+      if (copied) {
+        _zerocopy_copied++;
+      }
+      packet_sent(packet, true);
+      released = true;
+    } else {
+      previous = packet;
+    }
+    packet = next;
+  }
+  return released;
+}
+
+auto SessionMultiplexer::fill_batch(Lane &lane) -> void
+{
+  // Called with _sessions_mutex locked
+  lane.batch.clear();
+  lane.batch_sent = 0;
+  lane.batch_bytes = 0;
+
+  _filling = lane.worker ? &lane : nullptr;
+  while (lane.batch.size() < _send_batch_size) {
+    auto packet = next_packet();
+    if (!packet) break;
+
+    lane.batch_bytes += packet->size();
+    if (_txtime_pacing) {
+      packet->departure = _pacer.departure_time(packet->size());
+    }
+    lane.batch.push_back(packet);
+  }
+  _filling = nullptr;
+}
+
+auto SessionMultiplexer::flush_batch(Lane &lane) -> bool
+{
+  int flags = MSG_DONTWAIT;
+#if HAVE_MSG_ZEROCOPY
+  if (_zerocopy) {
+    flags |= MSG_ZEROCOPY;
+  }
+#endif
+
+  while (lane.batch_sent < lane.batch.size()) {
+    if (lane.batch[lane.batch_sent]->dropped) {
+      // The session was removed while the packet was waiting, the completion releases it
+      packet_failed(lane, lane.batch[lane.batch_sent++]);
+      continue;
+    }
+#if HAVE_UDP_SEGMENT
+    if (_udp_gso) {
+      // Gather the next run of equally sized packets to the same destination, only the last one in a run may be
+      // shorter
+      const auto& send_endpoint = lane.batch[lane.batch_sent]->destination;
+      size_t segment_size = lane.batch[lane.batch_sent]->size();
+      size_t max_segments = std::min<size_t>(max_gso_segments, max_udp_payload / segment_size);
+      size_t segments = 0;
+      size_t frags = 0;
+      auto &iov = lane.send_buffers->iov;
+      iov.clear();
+      for (size_t i = lane.batch_sent; i < lane.batch.size() && segments < max_segments; i++) {
+        auto packet = lane.batch[i];
+        if (packet->size() > segment_size) break;
+        if (segments > 0 && packet->dropped) break;
+        if (iov.size() + packet->segments.size() > static_cast<size_t>(IOV_MAX)) break;
+        if (segments > 0 && packet->destination != send_endpoint) break;
+        if (_zerocopy) {
+          // A zero copy send pins every page it touches as a fragment of a single skb, the kernel
+          // rejects the send with EMSGSIZE when they exceed MAX_SKB_FRAGS
+          size_t packet_frags = page_count(packet->segments);
+          if (segments > 0 && frags + packet_frags > max_zerocopy_frags) break;
+          frags += packet_frags;
+        }
+        for (const auto& segment : packet->segments) {
+          iov.push_back({const_cast<void*>(segment.data()), segment.size()});
+        }
+        segments++;
+        if (packet->size() < segment_size) break;
+      }
+
+      alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(uint16_t)) + CMSG_SPACE(sizeof(uint64_t))] = {};
+      struct msghdr msg = {};
+      msg.msg_name = const_cast<struct sockaddr*>(send_endpoint.data());
+      msg.msg_namelen = send_endpoint.size();
+      msg.msg_iov = iov.data();
+      msg.msg_iovlen = iov.size();
+      msg.msg_control = control;
+      msg.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+      struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      *reinterpret_cast<uint16_t*>(CMSG_DATA(cmsg)) = segment_size;
+#if HAVE_SO_TXTIME
+      if (_txtime_pacing) {
+        msg.msg_controllen += CMSG_SPACE(sizeof(uint64_t));
+        set_txtime(CMSG_NXTHDR(&msg, cmsg), lane.batch[lane.batch_sent]->departure);
+      }
+#endif
+
+      auto sent = sendmsg(lane.socket.native_handle(), &msg, flags);
+      _send_calls++;
+      if (sent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          return false;
+        }
+        if (errno == ENOBUFS && _zerocopy_head) {
+          // Out of kernel memory for the zero copy notifications, carry on when they arrive
+          _zerocopy_blocked = true;
+          return false;
+        }
+        if (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP || errno == EMSGSIZE) {
+          // EMSGSIZE: the segments are larger than the device MTU, individual packets are fragmented instead
+          spdlog::warn("UDP segmentation offload is not available ({}), sending packets individually", strerror(errno));
+          _udp_gso = false;
+          continue;
+        }
+        spdlog::debug("sendmsg error: {}", strerror(errno));
+        while (lane.batch_sent < lane.batch.size()) {
+          packet_failed(lane, lane.batch[lane.batch_sent++]);
+        }
+        break;
+      }
+      // A segmented send is a single zero copy send
+      auto zerocopy_id = _zerocopy_next_id;
+      if (_zerocopy) _zerocopy_next_id++;
+      for (size_t i = 0; i < segments; i++) {
+        packet_accepted(lane, lane.batch[lane.batch_sent++], zerocopy_id);
+      }
+      continue;
+    }
+#endif
+#if HAVE_SENDMMSG
+    // Up to the next dropped packet
+    size_t count = 0;
+    size_t segments = 0;
+    while (lane.batch_sent + count < lane.batch.size() &&
+        (count == 0 || !lane.batch[lane.batch_sent + count]->dropped)) {
+      segments += lane.batch[lane.batch_sent + count]->segments.size();
+      count++;
+    }
+    auto &iov = lane.send_buffers->iov;
+    auto &msgs = lane.send_buffers->msgs;
+    iov.resize(segments);
+    msgs.resize(count);
+#if HAVE_SO_TXTIME
+    auto &control = lane.send_buffers->control;
+    if (_txtime_pacing) {
+      control.resize(count * CMSG_SPACE(sizeof(uint64_t)));
+    }
+#endif
+    for (size_t i = 0, segment = 0; i < count; i++) {
+      auto packet = lane.batch[lane.batch_sent + i];
+      const auto& send_endpoint = packet->destination;
+      memset(&msgs[i], 0, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_name = const_cast<struct sockaddr*>(send_endpoint.data());
+      msgs[i].msg_hdr.msg_namelen = send_endpoint.size();
+      msgs[i].msg_hdr.msg_iov = &iov[segment];
+      msgs[i].msg_hdr.msg_iovlen = packet->segments.size();
+      for (const auto& data : packet->segments) {
+        iov[segment++] = {const_cast<void*>(data.data()), data.size()};
+      }
+#if HAVE_SO_TXTIME
+      if (_txtime_pacing) {
+        msgs[i].msg_hdr.msg_control = control.data() + i * CMSG_SPACE(sizeof(uint64_t));
+        msgs[i].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint64_t));
+        set_txtime(CMSG_FIRSTHDR(&msgs[i].msg_hdr), packet->departure);
+      }
+#endif
+    }
+
+    int sent = sendmmsg(lane.socket.native_handle(), msgs.data(), count, flags);
+    _send_calls++;
+    if (sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return false;
+      }
+      if (errno == ENOBUFS && _zerocopy_head) {
+        // Out of kernel memory for the zero copy notifications, carry on when they arrive
+        _zerocopy_blocked = true;
+        return false;
+      }
+      spdlog::debug("sendmmsg error: {}", strerror(errno));
+      while (lane.batch_sent < lane.batch.size()) {
+        packet_failed(lane, lane.batch[lane.batch_sent++]);
+      }
+      break;
+    }
+    for (int i = 0; i < sent; i++) {
+      // Each message of a sendmmsg() call is a zero copy send of its own
+      packet_accepted(lane, lane.batch[lane.batch_sent++], _zerocopy ? _zerocopy_next_id++ : 0);
+    }
+#else
+    auto packet = lane.batch[lane.batch_sent];
+    boost::system::error_code error;
+    lane.socket.send_to(PacketSegments(packet->segments), packet->destination, flags & ~MSG_DONTWAIT, error);
+    _send_calls++;
+    if (error) {
+      spdlog::debug("sent_to error: {}", error.message());
+      packet_failed(lane, lane.batch[lane.batch_sent++]);
+    } else {
+      packet_accepted(lane, lane.batch[lane.batch_sent++], _zerocopy ? _zerocopy_next_id++ : 0);
+    }
+#endif
+  }
+  return true;
+}
+
+auto SessionMultiplexer::send_single_packet() -> uint32_t
+{
+  PacketBuffer *packet;
+  {
+    std::lock_guard<std::mutex> guard(_sessions_mutex);
+    packet = next_packet();
+  }
+  if (!packet) return 0;
+
+  for(const auto& symbol : packet->symbols) {
+    spdlog::debug("sending TOI {} SBN {} ID {}", packet->file->meta().toi, symbol.source_block_number(), symbol.id() );
+  }
+
+  _send_calls++;
+  auto on_sent = [packet, this](
+          const boost::system::error_code& error,
+          std::size_t /*bytes_transferred*/)
+      {
+        if (error) {
+          spdlog::debug("sent_to error: {}", error.message());
+        }
+        packet_sent(packet, !error);
+      };
+  PacketHandlerAllocator<decltype(on_sent)> allocator(packet->handler_memory, sizeof(packet->handler_memory),
+      &packet->handler_memory_in_use);
+  _lane.socket.async_send_to(
+      PacketSegments(packet->segments), packet->destination,
+      PacketSendHandler<decltype(on_sent)>(allocator, std::move(on_sent)));
+  return packet->size();
+}
+
+auto SessionMultiplexer::send_next_packet() -> void
+{
+  _send_idle = false;
+  if (!_running || _worker_threads) return;
+
+  // Send until the pacer runs out of credit. A late wakeup is caught up with bursts of at most burst() bytes, the
+  // completions of each burst run in between and return its packet buffers to the pool.
+  bool sent = false;
+  size_t burst_bytes = 0;
+  do {
+    uint32_t bytes_queued = 0;
+    if (_send_batch_size > 1 || _zerocopy) {
+      _batch_blocked = false;
+      bool resuming = _lane.batch_sent < _lane.batch.size();
+      if (!resuming) {
+        {
+          std::lock_guard<std::mutex> guard(_sessions_mutex);
+          fill_batch(_lane);
+        }
+        bytes_queued = _lane.batch_bytes;
+        _pacer.consume(bytes_queued);
+      }
+      if (!flush_batch(_lane)) {
+        _batch_blocked = true;
+        if (_zerocopy_blocked) {
+          // Resumed by handle_zerocopy_completions()
+          return;
+        }
+        // Socket buffer is full, carry on with the rest of the batch once there is room
+        _lane.socket.async_wait(boost::asio::socket_base::wait_write,
+            [this](const boost::system::error_code& error) {
+              if (!error) send_next_packet();
+            });
+        return;
+      }
+      if (resuming) {
+        sent = true;
+        continue;
+      }
+    } else {
+      bytes_queued = send_single_packet();
+      _pacer.consume(bytes_queued);
+    }
+    if (!bytes_queued) {
+      _pacer.idle();
+      break;
+    }
+    sent = true;
+    burst_bytes += bytes_queued;
+  } while (_running && _rate_limit && _pacer.ready() && burst_bytes < _pacer.burst());
+
+  if (_running) {
+    if (!sent) {
+      // Stops the send loop if it only ran on for the control packets of sessions that have been deactivated
+      session_deactivated();
+      if (!_running) return;
+      // Files queued by the sessions end the poll early, see packets_queued()
+      _send_idle = true;
+      _send_timer.expires_after(std::chrono::milliseconds(10));
+      _send_timer.async_wait( boost::bind(&SessionMultiplexer::send_next_packet, this));
+    } else {
+      if (_rate_limit == 0) {
+        boost::asio::post(_io_context, boost::bind(&SessionMultiplexer::send_next_packet, this));
+      } else {
+        auto wait = _pacer.wait_time();
+        spdlog::trace("Rate limiter: limit {} kbps, next send in {} us", _rate_limit,
+            std::chrono::duration_cast<std::chrono::microseconds>(wait).count());
+        _send_timer.expires_after(wait);
+        _send_timer.async_wait( boost::bind(&SessionMultiplexer::send_next_packet, this));
+      }
+    }
+  }
+}
+
+auto SessionMultiplexer::run_worker(Worker &worker) -> void
+{
+  auto &lane = worker.lane;
+  for (;;) {
+    {
+      // Picking the packets of a batch is serialised with the other workers, building and sending them is not
+      std::unique_lock<std::mutex> lock(_sessions_mutex);
+      if (_stop_workers) return;
+      if (!_running) {
+        _workers_wakeup.wait(lock);
+        continue;
+      }
+      auto wait = _pacer.wait_time();
+      if (wait > Pacer::clock::duration::zero()) {
+        _workers_wakeup.wait_for(lock, wait);
+        continue;
+      }
+      fill_batch(lane);
+      if (lane.batch.empty()) {
+        _pacer.idle();
+        if (!sessions_sending()) {
+          _running = false;
+          continue;
+        }
+        _workers_wakeup.wait_for(lock, std::chrono::milliseconds(10));
+        continue;
+      }
+      _pacer.consume(lane.batch_bytes);
+      _building++;
+    }
+
+    // Headers and checksums are built in parallel with the other workers
+    for (auto packet : lane.batch) {
+      if (!packet->control) packet->session->build_packet(packet);
+    }
+    {
+      std::lock_guard<std::mutex> guard(_sessions_mutex);
+      _building--;
+    }
+    _building_done.notify_all();
+
+    while (!flush_batch(lane)) {
+      // Socket buffer is full
+      boost::system::error_code error;
+      lane.socket.wait(boost::asio::socket_base::wait_write, error);
+      if (error) {
+        while (lane.batch_sent < lane.batch.size()) {
+          packet_failed(lane, lane.batch[lane.batch_sent++]);
+        }
+      }
+    }
+
+    // The files and the completion callbacks of the sessions are only handled on the io_context thread
+    post([this, completions = std::move(lane.completions)]() {
+          for (const auto& completion : completions) {
+            packet_sent(completion.first, completion.second);
+          }
+        });
+    lane.completions.clear();
+  }
+}
+
+#if HAVE_SO_TXTIME
+static void set_txtime(struct cmsghdr *cmsg, Pacer::clock::time_point departure)
+{
+  uint64_t txtime = std::chrono::duration_cast<std::chrono::nanoseconds>(departure.time_since_epoch()).count();
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_TXTIME;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(txtime));
+  memcpy(CMSG_DATA(cmsg), &txtime, sizeof(txtime));
+}
+#endif
+
+#if HAVE_UDP_SEGMENT
+static size_t page_count(const std::vector<boost::asio::const_buffer> &segments)
+{
+  static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  size_t pages = 0;
+  for (const auto& segment : segments) {
+    if (!segment.size()) continue;
+    auto start = reinterpret_cast<uintptr_t>(segment.data());
+    pages += (start + segment.size() - 1) / page_size - start / page_size + 1;
+  }
+  return pages;
+}
+#endif
+
+} // End namespace LibFlute
@@ -30,6 +30,7 @@
 
 #include <zlib.h>
 
+#include <algorithm>
 #include <ctime>
 #include <cstdio>
 #include <chrono>
@@ -37,10 +38,12 @@
 #include <exception>
 #include <iostream>
 #include <list>
+#include <memory>
 #include <string>
 #include <system_error>
 
 #include "spdlog/spdlog.h"
+#include "ContentEncoder.h"
 #include "File.h"
 #include "IpSec.h"
 
@@ -48,16 +51,28 @@
 
 namespace LibFlute {
 
-static void create_udp_pkt( char *udp_buffer, const boost::asio::ip::udp::endpoint &endpoint, const char *data, size_t data_len,
-                            const boost::asio::ip::address &local_address );
+static void create_udp_hdr( char *udp_buffer, const boost::asio::ip::udp::endpoint &endpoint, size_t data_len,
+                            uint32_t data_sum, const boost::asio::ip::address &local_address );
 static void create_ip_hdr( char *ip_buffer, const boost::asio::ip::udp::endpoint &endpoint, size_t pkt_size,
                            const boost::asio::ip::address &local_address );
-static uint16_t calculate_sum( uint16_t *buffer, size_t len );
-
+static uint32_t partial_sum( const char *buffer, size_t len );
+static uint32_t combine_sum( uint32_t sum, uint32_t partial, size_t offset );
+static uint16_t calculate_sum( const char *buffer, size_t len );
+#if HAVE_MMAP
+static const char *map_file( int file_handle, size_t length );
+#endif
 /*****************************************************************************
  * Transmitter::FileDescription class
  *****************************************************************************/
 
+struct Transmitter::FileDescription::GrowingContent {
+  std::unique_ptr<char[]> buffer;
+  size_t max_length;
+  std::atomic<size_t> length{0};        //< Length of the content in buffer, stored after the content is written
+  std::atomic<bool> finalized{false};   //< Stored after the final file entry values have been set
+  MD5_CTX md5;                          //< MD5 of the content appended so far
+};
+
 Transmitter::FileDescription::FileDescription ( const std::string &content_location, const std::string &filename )
     : _tsi()
     , _file_entry({ .toi=0, .content_location=content_location})
@@ -107,6 +122,20 @@ Transmitter::FileDescription::FileDescription(const std::string &content_locatio
   _calculate_file_entry();
 }
 
+Transmitter::FileDescription::FileDescription(const std::string &content_location,
+                                              const std::shared_ptr<ContentSource> &source, size_t length)
+    : _tsi()
+    , _file_entry({ .toi=0, .content_location=content_location})
+    , _compression_type(Transmitter::FileDescription::COMPRESSION_NONE)
+    , _filename()
+    , _file_handle(-1)
+    , _data(nullptr)
+    , _data_length(source?length:0)
+    , _source(source)
+{
+  _calculate_file_entry();
+}
+
 Transmitter::FileDescription::FileDescription(const std::string &content_location)
     : _tsi()
     , _file_entry({ .toi=0, .content_location=content_location})
@@ -127,6 +156,11 @@ Transmitter::FileDescription::FileDescription(const Transmitter::FileDescription
     , _file_handle(-1)
     , _data(other._data)
     , _data_length(other._data_length)
+    , _priority(other._priority)
+    , _weight(other._weight)
+    , _carousel_interval(other._carousel_interval)
+    , _growing(other._growing)
+    , _source(other._source)
 {
   if (!_filename.empty()) {
     if (other._file_handle >= 0) {
@@ -134,7 +168,7 @@ Transmitter::FileDescription::FileDescription(const Transmitter::FileDescription
     }
 #if HAVE_MMAP
     // Map the file contents into memory
-    _data = reinterpret_cast<char*>(mmap(nullptr, _data_length, PROT_READ, MAP_SHARED, _file_handle, 0));
+    _data = map_file(_file_handle, _data_length);
 #else
     // copy the file contents into a new memory block
     char *data = new char[_data_length];
@@ -152,6 +186,11 @@ Transmitter::FileDescription::FileDescription(Transmitter::FileDescription &&oth
     , _file_handle(other._file_handle)
     , _data(other._data)
     , _data_length(other._data_length)
+    , _priority(other._priority)
+    , _weight(other._weight)
+    , _carousel_interval(other._carousel_interval)
+    , _growing(std::move(other._growing))
+    , _source(std::move(other._source))
 {
   other._data = nullptr;
   other._data_length = 0;
@@ -172,6 +211,11 @@ Transmitter::FileDescription &Transmitter::FileDescription::operator=(const Tran
   _file_handle = -1;
   _data = other._data;
   _data_length = other._data_length;
+  _priority = other._priority;
+  _weight = other._weight;
+  _carousel_interval = other._carousel_interval;
+  _growing = other._growing;
+  _source = other._source;
 
   if (!_filename.empty()) {
     if (other._file_handle >= 0) {
@@ -179,7 +223,7 @@ Transmitter::FileDescription &Transmitter::FileDescription::operator=(const Tran
     }
 #if HAVE_MMAP
     // Map the file contents into memory
-    _data = reinterpret_cast<char*>(mmap(nullptr, _data_length, PROT_READ, MAP_SHARED, _file_handle, 0));
+    _data = map_file(_file_handle, _data_length);
 #else
     // copy the file contents into a new memory block
     char *data = new char[_data_length];
@@ -204,6 +248,11 @@ Transmitter::FileDescription &Transmitter::FileDescription::operator=(Transmitte
   other._data = nullptr;
   _data_length = other._data_length;
   other._data_length = 0;
+  _priority = other._priority;
+  _weight = other._weight;
+  _carousel_interval = other._carousel_interval;
+  _growing = std::move(other._growing);
+  _source = std::move(other._source);
 
   return *this;
 }
@@ -218,6 +267,8 @@ bool Transmitter::FileDescription::operator==(const Transmitter::FileDescription
 
   //if (_filename != other._filename) return false;
 
+  if (_source != other._source) return false;
+
   if (_data_length != other._data_length) return false;
 
   if (_data == other._data) return true;
@@ -231,9 +282,19 @@ const char *Transmitter::FileDescription::data()
 
 size_t Transmitter::FileDescription::data_length()
 {
+  if (_growing) return _growing->length.load(std::memory_order_acquire);
   return _data_length;
 }
 
+bool Transmitter::FileDescription::is_mapped() const
+{
+#if HAVE_MMAP
+  return !_filename.empty() && _data != nullptr && _data != MAP_FAILED;
+#else
+  return false;
+#endif
+}
+
 Transmitter::FileDescription &Transmitter::FileDescription::set_compression(
 								Transmitter::FileDescription::CompressionAlgorithm compression)
 {
@@ -250,9 +311,10 @@ Transmitter::FileDescription &Transmitter::FileDescription::set_compression(
       _file_entry.content_encoding.clear();
       break;
     }
-    /* change in compression will change transmitted data, reset the TOI */
+    /* change in compression will change transmitted data, reset the TOI. The MD5 is of the uncompressed content
+     * and stays valid */
     _file_entry.toi = 0;
-    _calculate_file_entry();
+    _file_entry.fec_oti.transfer_length = _data_length;
   }
 
   return *this;
@@ -325,6 +387,85 @@ Transmitter::FileDescription &Transmitter::FileDescription::set_content(const st
   return set_content(reinterpret_cast<const char*>(data.data()), data.size());
 }
 
+Transmitter::FileDescription &Transmitter::FileDescription::set_content(const std::shared_ptr<ContentSource> &source,
+                                                                        size_t length)
+{
+  _free_file_data();
+  _source = source;
+  _data = nullptr;
+  _data_length = source?length:0;
+  /* new contents, reset the TOI */
+  _file_entry.toi = 0;
+  _calculate_file_entry();
+
+  return *this;
+}
+
+Transmitter::FileDescription &Transmitter::FileDescription::set_growing(size_t max_length)
+{
+  _free_file_data();
+  _growing = std::make_shared<GrowingContent>();
+  // Not initialised, so the pages are only used once content is written to them
+  _growing->buffer.reset(new char[max_length]);
+  _growing->max_length = max_length;
+  MD5_Init(&_growing->md5);
+  _data = _growing->buffer.get();
+  _data_length = 0;
+  /* new contents, reset the TOI */
+  _file_entry.toi = 0;
+  _calculate_file_entry();
+  _file_entry.growing = true;
+
+  return *this;
+}
+
+Transmitter::FileDescription &Transmitter::FileDescription::append(const char *data, size_t length)
+{
+  if (!is_growing()) {
+    throw "Content can only be appended to a growing object";
+  }
+  auto offset = _growing->length.load(std::memory_order_relaxed);
+  if (length > _growing->max_length - offset) {
+    throw "Content exceeds the maximum length of the growing object";
+  }
+  memcpy(_growing->buffer.get() + offset, data, length);
+  MD5_Update(&_growing->md5, data, length);
+  // The Transmitter only sends the new content once the length has been stored
+  _growing->length.store(offset + length, std::memory_order_release);
+
+  return *this;
+}
+
+Transmitter::FileDescription &Transmitter::FileDescription::finalize()
+{
+  if (!is_growing()) {
+    throw "Only a growing object can be finalized";
+  }
+  _data_length = _growing->length.load(std::memory_order_relaxed);
+  if (_data_length == 0) {
+    throw "A growing object needs content before it can be finalized";
+  }
+  _file_entry.content_length = _data_length;
+  _file_entry.fec_oti.transfer_length = _data_length;
+  unsigned char md5[MD5_DIGEST_LENGTH];
+  MD5_Final(md5, &_growing->md5);
+  _file_entry.content_md5 = base64_encode(md5, sizeof(md5));
+  _file_entry.growing = false;
+  _growing->finalized.store(true, std::memory_order_release);
+
+  return *this;
+}
+
+bool Transmitter::FileDescription::is_growing() const
+{
+  return _growing && !_growing->finalized.load(std::memory_order_acquire);
+}
+
+size_t Transmitter::FileDescription::max_length() const
+{
+  return _growing ? _growing->max_length : _data_length;
+}
+
 Transmitter::FileDescription &Transmitter::FileDescription::set_content_type(const std::string &content_type)
 {
   _file_entry.content_type = content_type;
@@ -410,7 +551,7 @@ void Transmitter::FileDescription::_attach_file(const std::string &filename)
 
 #if HAVE_MMAP
   // Map the file contents into memory
-  _data = reinterpret_cast<char*>(mmap(nullptr, _data_length, PROT_READ, MAP_SHARED, _file_handle, 0));
+  _data = map_file(_file_handle, _data_length);
 #else
   // Load the file contents into memory
   char *data = new char[_data_length];
@@ -432,12 +573,15 @@ void Transmitter::FileDescription::_free_file_data()
 #endif
     _filename.clear();
   }
+  _growing.reset();
+  _source.reset();
 }
 
 void Transmitter::FileDescription::_calculate_file_entry()
 {
   // Content length
   _file_entry.content_length = _data_length;
+  _file_entry.growing = false;
 
   // Initial transfer length assumes no encoding, this may be changed on transmission
   _file_entry.fec_oti.transfer_length = _data_length;
@@ -462,18 +606,42 @@ Transmitter::Transmitter ( const std::string& destination_address, short port,
                            const std::optional<boost::asio::ip::udp::endpoint> &tunnel_endpoint,
                            Transmitter::FdtNamespace fdt_namespace, bool active,
                            const std::optional<std::string> &source_address )
-    : _endpoint(boost::asio::ip::make_address(destination_address), port)
+    : Transmitter(std::make_unique<SessionMultiplexer>(io_context, rate_limit,
+                      boost::asio::ip::udp::endpoint(boost::asio::ip::make_address(destination_address), port).protocol()),
+                  nullptr, destination_address, port, tsi, mtu, tunnel_endpoint, fdt_namespace, active, source_address)
+{
+}
+
+Transmitter::Transmitter ( SessionMultiplexer& multiplexer, const std::string& destination_address, short port,
+                           uint64_t tsi, unsigned short mtu,
+                           const std::optional<boost::asio::ip::udp::endpoint> &tunnel_endpoint,
+                           Transmitter::FdtNamespace fdt_namespace, bool active,
+                           const std::optional<std::string> &source_address )
+    : Transmitter(nullptr, &multiplexer, destination_address, port, tsi, mtu, tunnel_endpoint, fdt_namespace, active,
+                  source_address)
+{
+}
+
+Transmitter::Transmitter ( std::unique_ptr<SessionMultiplexer> own_multiplexer, SessionMultiplexer *multiplexer,
+                           const std::string& destination_address, short port,
+                           uint64_t tsi, unsigned short mtu,
+                           const std::optional<boost::asio::ip::udp::endpoint> &tunnel_endpoint,
+                           Transmitter::FdtNamespace fdt_namespace, bool active,
+                           const std::optional<std::string> &source_address )
+    : _own_multiplexer(std::move(own_multiplexer))
+    , _multiplexer(multiplexer ? multiplexer : _own_multiplexer.get())
+    , _endpoint(boost::asio::ip::make_address(destination_address), port)
     , _source_address()
-    , _socket(io_context, _endpoint.protocol())
-    , _io_context(io_context)
-    , _send_timer(io_context)
-    , _fdt_timer(io_context)
+    , _io_context(_multiplexer->_io_context)
+    , _fdt_timer(_io_context)
+    , _fdt_update_timer(_io_context)
     , _tsi(tsi)
     , _mtu(mtu)
+    , _read_ahead_statistics(std::make_shared<ReadAheadStatistics>())
     , _files()
     , _files_mutex()
+    , _scheduler(std::make_unique<DeficitRoundRobinScheduler>())
     , _mcast_address(destination_address)
-    , _rate_limit(rate_limit)
     , _tunnel_endpoint(tunnel_endpoint)
     , _tunnel_local_address()
     , _active(active)
@@ -496,26 +664,50 @@ Transmitter::Transmitter ( const std::string& destination_address, short port,
   }
   uint32_t max_source_block_length = 64;
 
-  _socket.set_option(boost::asio::ip::multicast::enable_loopback(true));
-  _socket.set_option(boost::asio::ip::udp::socket::reuse_address(true));
-
   if (_source_address && !_tunnel_endpoint) {
-    _socket.bind(boost::asio::ip::udp::endpoint(_source_address.value(),0));
+    _multiplexer->bind(_source_address.value());
   }
 
   _fec_oti = FecOti{
     .encoding_id = FecScheme::CompactNoCode,
     .encoding_symbol_length = _max_payload,
     .max_source_block_length = max_source_block_length};
-  _fdt = std::make_unique<FileDeliveryTable>(1, _fec_oti, fdt_namespace);
+  _fdt_namespace = fdt_namespace;
 
+  _session_id = _multiplexer->add_session(this, _session_weight);
   if (_active) {
     start_fdt_repeat_timer();
-    send_next_packet();
+    _multiplexer->session_activated();
   }
 }
 
-Transmitter::~Transmitter() = default;
+Transmitter::~Transmitter()
+{
+  {
+    // Files still being compressed are dropped, the encoder threads and the posted handlers must be done with this
+    // Transmitter though
+    std::unique_lock<std::mutex> lock(_pending_encodes->mutex);
+    _pending_encodes->closed = true;
+    _pending_encodes->done.wait(lock, [this]() { return _pending_encodes->running == 0; });
+  }
+  _multiplexer->remove_session(_session_id);
+}
+
+auto Transmitter::post(std::function<void()> handler) -> void
+{
+  // Posted from any thread, the handler is dropped if the Transmitter is destroyed before it gets to run
+  boost::asio::post(_io_context, [pending = _pending_encodes, handler = std::move(handler)]() {
+        {
+          std::lock_guard<std::mutex> guard(pending->mutex);
+          if (pending->closed) return;
+          pending->running++;
+        }
+        handler();
+        std::lock_guard<std::mutex> guard(pending->mutex);
+        pending->running--;
+        pending->done.notify_all();
+      });
+}
 
 auto Transmitter::udp_tunnel_address(const boost::asio::ip::udp::endpoint &new_tunnel_endpoint) -> Transmitter&
 {
@@ -534,6 +726,8 @@ auto Transmitter::udp_tunnel_address(const std::optional<boost::asio::ip::udp::e
 
 auto Transmitter::udp_tunnel_address(std::optional<boost::asio::ip::udp::endpoint> &&new_tunnel_endpoint) -> Transmitter&
 {
+  // The packets are taken under the lock, they carry the addresses they were built with
+  std::lock_guard<std::mutex> guard(_files_mutex);
   if (!!_tunnel_endpoint == !!new_tunnel_endpoint) {
     /* change existing tunnel */
     if (_tunnel_endpoint) _tunnel_endpoint = new_tunnel_endpoint;
@@ -569,30 +763,33 @@ auto Transmitter::endpoint(const std::string &address, uint32_t port) -> Transmi
 
 auto Transmitter::endpoint(const boost::asio::ip::udp::endpoint &destination) -> Transmitter&
 {
+  std::lock_guard<std::mutex> guard(_files_mutex);
   _endpoint = destination;
   return *this;
 }
 
 auto Transmitter::endpoint(boost::asio::ip::udp::endpoint &&destination) -> Transmitter&
 {
+  std::lock_guard<std::mutex> guard(_files_mutex);
   _endpoint = std::move(destination);
   return *this;
 }
 
 auto Transmitter::source_address(const std::optional<boost::asio::ip::address> &source_address) -> Transmitter&
 {
-  _source_address = source_address;
-  if (_source_address && !_tunnel_endpoint) {
-    _socket.bind(boost::asio::ip::udp::endpoint(_source_address.value(),0));
-  }
-  return *this;
+  return this->source_address(std::optional<boost::asio::ip::address>(source_address));
 }
 
 auto Transmitter::source_address(std::optional<boost::asio::ip::address> &&source_address) -> Transmitter&
 {
-  _source_address = std::move(source_address);
-  if (_source_address && !_tunnel_endpoint) {
-    _socket.bind(boost::asio::ip::udp::endpoint(_source_address.value(),0));
+  std::optional<boost::asio::ip::address> bind_address;
+  {
+    std::lock_guard<std::mutex> guard(_files_mutex);
+    _source_address = std::move(source_address);
+    if (!_tunnel_endpoint) bind_address = _source_address;
+  }
+  if (bind_address) {
+    _multiplexer->bind(bind_address.value());
   }
   return *this;
 }
@@ -616,28 +813,142 @@ auto Transmitter::seconds_since_epoch() -> uint64_t
                         and the NTP epoch (1 January 1900, 00:00:00 UTC) */
 }
 
-auto Transmitter::send_fdt() -> void {
-  if (_fdt->file_entries().empty()) return;
-  _fdt->set_expires(seconds_since_epoch() + _fdt_repeat_interval * 2);
-  auto fdt = _fdt->to_string();
-  auto file = std::make_shared<File>(
-        0,
-        _fec_oti,
-        "",
-        "",
-        seconds_since_epoch() + _fdt_repeat_interval * 2,
-        (char*)fdt.c_str(),
-        fdt.length(),
-        true);
-  if (file) {
-    file->set_fdt_instance_id( _fdt->instance_id() );
-    spdlog::debug("Sending FDT instance {}:\n{}", _fdt->instance_id(), _fdt->to_string());
-    {
-      std::lock_guard<std::mutex> guard(_files_mutex);
-      _files.insert_or_assign(0, file);
+auto Transmitter::send_fdt(bool changed_only) -> void {
+  std::lock_guard<std::mutex> guard(_files_mutex);
+  _fdt_update_pending = false;
+  // Changed partitions go first, they announce the files waiting for them
+  std::deque<FdtPartition*> queue;
+  for (auto &partition : _fdt_partitions) {
+    if (partition.changed) queue.push_back(&partition);
+  }
+  if (changed_only) {
+    if (queue.empty()) {
+      queue_unannounced();
+      return;
+    }
+    // The rest of the current round follows
+    for (auto partition : _fdt_queue) {
+      if (!partition->changed) queue.push_back(partition);
+    }
+  } else {
+    for (auto &partition : _fdt_partitions) {
+      if (!partition.changed) queue.push_back(&partition);
     }
-    _fdt->sent();
   }
+  _fdt_queue = std::move(queue);
+  send_next_fdt_instance();
+}
+
+auto Transmitter::send_next_fdt_instance() -> void
+{
+  // Called with _files_mutex locked, replaces the FDT instance being sent
+  while (!_fdt_queue.empty()) {
+    auto partition = _fdt_queue.front();
+    _fdt_queue.pop_front();
+    auto &fdt = partition->fdt;
+    if (fdt->file_entries().empty()) continue;
+
+    if (partition->changed) {
+      partition->instance_id = _next_fdt_instance_id;
+      _next_fdt_instance_id = (_next_fdt_instance_id + 1) & 0xFFFFF;  // 20 bit field in EXT_FDT
+      partition->changed = false;
+    }
+    fdt->set_expires(seconds_since_epoch() + _fdt_repeat_interval * 2);
+    auto xml = fdt->to_string();
+    auto file = std::make_shared<File>(
+          0,
+          _fec_oti,
+          "",
+          "",
+          seconds_since_epoch() + _fdt_repeat_interval * 2,
+          (char*)xml.c_str(),
+          xml.length(),
+          true);
+    file->set_fdt_instance_id(partition->instance_id);
+    spdlog::debug("Sending FDT instance {}:\n{}", partition->instance_id, xml);
+    _files.insert_or_assign(0, file);
+    _scheduler->add(0, Scheduler::fdt_priority, 1);
+    _multiplexer->packets_queued();
+    break;
+  }
+
+  if (std::none_of(_fdt_queue.begin(), _fdt_queue.end(), [](auto partition) { return partition->changed; })) {
+    queue_unannounced();
+  }
+}
+
+auto Transmitter::queue_unannounced() -> void
+{
+  // Called with _files_mutex locked once the FDT instances announcing the files have been queued. The scheduler sends
+  // the FDT ahead of them.
+  for (auto &unannounced : _unannounced) {
+    auto toi = unannounced.file->meta().toi;
+    const auto &file_description = unannounced.file_description;
+    _files.insert({toi, unannounced.file});
+    if (file_description) {
+      _scheduler->add(toi, file_description->get_priority(), file_description->get_weight());
+      if (file_description->get_carousel_interval()) {
+        _carousel.insert_or_assign(toi,
+            CarouselObject{file_description->get_carousel_interval().value(), std::chrono::steady_clock::now()});
+      } else {
+        _carousel.erase(toi);
+      }
+    } else {
+      _scheduler->add(toi, 0, 1);
+    }
+  }
+  if (!_unannounced.empty()) {
+    _multiplexer->packets_queued();
+  }
+  _unannounced.clear();
+}
+
+auto Transmitter::fdt_add(const FileDeliveryTable::FileEntry &entry) -> void
+{
+  // Called with _files_mutex locked. A partition that has reached the size limit is closed, new entries go to the
+  // next one.
+  if (_fdt_partitions.empty() ||
+      (_fdt_partition_size && !_fdt_partitions.back().fdt->file_entries().empty() &&
+       _fdt_partitions.back().fdt->size() >= _fdt_partition_size)) {
+    _fdt_partitions.push_back(FdtPartition{std::make_unique<FileDeliveryTable>(1, _fec_oti, _fdt_namespace)});
+  }
+  auto &partition = _fdt_partitions.back();
+  partition.fdt->add(entry);
+  partition.changed = true;
+  _fdt_partition_of[entry.toi] = &partition;
+}
+
+auto Transmitter::fdt_remove(uint32_t toi) -> void
+{
+  // Called with _files_mutex locked
+  auto it = _fdt_partition_of.find(toi);
+  if (it == _fdt_partition_of.end()) return;
+  auto partition = it->second;
+  _fdt_partition_of.erase(it);
+  partition->fdt->remove(toi);
+  partition->changed = true;
+  if (partition->fdt->file_entries().empty() && partition != &_fdt_partitions.back()) {
+    _fdt_queue.erase(std::remove(_fdt_queue.begin(), _fdt_queue.end(), partition), _fdt_queue.end());
+    _fdt_partitions.remove_if([partition](const FdtPartition &other) { return &other == partition; });
+  }
+}
+
+auto Transmitter::schedule_fdt_update() -> void
+{
+  // Called with _files_mutex locked, also from the worker threads of the multiplexer. The timer is only armed on the
+  // io_context thread.
+  if (_fdt_update_pending) return;
+  _fdt_update_pending = true;
+  post([this]() {
+        _fdt_update_timer.expires_after(_fdt_update_window);
+        _fdt_update_timer.async_wait(boost::bind(&Transmitter::fdt_update_tick, this, boost::placeholders::_1));
+      });
+}
+
+auto Transmitter::fdt_update_tick(const boost::system::error_code& error) -> void
+{
+  if (error == boost::asio::error::operation_aborted) return;
+  send_fdt(true);
 }
 
 auto Transmitter::send(
@@ -660,43 +971,209 @@ auto Transmitter::send(
         data,
         length);
 
-  _fdt->add(file->meta());
-  send_fdt();
-  {
-    std::lock_guard<std::mutex> guard(_files_mutex);
-    _files.insert({toi, file});
-  }
+  std::lock_guard<std::mutex> guard(_files_mutex);
+  fdt_add(file->meta());
+  _unannounced.push_back({file, nullptr});
+  schedule_fdt_update();
   return toi;
 }
 
 auto Transmitter::send(const std::shared_ptr<Transmitter::FileDescription> &file_description) -> uint16_t
 {
-  if (file_description->has_tsi() && file_description->tsi() != _tsi) {
-    // Reset TOI if the file_description is being used on a new TSI
-    file_description->toi(0);
-    spdlog::debug("Reset TOI for FileDescription");
+  return send(std::vector<std::shared_ptr<FileDescription>>{file_description}).front();
+}
+
+auto Transmitter::send(const std::vector<std::shared_ptr<Transmitter::FileDescription>> &file_descriptions)
+    -> std::vector<uint16_t>
+{
+  // The whole batch is checked before any of it is changed, a batch that is refused is left as it was
+  for (const auto &file_description : file_descriptions) {
+    const auto &file_entry = file_description->file_entry();
+    if (file_description->is_growing() && !file_entry.content_encoding.empty()) {
+      throw "Growing objects cannot be content encoded";
+    }
+    if (file_description->source() && !file_entry.content_encoding.empty()) {
+      throw "Files sent from a content source cannot be content encoded";
+    }
   }
+  if (file_descriptions.empty()) return {};
+
+  struct Assigned {
+    std::optional<uint64_t> tsi;
+    uint32_t toi;
+    FecOti fec_oti;
+  };
+  std::vector<Assigned> previous;
+  previous.reserve(file_descriptions.size());
+  auto next_toi = _toi;
+
+  std::vector<uint16_t> tois;
+  bool compressed = false;
+  for (const auto &file_description : file_descriptions) {
+    previous.push_back({file_description->_tsi, file_description->toi(), file_description->file_entry().fec_oti});
+    if (file_description->has_tsi() && file_description->tsi() != _tsi) {
+      // Reset TOI if the file_description is being used on a new TSI
+      file_description->toi(0);
+      spdlog::debug("Reset TOI for FileDescription");
+    }
+
+    // Set the TSI and TOI for the FileDescription
+    file_description->tsi(_tsi);
+    if (file_description->toi() == 0) {
+      file_description->toi(_toi);
+      _toi++;
+      if (_toi == 0) _toi = 1; // clamp to >= 1 in case it wraps
+      spdlog::debug("Assigned new TOI {}", file_description->toi());
+    }
+
+    // Copy in default FEC parameters if not already set
+    file_description->merge_fec_oti(_fec_oti);
 
-  // Set the TSI and TOI for the FileDescription
-  file_description->tsi(_tsi);
-  if (file_description->toi() == 0) {
-    file_description->toi(_toi);
-    _toi++;
-    if (_toi == 0) _toi = 1; // clamp to >= 1 in case it wraps
-    spdlog::debug("Assigned new TOI {}", file_description->toi());
+    tois.push_back(file_description->toi());
+    if (!file_description->file_entry().content_encoding.empty()) compressed = true;
   }
 
-  // Copy in default FEC parameters if not already set
-  file_description->merge_fec_oti(_fec_oti);
+  if (!compressed) {
+    // Nothing is queued if any of the files cannot be created
+    std::vector<std::shared_ptr<File>> files;
+    try {
+      for (const auto &file_description : file_descriptions) {
+        files.push_back(std::make_shared<File>(file_description, _source_read_ahead, _read_ahead_statistics));
+      }
+    } catch (...) {
+      for (size_t i = 0; i < file_descriptions.size(); i++) {
+        file_descriptions[i]->_tsi = previous[i].tsi;
+        file_descriptions[i]->_file_entry.toi = previous[i].toi;
+        file_descriptions[i]->_file_entry.fec_oti = previous[i].fec_oti;
+      }
+      _toi = next_toi;
+      throw;
+    }
+    queue_files(files, file_descriptions);
+    return tois;
+  }
+
+  // Compressing a large file takes a while, the files are created on the encoder threads and the batch is queued from
+  // the io_context thread once the last of them is ready
+  {
+    std::lock_guard<std::mutex> guard(_files_mutex);
+    _encoding.insert(tois.begin(), tois.end());
+  }
+  auto pending = _pending_encodes;
+  {
+    std::lock_guard<std::mutex> guard(pending->mutex);
+    pending->running += file_descriptions.size();
+  }
+  struct Batch {
+    std::vector<std::shared_ptr<File>> files;
+    std::atomic<size_t> remaining;
+  };
+  auto batch = std::make_shared<Batch>();
+  batch->files.resize(file_descriptions.size());
+  batch->remaining = file_descriptions.size();
+  for (size_t i = 0; i < file_descriptions.size(); i++) {
+    boost::asio::post(ContentEncoder::thread_pool(), [this, pending, batch, file_descriptions, i]() {
+          try {
+            batch->files[i] = std::make_shared<File>(file_descriptions[i]);
+          } catch (const char *error) {
+            spdlog::error("Failed to encode TOI {}: {}", file_descriptions[i]->toi(), error);
+          }
+          bool last = --batch->remaining == 0;
+          std::lock_guard<std::mutex> guard(pending->mutex);
+          if (last && !pending->closed) {
+            post([this, batch, file_descriptions]() {
+                  std::vector<std::shared_ptr<File>> files;
+                  std::vector<std::shared_ptr<FileDescription>> queued;
+                  bool failed = false;
+                  {
+                    std::lock_guard<std::mutex> guard(_files_mutex);
+                    for (size_t i = 0; i < file_descriptions.size(); i++) {
+                      // Files removed in the meantime are dropped
+                      if (_encoding.erase(file_descriptions[i]->toi()) == 0) continue;
+                      if (!batch->files[i]) failed = true;
+                      files.push_back(batch->files[i]);
+                      queued.push_back(file_descriptions[i]);
+                    }
+                  }
+                  if (failed) {
+                    spdlog::error("Dropping a batch of {} files as not all of them could be encoded", files.size());
+                    return;
+                  }
+                  queue_files(files, queued);
+                });
+          }
+          pending->running--;
+          pending->done.notify_all();
+        });
+  }
+  return tois;
+}
+
+auto Transmitter::queue_files(const std::vector<std::shared_ptr<File>> &files,
+                              const std::vector<std::shared_ptr<FileDescription>> &file_descriptions) -> void
+{
+  // The files are queued by send_fdt() once the FDT instance announcing them goes out
+  std::lock_guard<std::mutex> guard(_files_mutex);
+  for (size_t i = 0; i < files.size(); i++) {
+    fdt_add(files[i]->meta());
+    _unannounced.push_back({files[i], file_descriptions[i]});
+  }
+  if (!files.empty()) schedule_fdt_update();
+}
+
+auto Transmitter::remove(uint32_t toi) -> bool
+{
+  if (toi == 0) return false;
+  {
+    std::lock_guard<std::mutex> guard(_files_mutex);
+    // A file that is still being compressed is not in the FDT yet, it is dropped once it is ready
+    if (_encoding.erase(toi)) return true;
+    _failed_sources.erase(toi);
+    auto unannounced = std::find_if(_unannounced.begin(), _unannounced.end(),
+        [toi](const UnannouncedFile &unannounced) { return unannounced.file->meta().toi == toi; });
+    if (unannounced != _unannounced.end()) {
+      _unannounced.erase(unannounced);
+    } else {
+      if (_files.erase(toi) == 0) return false;
+      _scheduler->remove(toi);
+      _carousel.erase(toi);
+    }
+    fdt_remove(toi);
+    schedule_fdt_update();
+  }
+  spdlog::debug("Removed TOI {} from transmission", toi);
+  if (_active) {
+    // Tell receivers they can release any state held for this object
+    send_close_packet(toi, false);
+  }
+  return true;
+}
 
-  auto file = std::make_shared<File>(file_description);
+auto Transmitter::send_close_packet(uint32_t toi, bool close_session) -> void
+{
+  // Queued in the multiplexer ahead of the files, it is paced and sent like any other packet
+  AlcPacket alc(_tsi, toi, _fec_oti, !close_session, close_session);
+  auto packet = _multiplexer->allocate_packet();
+  packet->session = this;
+  packet->control = true;
+  packet->symbols.clear();
+  packet->alc_size = alc.size();
   {
     std::lock_guard<std::mutex> guard(_files_mutex);
-    _files.insert({file_description->toi(), file});
+    set_addresses(packet);
   }
-  _fdt->add(file->meta());
-  send_fdt();
-  return file_description->toi();
+  if (packet->buffer.size() < tunnel_headroom + alc.size()) {
+    packet->buffer.resize(tunnel_headroom + alc.size());
+  }
+  memcpy(packet->alc(), alc.data(), alc.size());
+  if (packet->encapsulated) {
+    create_udp_hdr(packet->buffer.data()+20, packet->inner_destination, packet->alc_size,
+        partial_sum(packet->alc(), packet->alc_size), packet->inner_source);
+    create_ip_hdr(packet->buffer.data(), packet->inner_destination, packet->size(), packet->inner_source);
+  }
+  packet->segments.clear();
+  packet->segments.emplace_back(packet->encapsulated ? packet->buffer.data() : packet->alc(), packet->size());
+  _multiplexer->send_control_packet(packet);
 }
 
 auto Transmitter::fdt_send_tick(const boost::system::error_code& error) -> void
@@ -708,117 +1185,258 @@ auto Transmitter::fdt_send_tick(const boost::system::error_code& error) -> void
   }
 }
 
-auto Transmitter::file_transmitted(uint32_t toi) -> void
+auto Transmitter::file_transmitted(const std::shared_ptr<File> &file) -> void
 {
+  auto toi = file->meta().toi;
   {
     std::lock_guard<std::mutex> guard(_files_mutex);
-    _files.erase(toi);
+    auto it = _files.find(toi);
+    if (it == _files.end() || it->second != file) {
+      // File was removed or replaced while its last packets were in flight
+      return;
+    }
+    auto carousel_it = _carousel.find(toi);
+    if (carousel_it != _carousel.end()) {
+      // Stays queued and in the FDT, the next round is started by start_carousel_round()
+      carousel_it->second.round_complete = true;
+    } else {
+      _files.erase(it);
+      _scheduler->remove(toi);
+      if (toi != 0) {
+        fdt_remove(toi);
+        schedule_fdt_update();
+      } else {
+        // The next partition of the FDT, if it is split up
+        send_next_fdt_instance();
+      }
+    }
   }
   if (toi != 0) {
-    _fdt->remove(toi);
-    send_fdt();
-
     if (_completion_cb) {
       _completion_cb(toi);
     }
   }
 }
 
-auto Transmitter::send_next_packet() -> void
+auto Transmitter::scheduler(std::unique_ptr<Scheduler> scheduler) -> Transmitter&
 {
-  uint32_t bytes_queued = 0;
+  std::lock_guard<std::mutex> guard(_files_mutex);
+  if (!_files.empty() || !_unannounced.empty()) {
+    throw "The scheduler cannot be changed while files are queued";
+  }
+  _scheduler = scheduler ? std::move(scheduler) : std::make_unique<DeficitRoundRobinScheduler>();
+  return *this;
+}
 
-  if (!_active) return;
-  std::shared_ptr<File> file;
-  {
-    std::lock_guard<std::mutex> guard(_files_mutex);
-    for (auto& file_m : _files) {
-      auto &next_file = file_m.second;
+auto Transmitter::session_weight(unsigned weight) -> Transmitter&
+{
+  _session_weight = weight ? weight : 1;
+  _multiplexer->session_weight(_session_id, _session_weight);
+  return *this;
+}
 
-      if (next_file && !next_file->complete()) {
-        file = next_file;
-        break;
-      }
+auto Transmitter::statistics() const -> Statistics
+{
+  auto stats = _multiplexer->statistics();
+  stats.packets_sent = _packets_sent;
+  stats.bytes_sent = _bytes_sent;
+  stats.prefetched_bytes = _read_ahead_statistics->prefetched_bytes;
+  stats.prefetch_misses = _read_ahead_statistics->prefetch_misses;
+  stats.page_fault_stalls = _read_ahead_statistics->page_fault_stalls;
+  return stats;
+}
+
+auto Transmitter::next_packet() -> PacketBuffer*
+{
+  if (!_active) return nullptr;
+  PacketBuffer *packet = nullptr;
+  std::lock_guard<std::mutex> guard(_files_mutex);
+  _scheduler->schedule([this, &packet](uint32_t toi) -> size_t {
+        packet = next_scheduled_packet(toi);
+        return packet ? packet->size() : 0;
+      });
+  return packet;
+}
+
+auto Transmitter::next_packet(const std::shared_ptr<File> &file) -> PacketBuffer*
+{
+  auto packet = _multiplexer->allocate_packet();
+  file->get_next_symbols(_max_payload, packet->symbols);
+  if (packet->symbols.empty()) {
+    _multiplexer->release_packet(packet);
+    return nullptr;
+  }
+  packet->session = this;
+  set_addresses(packet);
+  packet->file = file;
+  // The length of a growing object may change while the packet is built outside the lock
+  packet->fec_oti = file->meta().fec_oti;
+  packet->ext_fti = file->ext_fti();
+
+  // The size is known before the packet is built, only compact no-code FEC is supported so the headers are always
+  // of the maximum size
+  packet->alc_size = AlcPacket::max_size(file->meta().toi, 0, packet->ext_fti);
+  for (const auto& symbol : packet->symbols) {
+    packet->alc_size += symbol.len();
+  }
+  return packet;
+}
+
+auto Transmitter::set_addresses(PacketBuffer *packet) const -> void
+{
+  // Called with _files_mutex locked, the addresses can be changed while the packet is built and sent
+  packet->destination = send_endpoint();
+  packet->encapsulated = _tunnel_endpoint.has_value();
+  if (packet->encapsulated) {
+    packet->inner_destination = _endpoint;
+    packet->inner_source = _source_address ? _source_address.value() : _tunnel_local_address;
+  }
+}
+
+auto Transmitter::build_packet(PacketBuffer *packet) const -> void
+{
+  const auto &file = packet->file;
+
+  // Only the headers are built into the packet buffer, behind room for the tunnel headers. The symbol data is
+  // gathered from the file buffer when sending, so it is never copied.
+  auto max_size = tunnel_headroom + AlcPacket::max_size(file->meta().toi, 0, packet->ext_fti);
+  if (packet->buffer.size() < max_size) {
+    packet->buffer.resize(max_size);
+  }
+  auto header_size = AlcPacket::build_header(packet->alc(), packet->buffer.size() - tunnel_headroom, _tsi,
+      file->meta().toi, packet->fec_oti, packet->symbols.front(), file->fdt_instance_id(), packet->ext_fti);
+
+  packet->segments.clear();
+  packet->segments.emplace_back(packet->alc(), header_size);
+  packet->alc_size = header_size;
+  for (const auto& symbol : packet->symbols) {
+    auto &last = packet->segments.back();
+    if (packet->segments.size() > 1 && static_cast<const char*>(last.data()) + last.size() == symbol.data()) {
+      // Consecutive symbols are adjacent in the file buffer
+      last = boost::asio::const_buffer(last.data(), last.size() + symbol.len());
+    } else {
+      packet->segments.emplace_back(symbol.data(), symbol.len());
     }
+    packet->alc_size += symbol.len();
   }
-  if (file) {
-    auto symbols = file->get_next_symbols(_max_payload);
 
-    if (symbols.size()) {
-      for(const auto& symbol : symbols) {
-        spdlog::debug("sending TOI {} SBN {} ID {}", file->meta().toi, symbol.source_block_number(), symbol.id() );
-      }
-      auto packet = std::make_shared<AlcPacket>(_tsi, file->meta().toi, file->meta().fec_oti, symbols, _max_payload, file->fdt_instance_id());
-      bytes_queued += packet->size();
-
-      boost::asio::ip::udp::endpoint send_endpoint;
-      char *data = nullptr;
-      size_t data_size = 0;
-      if (_tunnel_endpoint) {
-        send_endpoint = _tunnel_endpoint.value();
-        data_size = packet->size() + 20 /* IP header */ + 8 /* UDP header */;
-        data = new char[data_size];
-        create_udp_pkt(data+20, _endpoint, packet->data(), packet->size(), _source_address?_source_address.value():_tunnel_local_address);
-        create_ip_hdr(data, _endpoint, data_size, _source_address?_source_address.value():_tunnel_local_address);
-      } else {
-        send_endpoint = _endpoint;
-        data = packet->data();
-        data_size = packet->size();
-      }
-      _socket.async_send_to(
-          boost::asio::buffer(data, data_size), send_endpoint,
-          [file, symbols, packet, this](
-              const boost::system::error_code& error,
-              std::size_t bytes_transferred)
-          {
-            if (error) {
-              spdlog::debug("sent_to error: {}", error.message());
-            } else {
-              file->mark_completed(symbols, !error);
-              if (file->complete()) {
-                file_transmitted(file->meta().toi);
-              }
-            }
-          });
-      if (_tunnel_endpoint) {
-        delete[] data;
-      }
+  if (packet->encapsulated) {
+    uint32_t data_sum = 0;
+    size_t offset = 0;
+    for (const auto& segment : packet->segments) {
+      data_sum = combine_sum(data_sum, partial_sum(static_cast<const char*>(segment.data()), segment.size()), offset);
+      offset += segment.size();
     }
+    create_udp_hdr(packet->buffer.data()+20, packet->inner_destination, packet->alc_size, data_sum,
+        packet->inner_source);
+    create_ip_hdr(packet->buffer.data(), packet->inner_destination, packet->size(), packet->inner_source);
+    packet->segments.front() = boost::asio::const_buffer(packet->buffer.data(), tunnel_headroom + header_size);
   }
-  if (_active) {
-    if (!bytes_queued) {
-      _send_timer.expires_from_now(boost::posix_time::milliseconds(10));
-      _send_timer.async_wait( boost::bind(&Transmitter::send_next_packet, this));
-    } else {
-      if (_rate_limit == 0) {
-        boost::asio::post(_io_context, boost::bind(&Transmitter::send_next_packet, this));
-      } else {
-        auto send_duration = ((bytes_queued * 8.0) / (double)_rate_limit/1000.0) * 1000.0 * 1000.0;
-        spdlog::trace("Rate limiter: queued {} bytes, limit {} kbps, next send in {} us",
-            bytes_queued, _rate_limit, send_duration);
-        _send_timer.expires_from_now(boost::posix_time::microseconds(
-              static_cast<int>(ceil(send_duration))));
-        _send_timer.async_wait( boost::bind(&Transmitter::send_next_packet, this));
-      }
+}
+
+auto Transmitter::packet_sent(PacketBuffer *packet, bool success) -> void
+{
+  if (success) {
+    _packets_sent++;
+    _bytes_sent += packet->size();
+  }
+  if (packet->control) {
+    // Close packets are not sent again
+    if (!success) spdlog::debug("Failed to send close packet");
+    return;
+  }
+  // Unsuccessful symbols are left incomplete so they are picked up again by a later packet
+  auto file = std::move(packet->file);
+  bool complete;
+  {
+    // Packets may be built on the worker threads of the multiplexer
+    std::lock_guard<std::mutex> guard(_files_mutex);
+    file->mark_completed(packet->symbols, success);
+    complete = file->complete();
+  }
+  if (success && complete) {
+    file_transmitted(file);
+  }
+}
+
+auto Transmitter::next_scheduled_packet(uint32_t toi) -> PacketBuffer*
+{
+  auto it = _files.find(toi);
+  if (it == _files.end()) return nullptr;
+  auto &file = it->second;
+  if (!file) return nullptr;
+  if (!_multiplexer->sends_object(_session_id, toi)) return nullptr;
+  if (toi != 0 && _multiplexer->worker_threads()) {
+    // Packets of other workers could overtake the FDT instance on its way out, so objects wait until it has been sent
+    auto fdt = _files.find(0);
+    if (fdt != _files.end() && fdt->second && !fdt->second->complete()) return nullptr;
+  }
+  if (file->complete() && !start_carousel_round(toi, file)) return nullptr;
+  if (file->failed()) {
+    // The file cannot be sent any further, it is removed once the scheduler is done
+    if (_failed_sources.insert(toi).second) {
+      spdlog::error("Reading the content source of TOI {} failed, removing it", toi);
+      post([this, toi]() { remove(toi); });
     }
+    return nullptr;
   }
+  if (file->growing()) {
+    auto packet = next_packet(file);
+    if (!file->growing()) {
+      // The growing object has been finalized, the next FDT instance announces its length and MD5
+      fdt_remove(toi);
+      fdt_add(file->meta());
+      schedule_fdt_update();
+    }
+    return packet;
+  }
+  return next_packet(file);
+}
+
+auto Transmitter::start_carousel_round(uint32_t toi, const std::shared_ptr<File> &file) -> bool
+{
+  auto it = _carousel.find(toi);
+  if (it == _carousel.end() || !it->second.round_complete) return false;
+  auto &carousel = it->second;
+  auto now = std::chrono::steady_clock::now();
+  if (now < carousel.round_start + carousel.interval) return false;
+
+  // Rounds that are late start straight away, the next one is timed from this start
+  carousel.round_start = now;
+  carousel.round_complete = false;
+  file->restart();
+  return true;
 }
 
 auto Transmitter::activate() -> void
 {
   if (!_active) {
     _active = true;
+    {
+      // Receivers discarded partially received files when the session was closed, start them again
+      std::lock_guard<std::mutex> guard(_files_mutex);
+      for (auto& file_m : _files) {
+        file_m.second->restart();
+      }
+      for (auto& carousel_m : _carousel) {
+        carousel_m.second.round_start = std::chrono::steady_clock::now();
+        carousel_m.second.round_complete = false;
+      }
+    }
+    send_fdt();
     start_fdt_repeat_timer();
-    send_next_packet();
+    _multiplexer->session_activated();
   }
 }
 
 auto Transmitter::deactivate() -> void
 {
   if (_active) {
+    // The send loop stays up until the close packet has gone out
+    send_close_packet(0, true);
     _active = false;
     _fdt_timer.cancel();
-    _send_timer.cancel();
+    _multiplexer->session_deactivated();
   }
 }
 
@@ -828,8 +1446,23 @@ auto Transmitter::start_fdt_repeat_timer() -> void
     _fdt_timer.async_wait( boost::bind(&Transmitter::fdt_send_tick, this, boost::placeholders::_1));
 }
 
-static void create_udp_pkt(char *udp_buffer, const boost::asio::ip::udp::endpoint &endpoint, const char *data, size_t data_len, const boost::asio::ip::address &local_address)
+#if HAVE_MMAP
+static const char *map_file(int file_handle, size_t length)
 {
+  auto data = mmap(nullptr, length, PROT_READ, MAP_SHARED, file_handle, 0);
+  if (data != MAP_FAILED) {
+    // Files are sent from start to end, so the kernel can read ahead further and drop pages behind the transmission.
+    // The File prefetches the source blocks ahead of the one being sent on top of this, see Transmitter::source_read_ahead().
+    madvise(data, length, MADV_SEQUENTIAL);
+  }
+  return reinterpret_cast<const char*>(data);
+}
+#endif
+
+static void create_udp_hdr(char *udp_buffer, const boost::asio::ip::udp::endpoint &endpoint, size_t data_len, uint32_t data_sum, const boost::asio::ip::address &local_address)
+{
+  // The payload follows the header and has already been summed into data_sum. The pseudo header for the checksum is
+  // written in front of the UDP header, where the IP header is created afterwards.
   struct udp_pseudo_hdr {
     in_addr_t source;
     in_addr_t dest;
@@ -849,9 +1482,13 @@ static void create_udp_pkt(char *udp_buffer, const boost::asio::ip::udp::endpoin
   udp_hdr->uh_dport = udp_hdr->uh_sport;
   udp_hdr->uh_ulen = pseudo_hdr->length;
   udp_hdr->uh_sum = 0;
-  memcpy(udp_buffer+8, data, data_len);
 
-  udp_hdr->uh_sum = calculate_sum(reinterpret_cast<uint16_t*>(pseudo_hdr), data_len + 8 + 12);
+  auto sum = combine_sum(partial_sum(reinterpret_cast<char*>(pseudo_hdr), 12 + 8), data_sum, 12 + 8);
+  udp_hdr->uh_sum = static_cast<uint16_t>(~sum);
+  if (udp_hdr->uh_sum == 0) {
+    // A computed checksum of zero is sent as all ones, zero means no checksum (RFC 768)
+    udp_hdr->uh_sum = 0xffff;
+  }
 }
 
 static void create_ip_hdr(char *ip_buffer, const boost::asio::ip::udp::endpoint &endpoint, size_t pkt_size, const boost::asio::ip::address &local_address)
@@ -870,29 +1507,53 @@ static void create_ip_hdr(char *ip_buffer, const boost::asio::ip::udp::endpoint
   ip_hdr->saddr = htonl(local_address.to_v4().to_uint());
   ip_hdr->daddr = htonl(endpoint.address().to_v4().to_uint());
 
-  ip_hdr->check = calculate_sum(reinterpret_cast<uint16_t*>(ip_hdr), 20);
+  ip_hdr->check = calculate_sum(ip_buffer, 20);
 }
 
-static uint16_t calculate_sum(uint16_t *buffer, size_t len)
+static uint32_t partial_sum(const char *buffer, size_t len)
 {
-  uint32_t cksum = 0;
-
-  while (len > 1) {
-    cksum += ntohs(*buffer);
-    len -= 2;
-    buffer++;
+  // The one's complement sum does not depend on the byte order (RFC 1071), so the buffer is summed as native 64 bit
+  // words with the carries wrapped around and folded to 16 bits.
+  uint64_t sum = 0;
+  uint64_t word;
+
+  while (len >= sizeof(word)) {
+    memcpy(&word, buffer, sizeof(word));
+    sum += word;
+    sum += (sum < word);
+    buffer += sizeof(word);
+    len -= sizeof(word);
   }
   if (len > 0) {
-    cksum += (*reinterpret_cast<uint8_t*>(buffer)) << 8;
-  }
-  
-  while (cksum >> 16) {
-    cksum = (cksum & 0xFFFF) + (cksum >> 16);
+    // Pad the tail with zeroes
+    word = 0;
+    memcpy(&word, buffer, len);
+    sum += word;
+    sum += (sum < word);
   }
 
-  uint16_t result = htons(static_cast<uint16_t>(~cksum));
+  sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+  sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  sum = (sum & 0xFFFF) + (sum >> 16);
 
-  return result;
+  return static_cast<uint32_t>(sum);
+}
+
+static uint32_t combine_sum(uint32_t sum, uint32_t partial, size_t offset)
+{
+  // A block starting at an odd offset has its bytes swapped relative to the rest of the packet
+  if (offset & 1) {
+    partial = ((partial & 0xFF) << 8) | (partial >> 8);
+  }
+  sum += partial;
+  return (sum & 0xFFFF) + (sum >> 16);
+}
+
+static uint16_t calculate_sum(const char *buffer, size_t len)
+{
+  return static_cast<uint16_t>(~partial_sum(buffer, len));
 }
 
 } // End namespace LibFlute
@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "File.h"
+
+using namespace LibFlute;
+
+// Exposes the FEC OTI defaults normally merged in by the Transmitter
+struct BenchmarkFileDescription : Transmitter::FileDescription {
+  using Transmitter::FileDescription::FileDescription;
+  using Transmitter::FileDescription::merge_fec_oti;
+};
+
+TEST(FileBenchmark, SymbolSelectionScalesWithObjectSize) {
+  // Sends objects of growing size one symbol per packet, the time per packet should not grow with the object size
+  constexpr size_t kSymbolLength = 1428;
+  std::vector<char> data(256 * 1024 * 1024, 'b');
+  std::vector<EncodingSymbol> symbols;
+  for (size_t length : {1024ul, 1024ul * 1024, 64ul * 1024 * 1024, 256ul * 1024 * 1024}) {
+    auto description = std::make_shared<BenchmarkFileDescription>("test/file.bin", data.data(), length);
+    description->merge_fec_oti(FecOti{
+      .encoding_id = FecScheme::CompactNoCode,
+      .instance_id = 0,
+      .transfer_length = 0,
+      .encoding_symbol_length = kSymbolLength,
+      .max_source_block_length = 64,
+      .max_number_of_encoding_symbols = 0});
+    File file(description);
+
+    const auto sending = std::chrono::steady_clock::now();
+    size_t packets = 0;
+    for (file.get_next_symbols(kSymbolLength, symbols); !symbols.empty(); file.get_next_symbols(kSymbolLength, symbols)) {
+      file.mark_completed(symbols, true);
+      packets++;
+    }
+    const auto sent = std::chrono::steady_clock::now();
+
+    EXPECT_TRUE(file.complete());
+    using ns = std::chrono::duration<double, std::nano>;
+    std::cout << "Sent " << length << " bytes in " << packets << " packets, "
+      << ns(sent - sending).count() / packets << " ns per packet" << std::endl;
+  }
+}
@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Transmitter.h"
+
+using namespace LibFlute;
+
+namespace {
+struct LoopbackRun {
+  double seconds = 0;
+  double cpu_seconds = 0;   //< Process CPU time, the sends run on the calling thread
+  Transmitter::Statistics statistics;
+};
+
+// Sends one object to a socket on the loopback interface, as fast as the Transmitter goes
+template <typename Configure>
+LoopbackRun send_over_loopback(const std::vector<char> &content, Configure configure) {
+  constexpr short kPort = 18200;
+  boost::asio::io_context io;
+  // Nothing reads from the sink, the kernel drops what does not fit in its receive buffer
+  boost::asio::ip::udp::socket sink(io, boost::asio::ip::udp::endpoint(boost::asio::ip::make_address("127.0.0.1"),
+      kPort));
+  Transmitter tx("127.0.0.1", kPort, /*tsi*/1234, /*mtu*/1400, /*rate_limit*/0, io);
+  configure(tx);
+  tx.register_completion_callback([&io](uint32_t) { io.stop(); });
+
+  LoopbackRun run;
+  const auto start = std::chrono::steady_clock::now();
+  const auto cpu_start = std::clock();
+  tx.send(std::make_shared<Transmitter::FileDescription>("loopback.bin", content));
+  io.run();
+  run.cpu_seconds = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+  run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  run.statistics = tx.statistics();
+  tx.deactivate();
+  return run;
+}
+
+void print(const std::string &name, const LoopbackRun &run) {
+  const auto &stats = run.statistics;
+  std::cout << name << ": " << stats.packets_sent / run.seconds << " packets/s, "
+            << stats.bytes_sent * 8 / run.seconds / 1e9 << " Gbit/s, "
+            << static_cast<double>(stats.packets_sent) / stats.send_calls << " packets per send call" << std::endl;
+}
+}
+
+TEST(LoopbackBenchmark, BatchedSendsRaiseThroughput) {
+  // One sendmsg() per packet against sendmmsg() and UDP GSO batches of 32
+  const std::vector<char> content(64 * 1024 * 1024, 'l');
+  auto single = send_over_loopback(content, [](Transmitter &tx) { tx.send_batch_size(1); });
+  auto batched = send_over_loopback(content, [](Transmitter &tx) { tx.send_batch_size(32); });
+  print("Batch size 1", single);
+  print("Batch size 32", batched);
+
+  EXPECT_EQ(batched.statistics.packets_sent, single.statistics.packets_sent);
+  EXPECT_LT(batched.statistics.send_calls, single.statistics.send_calls);
+}
+
+TEST(LoopbackBenchmark, ZeroCopyCpuPerGbps) {
+  // The loopback interface copies zero copy sends anyway (counted in zerocopy_copied), so this shows the cost of the
+  // completion notifications. The saving needs a NIC that sends from the pages in place.
+  const std::vector<char> content(64 * 1024 * 1024, 'z');
+  // CPU cores busy per Gbit/s sent
+  auto cpu_per_gbps = [](const LoopbackRun &run) { return run.cpu_seconds / (run.statistics.bytes_sent * 8 / 1e9); };
+  auto copied = send_over_loopback(content, [](Transmitter &tx) { tx.send_batch_size(32).zerocopy(false); });
+  auto zerocopy = send_over_loopback(content, [](Transmitter &tx) { tx.send_batch_size(32).zerocopy(true); });
+  print("Copied", copied);
+  print("Zero copy", zerocopy);
+  std::cout << "CPU per Gbit/s: copied " << cpu_per_gbps(copied) << ", zero copy " << cpu_per_gbps(zerocopy)
+            << " (" << zerocopy.statistics.zerocopy_copied << " zero copy sends copied by the kernel)" << std::endl;
+
+  EXPECT_EQ(zerocopy.statistics.packets_sent, copied.statistics.packets_sent);
+}
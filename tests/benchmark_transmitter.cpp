@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Transmitter.h"
+
+using namespace LibFlute;
+
+TEST(TransmitterBenchmark, QueueingManyFilesBuildsOneFdt) {
+  // Queueing each file used to rebuild and serialize the whole FDT, quadratic in the number of files
+  constexpr size_t kFiles = 10000;
+  boost::asio::io_context io;
+  Transmitter tx("239.1.1.1", 5000, /*tsi*/1234, /*mtu*/1400, /*rate_limit*/0, io);
+  std::vector<char> content(100, 'x');
+  std::vector<std::shared_ptr<Transmitter::FileDescription>> files;
+  for (size_t i = 0; i < kFiles; i++) {
+    files.push_back(std::make_shared<Transmitter::FileDescription>("file" + std::to_string(i) + ".bin", content));
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto& file : files) {
+    tx.send(file);
+  }
+  const auto queued = std::chrono::steady_clock::now();
+  while (tx.number_of_files() == kFiles && io.run_one_for(std::chrono::seconds(1))) {}
+  const auto announced = std::chrono::steady_clock::now();
+  EXPECT_EQ(tx.number_of_files(), kFiles + 1);
+
+  using ms = std::chrono::duration<double, std::milli>;
+  std::cout << "Queued " << kFiles << " files in " << ms(queued - start).count() << " ms, FDT built in "
+            << ms(announced - queued).count() << " ms" << std::endl;
+}
@@ -0,0 +1,140 @@
+// libflute - FLUTE/ALC library
+//
+// Copyright (C) 2026 libflute contributors
+//
+// Licensed under the License terms and conditions for use, reproduction, and
+// distribution of 5G-MAG software (the "License").  You may not use this file
+// except in compliance with the License.  You may obtain a copy of the License at
+// https://www.5g-mag.com/reference-tools.  Unless required by applicable law or
+// agreed to in writing, software distributed under the License is distributed on
+// an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied.
+//
+// See the License for the specific language governing permissions and limitations
+// under the License.
+//
+
+#include <gtest/gtest.h>
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "Transmitter.h"
+
+namespace {
+
+std::atomic<uint64_t> allocation_count{0};
+
+}  // namespace
+
+#ifdef __GLIBC__
+// Count every heap allocation in the process, including those made by operator new, the C library and Boost.Asio's
+// handler allocator, by interposing the malloc family and forwarding to the glibc implementation.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  *ptr = __libc_memalign(alignment, size);
+  return *ptr ? 0 : ENOMEM;
+}
+
+void free(void* ptr) { __libc_free(ptr); }
+}
+#else
+void* operator new(std::size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+#endif
+
+namespace {
+
+struct SteadyStateSample {
+  uint64_t allocations;
+  uint64_t packets;
+};
+
+// Transmit a large file at a limited rate (nobody is listening) and count the allocations made while the transmitter
+// is in the steady state, i.e. after the FDT and the first packets are out and before the file completes.
+auto sample_steady_state(unsigned batch_size) -> SteadyStateSample {
+  using namespace std::chrono_literals;
+
+  boost::asio::io_context io;
+  LibFlute::Transmitter transmitter("239.255.0.11", 18100, 4250, 1400, 20000, io);
+  transmitter.send_batch_size(batch_size);
+
+  std::vector<char> payload(4 * 1024 * 1024);
+  for (size_t i = 0; i < payload.size(); i++) payload[i] = static_cast<char>(i * 13);
+  transmitter.send(std::make_shared<LibFlute::Transmitter::FileDescription>("steady.bin", payload));
+
+  std::thread io_thread([&io]() { io.run(); });
+  std::this_thread::sleep_for(300ms);
+
+  const auto packets_before = transmitter.statistics().packets_sent;
+  const auto allocations_before = allocation_count.load();
+  std::this_thread::sleep_for(700ms);
+  const auto allocations_after = allocation_count.load();
+  const auto packets_after = transmitter.statistics().packets_sent;
+
+  io.stop();
+  io_thread.join();
+  transmitter.deactivate();
+
+  return {allocations_after - allocations_before, packets_after - packets_before};
+}
+
+}  // namespace
+
+TEST(FluteAllocationTest, SendsWithoutPerPacketAllocations) {
+  const auto sample = sample_steady_state(1);
+  EXPECT_GT(sample.packets, 500u);
+  EXPECT_EQ(sample.allocations, 0u);
+}
+
+TEST(FluteAllocationTest, SendsBatchesWithoutPerPacketAllocations) {
+  const auto sample = sample_steady_state(8);
+  EXPECT_GT(sample.packets, 500u);
+  EXPECT_EQ(sample.allocations, 0u);
+}
@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+#include <boost/asio/post.hpp>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+#include "ContentEncoder.h"
+
+using namespace LibFlute;
+
+namespace {
+
+// Decompress with plain zlib, windowBits selects the gzip (31) or zlib (15) container
+auto inflate_all(const std::vector<char> &compressed, int window_bits) -> std::string {
+  z_stream zs = {};
+  EXPECT_EQ(inflateInit2(&zs, window_bits), Z_OK);
+  std::string out;
+  char buffer[16384];
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  zs.avail_in = compressed.size();
+  int result;
+  do {
+    zs.next_out = reinterpret_cast<Bytef*>(buffer);
+    zs.avail_out = sizeof(buffer);
+    result = inflate(&zs, Z_NO_FLUSH);
+    out.append(buffer, sizeof(buffer) - zs.avail_out);
+  } while (result == Z_OK);
+  EXPECT_EQ(result, Z_STREAM_END);
+  // Nothing may follow the end of the stream
+  EXPECT_EQ(zs.avail_in, 0u);
+  inflateEnd(&zs);
+  return out;
+}
+
+// Text-like content that compresses, with repeats reaching across block boundaries
+auto make_content(size_t length) -> std::string {
+  std::string content;
+  unsigned seed = 1;
+  while (content.size() < length) {
+    seed = seed * 1103515245 + 12345;
+    content += "line " + std::to_string((seed >> 16) % 1000) + " of the content\n";
+  }
+  content.resize(length);
+  return content;
+}
+
+}  // namespace
+
+TEST(ContentEncoderTest, GzipRoundTripAcrossBlocks) {
+  auto content = make_content(1000000);
+  ContentEncoder encoder(ContentEncoder::Format::GZIP, -1, 64 * 1024);
+  auto compressed = encoder.encode(content.data(), content.size());
+  EXPECT_LT(compressed.size(), content.size() / 2);
+  EXPECT_EQ(inflate_all(compressed, 15 | 16), content);
+}
+
+TEST(ContentEncoderTest, ZlibRoundTripAcrossBlocks) {
+  auto content = make_content(300001);
+  ContentEncoder encoder(ContentEncoder::Format::ZLIB, 9, 50000);
+  auto compressed = encoder.encode(content.data(), content.size());
+  EXPECT_EQ(inflate_all(compressed, 15), content);
+}
+
+TEST(ContentEncoderTest, BlocksUseTheContentBeforeThemAsDictionary) {
+  // The same content twice, the second half is a back reference into the first block
+  auto half = make_content(64 * 1024);
+  auto content = half + half;
+  ContentEncoder single(ContentEncoder::Format::GZIP, -1, content.size());
+  ContentEncoder split(ContentEncoder::Format::GZIP, -1, half.size());
+  auto single_size = single.encode(content.data(), content.size()).size();
+  auto split_size = split.encode(content.data(), content.size()).size();
+  EXPECT_LT(split_size, single_size + 64);
+}
+
+TEST(ContentEncoderTest, EncodesEmptyContent) {
+  ContentEncoder gzip(ContentEncoder::Format::GZIP);
+  EXPECT_EQ(inflate_all(gzip.encode(nullptr, 0), 15 | 16), "");
+  ContentEncoder zlib(ContentEncoder::Format::ZLIB);
+  EXPECT_EQ(inflate_all(zlib.encode(nullptr, 0), 15), "");
+}
+
+TEST(ContentEncoderTest, EncodesFromTheThreadPool) {
+  // Encoders running on every pool thread at once must not wait for each other's blocks
+  auto content = make_content(200000);
+  ContentEncoder encoder(ContentEncoder::Format::GZIP, -1, 16 * 1024);
+  constexpr int kJobs = 16;
+  std::vector<std::string> results(kJobs);
+  std::atomic<int> done = 0;
+  for (int i = 0; i < kJobs; i++) {
+    boost::asio::post(ContentEncoder::thread_pool(), [&, i]() {
+          results[i] = inflate_all(encoder.encode(content.data(), content.size()), 15 | 16);
+          done++;
+        });
+  }
+  while (done < kJobs) std::this_thread::yield();
+  for (const auto& result : results) {
+    EXPECT_EQ(result, content);
+  }
+}
+
+TEST(ContentEncoderTest, CachesStreamsByDigestAndSettings) {
+  auto content = make_content(100000);
+  ContentEncoder gzip(ContentEncoder::Format::GZIP);
+  auto before = ContentEncoder::cache_statistics();
+  auto first = gzip.encode(content.data(), content.size(), "cache-test-digest");
+  auto second = gzip.encode(content.data(), content.size(), "cache-test-digest");
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(inflate_all(*first, 15 | 16), content);
+
+  // Other settings are another cache entry
+  ContentEncoder zlib(ContentEncoder::Format::ZLIB);
+  auto other = zlib.encode(content.data(), content.size(), "cache-test-digest");
+  EXPECT_NE(first, other);
+  EXPECT_EQ(inflate_all(*other, 15), content);
+
+  auto after = ContentEncoder::cache_statistics();
+  EXPECT_EQ(after.hits - before.hits, 1u);
+  EXPECT_EQ(after.misses - before.misses, 2u);
+  EXPECT_EQ(after.entries - before.entries, 2u);
+}
+
+TEST(ContentEncoderTest, EvictsLeastRecentlyUsedStreams) {
+  ContentEncoder encoder(ContentEncoder::Format::GZIP);
+  auto a = make_content(50000);
+  auto b = a + "b";
+  auto c = a + "c";
+  auto size = encoder.encode(a.data(), a.size()).size();
+  ContentEncoder::cache_limit(0);
+  ContentEncoder::cache_limit(size * 5 / 2);  // Room for two of the streams
+
+  auto before = ContentEncoder::cache_statistics();
+  EXPECT_EQ(before.entries, 0u);
+  auto first = encoder.encode(a.data(), a.size(), "evict-a");
+  encoder.encode(b.data(), b.size(), "evict-b");
+  encoder.encode(a.data(), a.size(), "evict-a");  // a is now more recently used than b
+  encoder.encode(c.data(), c.size(), "evict-c");  // evicts b
+
+  auto after = ContentEncoder::cache_statistics();
+  EXPECT_EQ(after.evictions - before.evictions, 1u);
+  EXPECT_EQ(after.entries, 2u);
+  EXPECT_LE(after.bytes, ContentEncoder::cache_limit());
+  EXPECT_EQ(encoder.encode(a.data(), a.size(), "evict-a"), first);
+  EXPECT_EQ(ContentEncoder::cache_statistics().misses, after.misses);
+  encoder.encode(b.data(), b.size(), "evict-b");
+  EXPECT_EQ(ContentEncoder::cache_statistics().misses, after.misses + 1);
+
+  // Streams larger than the limit are not cached
+  ContentEncoder::cache_limit(size / 2);
+  EXPECT_EQ(ContentEncoder::cache_statistics().entries, 0u);
+  auto big = encoder.encode(a.data(), a.size(), "evict-a");
+  EXPECT_EQ(inflate_all(*big, 15 | 16), a);
+  EXPECT_EQ(ContentEncoder::cache_statistics().entries, 0u);
+
+  ContentEncoder::cache_limit(ContentEncoder::default_cache_limit);
+}
@@ -17,18 +17,31 @@
 #include <gtest/gtest.h>
 
 #include <boost/asio.hpp>
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <future>
 #include <iostream>
 #include <iterator>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <vector>
 
+#include "AlcPacket.h"
 #include "Receiver.h"
 #include "Transmitter.h"
 
@@ -43,6 +56,172 @@ auto read_fixture_file(const std::filesystem::path& file_path) -> std::string {
   return {std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
 }
 
+// Straightforward RFC 1071 checksum to check the transmitter's optimised one against
+auto reference_checksum(const std::vector<uint8_t>& data) -> uint16_t {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < data.size(); i += 2) {
+    sum += (data[i] << 8) | (i + 1 < data.size() ? data[i + 1] : 0);
+  }
+  while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+  return static_cast<uint16_t>(~sum);
+}
+
+// Receiver and Transmitter of a test session, with their io_contexts run on threads of their own
+class Session {
+ public:
+  Session() = default;
+
+  // A receiver on any interface and a transmitter for the same group and TSI
+  Session(const std::string& address, short port, uint64_t tsi, uint32_t rate_limit = 0)
+      : receiver(std::make_unique<LibFlute::Receiver>("0.0.0.0", address, port, tsi, receiver_io)),
+        transmitter(std::make_unique<LibFlute::Transmitter>(address, port, tsi, 1400, rate_limit, transmitter_io)) {}
+
+  ~Session() { stop(); }
+
+  // Run the io_contexts. They keep running without pending work, so that a receiver can be added later.
+  void start() {
+    _receiver_thread = std::thread([this]() {
+      auto work = boost::asio::make_work_guard(receiver_io);
+      receiver_io.run();
+    });
+    _transmitter_thread = std::thread([this]() {
+      auto work = boost::asio::make_work_guard(transmitter_io);
+      transmitter_io.run();
+    });
+  }
+
+  // Deactivate the transmitter, stop the receiver and wait for the io_context threads
+  void stop() {
+    if (transmitter) transmitter->deactivate();
+    transmitter_io.stop();
+    if (receiver) receiver->stop();
+    receiver_io.stop();
+    if (_transmitter_thread.joinable()) _transmitter_thread.join();
+    if (_receiver_thread.joinable()) _receiver_thread.join();
+  }
+
+  // The first file completed by the receiver. Registers the receiver's completion callback.
+  auto first_received_file() -> std::future<std::shared_ptr<LibFlute::File>> {
+    receiver->register_completion_callback([this](const std::shared_ptr<LibFlute::File>& file) {
+      std::call_once(_received_once, [this, &file]() { _received.set_value(file); });
+    });
+    return _received.get_future();
+  }
+
+  // Ready once the transmitter has sent that many files. Registers the transmitter's completion callback.
+  auto files_transmitted(size_t count) -> std::future<void> {
+    transmitter->register_completion_callback([this, count](uint32_t) {
+      if (++_transmitted == count) _transmitted_promise.set_value();
+    });
+    return _transmitted_promise.get_future();
+  }
+
+  boost::asio::io_context receiver_io;
+  boost::asio::io_context transmitter_io;
+  std::unique_ptr<LibFlute::Receiver> receiver;
+  std::unique_ptr<LibFlute::Transmitter> transmitter;
+
+ private:
+  std::thread _receiver_thread;
+  std::thread _transmitter_thread;
+  std::promise<std::shared_ptr<LibFlute::File>> _received;
+  std::once_flag _received_once;
+  std::atomic<size_t> _transmitted{0};
+  std::promise<void> _transmitted_promise;
+};
+
+// Listens in on a session and passes every packet to a handler, on the thread running the io_context
+class Sniffer {
+ public:
+  using Handler = std::function<void(const LibFlute::AlcPacket& alc, const char* data)>;
+
+  Sniffer(boost::asio::io_context& io, const std::string& address, short port, Handler handler)
+      : _socket(io), _handler(std::move(handler)) {
+    _socket.open(boost::asio::ip::udp::v4());
+    _socket.set_option(boost::asio::ip::udp::socket::reuse_address(true));
+    _socket.bind(boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::any(), port));
+    _socket.set_option(boost::asio::ip::multicast::join_group(boost::asio::ip::make_address(address)));
+    receive();
+  }
+
+ private:
+  void receive() {
+    _socket.async_receive(boost::asio::buffer(_buffer), [this](const boost::system::error_code& error, size_t length) {
+      if (error) return;
+      _handler(LibFlute::AlcPacket(_buffer, length), _buffer);
+      receive();
+    });
+  }
+
+  boost::asio::ip::udp::socket _socket;
+  Handler _handler;
+  char _buffer[2048];
+};
+
+// Relays the packets of a session onto two paths, each of them losing a different third of the packets
+class Relay {
+ public:
+  struct Path {
+    std::string address;  // Multicast address of the path
+    std::string iface;    // Address of the interface to send on, empty for the default one
+  };
+
+  Relay(boost::asio::io_context& io, const std::string& source, short source_port, const Path& a, const Path& b,
+        short port)
+      : _in(io), _out_a(io, boost::asio::ip::udp::v4()), _out_b(io, boost::asio::ip::udp::v4()),
+        _a(boost::asio::ip::make_address(a.address), port), _b(boost::asio::ip::make_address(b.address), port) {
+    boost::asio::ip::udp::endpoint listen(boost::asio::ip::address_v4::any(), source_port);
+    _in.open(listen.protocol());
+    _in.set_option(boost::asio::ip::udp::socket::reuse_address(true));
+    _in.bind(listen);
+    _in.set_option(boost::asio::ip::multicast::join_group(boost::asio::ip::make_address(source)));
+    for (auto [out, path] : {std::make_pair(&_out_a, &a), std::make_pair(&_out_b, &b)}) {
+      out->set_option(boost::asio::ip::multicast::enable_loopback(true));
+      if (!path->iface.empty()) {
+        out->set_option(boost::asio::ip::multicast::outbound_interface(
+            boost::asio::ip::make_address_v4(path->iface)));
+      }
+    }
+    receive();
+  }
+
+ private:
+  void receive() {
+    _in.async_receive(boost::asio::buffer(_buffer), [this](const boost::system::error_code& error, size_t length) {
+      if (error) return;
+      if (_relayed % 3 != 0) _out_a.send_to(boost::asio::buffer(_buffer, length), _a);
+      if (_relayed % 3 != 1) _out_b.send_to(boost::asio::buffer(_buffer, length), _b);
+      _relayed++;
+      receive();
+    });
+  }
+
+  boost::asio::ip::udp::socket _in;
+  boost::asio::ip::udp::socket _out_a;
+  boost::asio::ip::udp::socket _out_b;
+  boost::asio::ip::udp::endpoint _a;
+  boost::asio::ip::udp::endpoint _b;
+  char _buffer[2048];
+  size_t _relayed = 0;
+};
+
+// Address of the first multicast capable interface other than loopback, empty if there is none
+auto primary_interface_address() -> std::string {
+  struct ifaddrs* interfaces = nullptr;
+  if (getifaddrs(&interfaces) != 0) return {};
+  std::string address;
+  for (auto interface = interfaces; interface && address.empty(); interface = interface->ifa_next) {
+    if (interface->ifa_addr && interface->ifa_addr->sa_family == AF_INET && (interface->ifa_flags & IFF_UP) &&
+        (interface->ifa_flags & IFF_MULTICAST) && !(interface->ifa_flags & IFF_LOOPBACK)) {
+      char buffer[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, &reinterpret_cast<struct sockaddr_in*>(interface->ifa_addr)->sin_addr, buffer, sizeof(buffer));
+      address = buffer;
+    }
+  }
+  freeifaddrs(interfaces);
+  return address;
+}
+
 }  // namespace
 
 TEST(FluteEndToEndTest, TransmitsFileToReceiver) {
@@ -143,3 +322,1060 @@ TEST(FluteEndToEndTest, TransmitsFileToReceiver) {
   const std::string received_payload(received_file->buffer(), received_file->length());
   EXPECT_EQ(received_payload, expected_payload);
 }
+
+TEST(FluteEndToEndTest, ReceiverSkipsFilteredFiles) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18092;
+  const std::vector<char> wanted_payload(3000, 'w');
+  const std::vector<char> unwanted_payload(3000, 'u');
+
+  Session session("239.255.0.2", kPort, 4243);
+  session.receiver->add_content_location_filter("video/*.m4s");
+
+  auto wanted = std::make_shared<LibFlute::Transmitter::FileDescription>("video/segment_1.m4s", wanted_payload);
+  auto unwanted = std::make_shared<LibFlute::Transmitter::FileDescription>("audio/segment_1.m4s", unwanted_payload);
+
+  std::mutex received_mutex;
+  std::vector<std::string> received_locations;
+  session.receiver->register_completion_callback(
+      [&received_mutex, &received_locations](const std::shared_ptr<LibFlute::File>& file) {
+        std::lock_guard<std::mutex> guard(received_mutex);
+        received_locations.push_back(file->meta().content_location);
+      });
+  auto transmitted = session.files_transmitted(2);
+
+  session.start();
+  session.transmitter->send(wanted);
+  session.transmitter->send(unwanted);
+
+  const auto transmitted_ready = transmitted.wait_for(5s);
+  std::this_thread::sleep_for(200ms);
+  session.stop();
+
+  ASSERT_EQ(transmitted_ready, std::future_status::ready);
+  ASSERT_EQ(received_locations.size(), 1u);
+  EXPECT_EQ(received_locations[0], "video/segment_1.m4s");
+
+  auto stats = session.receiver->statistics();
+  EXPECT_GE(stats.files_filtered, 1u);
+  EXPECT_GT(stats.packets_filtered, 0u);
+}
+
+TEST(FluteEndToEndTest, ReceiverDoesNotReceiveDeliveredFilesAgainWhenFiltersChange) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18115;
+  const std::vector<char> payload(3000, 'd');
+
+  Session session("239.255.0.28", kPort, 4265);
+  std::atomic<size_t> delivered{0};
+  std::promise<void> first_delivery;
+  session.receiver->register_completion_callback([&](const std::shared_ptr<LibFlute::File>&) {
+        if (delivered++ == 0) first_delivery.set_value();
+      });
+
+  // The carousel keeps sending the file after it has been delivered
+  auto file = std::make_shared<LibFlute::Transmitter::FileDescription>("delivered.bin", payload);
+  file->set_carousel_interval(50ms);
+  session.start();
+  session.transmitter->send(file);
+  const auto delivered_ready = first_delivery.get_future().wait_for(5s);
+
+  // Replays the FDT, which still announces the delivered file
+  session.receiver->file_size_filter(0);
+  std::this_thread::sleep_for(500ms);
+  const auto files = session.receiver->file_list();
+  session.stop();
+
+  ASSERT_EQ(delivered_ready, std::future_status::ready);
+  EXPECT_EQ(delivered, 1u);
+  EXPECT_TRUE(files.empty());
+}
+
+TEST(FluteEndToEndTest, ReceiverReleasesClosedFilesAndSession) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18093;
+  const std::vector<char> small_payload(1000, 's');
+  const std::vector<char> payload(200000, 'c');
+
+  // 1 Mbit/s so that the file is still incomplete when it gets removed
+  Session session("239.255.0.3", kPort, 4244, 1000);
+  auto& transmitter = *session.transmitter;
+  auto& receiver = *session.receiver;
+
+  // No completion callback, so that the receiver keeps the completed file
+  auto small_file = std::make_shared<LibFlute::Transmitter::FileDescription>("closed/small.bin", small_payload);
+  auto file = std::make_shared<LibFlute::Transmitter::FileDescription>("closed/file.bin", payload);
+
+  session.start();
+  transmitter.send(small_file);
+  auto toi = transmitter.send(file);
+  std::this_thread::sleep_for(300ms);
+
+  std::promise<bool> removed;
+  boost::asio::post(session.transmitter_io, [&]() { removed.set_value(transmitter.remove(toi)); });
+  EXPECT_TRUE(removed.get_future().get());
+  std::this_thread::sleep_for(100ms);
+
+  auto stats = receiver.statistics();
+  EXPECT_EQ(stats.files_closed, 1u);
+  auto files = receiver.file_list();
+  ASSERT_EQ(files.size(), 1u);
+  EXPECT_EQ(files.front()->meta().content_location, "closed/small.bin");
+  EXPECT_TRUE(files.front()->complete());
+
+  std::promise<void> deactivated;
+  boost::asio::post(session.transmitter_io, [&]() { transmitter.deactivate(); deactivated.set_value(); });
+  deactivated.get_future().wait();
+  std::this_thread::sleep_for(100ms);
+
+  EXPECT_EQ(receiver.statistics().sessions_closed, 1u);
+  // Only files still being received are released with the session
+  EXPECT_EQ(receiver.file_list().size(), 1u);
+}
+
+TEST(FluteEndToEndTest, ReceiverRejectsFilesOverAdmissionLimit) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18094;
+  const std::vector<char> small_payload(1000, 's');
+  const std::vector<char> large_payload(50000, 'l');
+
+  Session session("239.255.0.4", kPort, 4245);
+  LibFlute::Receiver::AdmissionLimits limits;
+  limits.max_file_size = 10000;
+  session.receiver->admission_limits(limits);
+
+  std::mutex received_mutex;
+  std::vector<std::string> received_locations;
+  session.receiver->register_completion_callback(
+      [&received_mutex, &received_locations](const std::shared_ptr<LibFlute::File>& file) {
+        std::lock_guard<std::mutex> guard(received_mutex);
+        received_locations.push_back(file->meta().content_location);
+      });
+  auto transmitted = session.files_transmitted(2);
+
+  session.start();
+  session.transmitter->send(std::make_shared<LibFlute::Transmitter::FileDescription>("small.bin", small_payload));
+  session.transmitter->send(std::make_shared<LibFlute::Transmitter::FileDescription>("large.bin", large_payload));
+
+  const auto transmitted_ready = transmitted.wait_for(5s);
+  std::this_thread::sleep_for(200ms);
+  session.stop();
+
+  ASSERT_EQ(transmitted_ready, std::future_status::ready);
+  ASSERT_EQ(received_locations.size(), 1u);
+  EXPECT_EQ(received_locations[0], "small.bin");
+  EXPECT_GE(session.receiver->statistics().files_rejected, 1u);
+}
+
+TEST(FluteEndToEndTest, ReceiverAdmitsFilesOnceConcurrentReceptionCompletes) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18117;
+  const std::vector<char> first_payload(3000, '1');
+  const std::vector<char> second_payload(3000, '2');
+
+  Session session("239.255.0.30", kPort, 4267);
+  LibFlute::Receiver::AdmissionLimits limits;
+  limits.max_concurrent_files = 1;
+  session.receiver->admission_limits(limits);
+
+  // No completion callback, so that the receiver keeps the completed file. One FDT instance announces both files,
+  // the second is only admitted with a repetition of the FDT after the first has been received.
+  std::vector<std::shared_ptr<LibFlute::Transmitter::FileDescription>> files{
+      std::make_shared<LibFlute::Transmitter::FileDescription>("first.bin", first_payload),
+      std::make_shared<LibFlute::Transmitter::FileDescription>("second.bin", second_payload)};
+  for (auto& file : files) file->set_carousel_interval(50ms);
+  session.start();
+  session.transmitter->send(files);
+
+  auto complete_files = [&session]() {
+    auto files = session.receiver->file_list();
+    return std::count_if(files.begin(), files.end(), [](const auto& file) { return file->complete(); });
+  };
+  std::this_thread::sleep_for(500ms);
+  const auto complete_at_limit = complete_files();
+  const auto rejected = session.receiver->statistics().files_rejected;
+  const auto deadline = std::chrono::steady_clock::now() + 8s;
+  while (complete_files() < 2 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(50ms);
+  }
+  const auto complete_after_repeat = complete_files();
+  session.stop();
+
+  EXPECT_EQ(complete_at_limit, 1);
+  EXPECT_GE(rejected, 1u);
+  EXPECT_EQ(complete_after_repeat, 2);
+}
+
+TEST(FluteEndToEndTest, ReceiverDropsPacketsOverSourcePacketRate) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18118;
+  const std::vector<char> payload(30000, 'p');
+
+  Session session("239.255.0.31", kPort, 4268);
+  LibFlute::Receiver::AdmissionLimits limits;
+  limits.max_source_packet_rate = 10;
+  session.receiver->admission_limits(limits);
+  std::atomic<size_t> received{0};
+  session.receiver->register_completion_callback([&received](const std::shared_ptr<LibFlute::File>&) { received++; });
+  auto transmitted = session.files_transmitted(1);
+
+  session.start();
+  session.transmitter->send(std::make_shared<LibFlute::Transmitter::FileDescription>("packets.bin", payload));
+  const auto transmitted_ready = transmitted.wait_for(5s);
+  std::this_thread::sleep_for(200ms);
+  session.stop();
+
+  ASSERT_EQ(transmitted_ready, std::future_status::ready);
+  EXPECT_GT(session.receiver->statistics().packets_rate_limited, 0u);
+  EXPECT_EQ(received, 0u);
+}
+
+TEST(FluteEndToEndTest, ReceiverDropsPacketsOverSourceByteRate) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18119;
+  const std::vector<char> payload(30000, 'b');
+
+  Session session("239.255.0.32", kPort, 4269);
+  LibFlute::Receiver::AdmissionLimits limits;
+  limits.max_source_byte_rate = 10000;
+  session.receiver->admission_limits(limits);
+  std::atomic<size_t> received{0};
+  session.receiver->register_completion_callback([&received](const std::shared_ptr<LibFlute::File>&) { received++; });
+  auto transmitted = session.files_transmitted(1);
+
+  session.start();
+  session.transmitter->send(std::make_shared<LibFlute::Transmitter::FileDescription>("bytes.bin", payload));
+  const auto transmitted_ready = transmitted.wait_for(5s);
+  std::this_thread::sleep_for(200ms);
+  session.stop();
+
+  ASSERT_EQ(transmitted_ready, std::future_status::ready);
+  EXPECT_GT(session.receiver->statistics().packets_rate_limited, 0u);
+  EXPECT_EQ(received, 0u);
+}
+
+TEST(FluteEndToEndTest, ReceiverMergesRedundantPaths) {
+  using namespace std::chrono_literals;
+
+  constexpr short kSourcePort = 18095;
+  constexpr short kPathPort = 18096;
+  const std::vector<char> payload(30000, 'r');
+
+  Session session;
+  session.receiver = std::make_unique<LibFlute::Receiver>(
+      std::vector<LibFlute::Receiver::ReceivePath>{{"0.0.0.0", "239.255.0.6"}, {"0.0.0.0", "239.255.0.7"}},
+      kPathPort, 4246, session.receiver_io);
+  session.transmitter = std::make_unique<LibFlute::Transmitter>(
+      "239.255.0.5", kSourcePort, 4246, 1400, 0, session.transmitter_io);
+
+  Relay relay(session.transmitter_io, "239.255.0.5", kSourcePort, {"239.255.0.6", ""}, {"239.255.0.7", ""}, kPathPort);
+
+  auto received_future = session.first_received_file();
+  session.start();
+  session.transmitter->send(std::make_shared<LibFlute::Transmitter::FileDescription>("merged.bin", payload));
+
+  const auto received_ready = received_future.wait_for(5s);
+  session.stop();
+
+  ASSERT_EQ(received_ready, std::future_status::ready);
+  const auto file = received_future.get();
+  ASSERT_EQ(file->length(), payload.size());
+  EXPECT_EQ(std::string(file->buffer(), file->length()), std::string(payload.begin(), payload.end()));
+
+  const auto stats = session.receiver->statistics();
+  ASSERT_EQ(stats.paths.size(), 2u);
+  EXPECT_EQ(stats.paths[0].address, "239.255.0.6");
+  EXPECT_GT(stats.paths[0].symbols_used, 0u);
+  EXPECT_GT(stats.paths[1].symbols_used, 0u);
+  EXPECT_GT(stats.symbols_duplicate, 0u);
+}
+
+TEST(FluteEndToEndTest, ReceiverMergesPathsOnDistinctInterfaces) {
+  using namespace std::chrono_literals;
+
+  constexpr short kSourcePort = 18113;
+  constexpr short kPathPort = 18114;
+  const std::vector<char> payload(30000, 'i');
+  const auto primary = primary_interface_address();
+  if (primary.empty()) {
+    GTEST_SKIP() << "No multicast capable interface besides loopback";
+  }
+
+  // Each path arrives on an interface of its own
+  Session session;
+  session.receiver = std::make_unique<LibFlute::Receiver>(
+      std::vector<LibFlute::Receiver::ReceivePath>{{"127.0.0.1", "239.255.0.25"}, {primary, "239.255.0.26"}},
+      kPathPort, 4264, session.receiver_io);
+  session.transmitter = std::make_unique<LibFlute::Transmitter>(
+      "239.255.0.27", kSourcePort, 4264, 1400, 0, session.transmitter_io);
+  Relay relay(session.transmitter_io, "239.255.0.27", kSourcePort, {"239.255.0.25", "127.0.0.1"},
+      {"239.255.0.26", primary}, kPathPort);
+
+  auto received_future = session.first_received_file();
+  session.start();
+  session.transmitter->send(std::make_shared<LibFlute::Transmitter::FileDescription>("interfaces.bin", payload));
+
+  const auto received_ready = received_future.wait_for(5s);
+  session.stop();
+
+  ASSERT_EQ(received_ready, std::future_status::ready);
+  const auto file = received_future.get();
+  EXPECT_EQ(std::string(file->buffer(), file->length()), std::string(payload.begin(), payload.end()));
+
+  const auto stats = session.receiver->statistics();
+  ASSERT_EQ(stats.paths.size(), 2u);
+  EXPECT_GT(stats.paths[0].symbols_used, 0u);
+  EXPECT_GT(stats.paths[1].symbols_used, 0u);
+}
+
+TEST(FluteEndToEndTest, TransmitsBatchedPackets) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18097;
+  std::vector<char> payload(200000);
+  for (size_t i = 0; i < payload.size(); i++) payload[i] = static_cast<char>(i * 7);
+
+  Session session("239.255.0.8", kPort, 4247);
+  session.transmitter->send_batch_size(16);
+  EXPECT_EQ(session.transmitter->send_batch_size(), 16u);
+
+  auto received_future = session.first_received_file();
+  auto transmitted = session.files_transmitted(1);
+  session.start();
+  session.transmitter->send(std::make_shared<LibFlute::Transmitter::FileDescription>("batched.bin", payload));
+
+  const auto transmitted_ready = transmitted.wait_for(5s);
+  const auto received_ready = received_future.wait_for(5s);
+  session.stop();
+
+  ASSERT_EQ(transmitted_ready, std::future_status::ready);
+  ASSERT_EQ(received_ready, std::future_status::ready);
+  const auto file = received_future.get();
+  ASSERT_EQ(file->length(), payload.size());
+  EXPECT_EQ(std::string(file->buffer(), file->length()), std::string(payload.begin(), payload.end()));
+
+  const auto stats = session.transmitter->statistics();
+  EXPECT_GT(stats.packets_sent, payload.size() / 1400);
+  EXPECT_LT(stats.send_calls, stats.packets_sent);
+}
+
+TEST(FluteEndToEndTest, TransmitsWithSegmentationOffload) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18098;
+  std::vector<char> payload(100000);
+  for (size_t i = 0; i < payload.size(); i++) payload[i] = static_cast<char>(i * 13);
+
+  Session session("239.255.0.9", kPort, 4248);
+  session.transmitter->send_batch_size(32).udp_gso(true);
+
+  auto received_future = session.first_received_file();
+  session.start();
+  session.transmitter->send(std::make_shared<LibFlute::Transmitter::FileDescription>("segmented.bin", payload));
+
+  // Falls back to individual packets where segmentation offload is not supported, either way the file must arrive
+  const auto received_ready = received_future.wait_for(5s);
+  session.stop();
+
+  ASSERT_EQ(received_ready, std::future_status::ready);
+  const auto file = received_future.get();
+  ASSERT_EQ(file->length(), payload.size());
+  EXPECT_EQ(std::string(file->buffer(), file->length()), std::string(payload.begin(), payload.end()));
+  const auto stats = session.transmitter->statistics();
+  EXPECT_LT(stats.send_calls, stats.packets_sent);
+}
+
+TEST(FluteEndToEndTest, PacedTransmissionHoldsRate) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18099;
+  constexpr uint32_t kRateKbps = 50000;
+  const std::vector<char> payload(4 * 1024 * 1024, 'p');
+
+  // No receiver, the rate is measured at the transmitter
+  Session session;
+  session.transmitter = std::make_unique<LibFlute::Transmitter>(
+      "239.255.0.10", kPort, 4249, 1400, kRateKbps, session.transmitter_io);
+  auto& transmitter = *session.transmitter;
+
+  // Keep the transmitter busy by sending the file again whenever it completes
+  auto file_description = std::make_shared<LibFlute::Transmitter::FileDescription>("paced.bin", payload);
+  transmitter.register_completion_callback([&transmitter, &file_description](uint32_t) {
+    transmitter.send(file_description);
+  });
+  transmitter.send(file_description);
+  session.start();
+
+  std::this_thread::sleep_for(1s);
+  const auto start_bytes = transmitter.statistics().bytes_sent;
+  const auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(10s);
+  const auto end_bytes = transmitter.statistics().bytes_sent;
+  const auto end = std::chrono::steady_clock::now();
+  session.stop();
+
+  const double seconds = std::chrono::duration<double>(end - start).count();
+  const double achieved_kbps = (end_bytes - start_bytes) * 8.0 / seconds / 1000.0;
+  EXPECT_NEAR(achieved_kbps, kRateKbps, kRateKbps * 0.01);
+}
+
+TEST(FluteEndToEndTest, TunnelsPacketsWithValidHeaders) {
+  using namespace std::chrono_literals;
+
+  constexpr short kTunnelPort = 18101;
+  constexpr short kPort = 18102;
+  std::vector<char> payload(100001);
+  for (size_t i = 0; i < payload.size(); i++) payload[i] = static_cast<char>(i * 11);
+
+  Session session;
+  session.receiver = std::make_unique<LibFlute::Receiver>("0.0.0.0", "239.255.0.12", kPort, 4251, session.receiver_io);
+  const boost::asio::ip::udp::endpoint tunnel(boost::asio::ip::make_address("127.0.0.1"), kTunnelPort);
+  session.transmitter = std::make_unique<LibFlute::Transmitter>(
+      "239.255.0.12", kPort, 4251, 1400, 0, session.transmitter_io, tunnel);
+
+  // Terminate the tunnel: check the IP and UDP headers and forward the inner packet to the receiver
+  boost::asio::ip::udp::socket tunnel_in(session.transmitter_io, tunnel);
+  boost::asio::ip::udp::socket tunnel_out(session.transmitter_io, boost::asio::ip::udp::v4());
+  tunnel_out.set_option(boost::asio::ip::multicast::enable_loopback(true));
+  const boost::asio::ip::udp::endpoint destination(boost::asio::ip::make_address("239.255.0.12"), kPort);
+
+  uint8_t tunnel_buffer[2048];
+  boost::asio::ip::udp::endpoint tunnel_sender;
+  size_t tunnelled = 0;
+  size_t invalid = 0;
+  std::function<void(const boost::system::error_code&, size_t)> decapsulate =
+      [&](const boost::system::error_code& error, size_t length) {
+        if (error) return;
+        tunnelled++;
+        const std::vector<uint8_t> ip_header(tunnel_buffer, tunnel_buffer + 20);
+        // UDP pseudo header followed by the UDP header and payload
+        std::vector<uint8_t> udp(tunnel_buffer + 12, tunnel_buffer + 20);
+        udp.insert(udp.end(), {0, tunnel_buffer[9], tunnel_buffer[24], tunnel_buffer[25]});
+        udp.insert(udp.end(), tunnel_buffer + 20, tunnel_buffer + length);
+        const size_t total_length = (tunnel_buffer[2] << 8) | tunnel_buffer[3];
+        const unsigned port = (tunnel_buffer[22] << 8) | tunnel_buffer[23];
+        if (length < 28 || tunnel_buffer[0] != 0x45 || total_length != length || port != static_cast<unsigned>(kPort) ||
+            reference_checksum(ip_header) != 0 || reference_checksum(udp) != 0) {
+          invalid++;
+        } else {
+          tunnel_out.send_to(boost::asio::buffer(tunnel_buffer + 28, length - 28), destination);
+        }
+        tunnel_in.async_receive_from(boost::asio::buffer(tunnel_buffer), tunnel_sender, decapsulate);
+      };
+  tunnel_in.async_receive_from(boost::asio::buffer(tunnel_buffer), tunnel_sender, decapsulate);
+
+  auto received_future = session.first_received_file();
+  session.start();
+  session.transmitter->send(std::make_shared<LibFlute::Transmitter::FileDescription>("tunnelled.bin", payload));
+
+  const auto received_ready = received_future.wait_for(5s);
+  session.stop();
+
+  ASSERT_EQ(received_ready, std::future_status::ready);
+  const auto file = received_future.get();
+  ASSERT_EQ(file->length(), payload.size());
+  EXPECT_EQ(std::string(file->buffer(), file->length()), std::string(payload.begin(), payload.end()));
+  EXPECT_GT(tunnelled, payload.size() / 1400);
+  EXPECT_EQ(invalid, 0u);
+}
+
+TEST(FluteEndToEndTest, TransmitsWithZeroCopy) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18103;
+  std::vector<char> payload(300000);
+  for (size_t i = 0; i < payload.size(); i++) payload[i] = static_cast<char>(i * 5);
+
+  Session session("239.255.0.13", kPort, 4252);
+  session.transmitter->send_batch_size(8);
+  session.transmitter->zerocopy(true);
+  if (!session.transmitter->zerocopy()) {
+    GTEST_SKIP() << "MSG_ZEROCOPY is not available";
+  }
+
+  auto received_future = session.first_received_file();
+  // Only ready once the kernel has released all packets of the file
+  auto transmitted = session.files_transmitted(1);
+  session.start();
+  session.transmitter->send(std::make_shared<LibFlute::Transmitter::FileDescription>("zerocopy.bin", payload));
+
+  const auto transmitted_ready = transmitted.wait_for(5s);
+  const auto received_ready = received_future.wait_for(5s);
+  session.stop();
+
+  ASSERT_EQ(transmitted_ready, std::future_status::ready);
+  ASSERT_EQ(received_ready, std::future_status::ready);
+  const auto file = received_future.get();
+  ASSERT_EQ(file->length(), payload.size());
+  EXPECT_EQ(std::string(file->buffer(), file->length()), std::string(payload.begin(), payload.end()));
+
+  const auto stats = session.transmitter->statistics();
+  EXPECT_GT(stats.packets_sent, payload.size() / 1400);
+  EXPECT_LE(stats.zerocopy_copied, stats.packets_sent);
+}
+
+TEST(FluteEndToEndTest, SendsUrgentFileAheadOfBulkFile) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18104;
+  std::vector<char> bulk_payload(4 * 1024 * 1024, 'b');
+  std::vector<char> urgent_payload(30000);
+  for (size_t i = 0; i < urgent_payload.size(); i++) urgent_payload[i] = static_cast<char>(i * 11);
+
+  Session session("239.255.0.14", kPort, 4253, 20000);
+  auto& transmitter = *session.transmitter;
+
+  std::promise<std::shared_ptr<LibFlute::File>> urgent_promise;
+  session.receiver->register_completion_callback([&urgent_promise](const std::shared_ptr<LibFlute::File>& file) {
+    if (file->meta().content_location == "urgent.bin") urgent_promise.set_value(file);
+  });
+  std::mutex order_mutex;
+  std::vector<std::string> transmitted;
+  std::map<uint32_t, std::string> locations;
+  transmitter.register_completion_callback([&](uint32_t toi) {
+    std::lock_guard<std::mutex> guard(order_mutex);
+    transmitted.push_back(locations[toi]);
+  });
+  session.start();
+
+  // The bulk file takes about 1.7 s at 20 Mbit/s, queue the urgent one once it is under way
+  auto bulk = std::make_shared<LibFlute::Transmitter::FileDescription>("bulk.bin", bulk_payload);
+  auto urgent = std::make_shared<LibFlute::Transmitter::FileDescription>("urgent.bin", urgent_payload);
+  urgent->set_priority(1);
+  EXPECT_EQ(urgent->get_priority(), 1u);
+  {
+    std::lock_guard<std::mutex> guard(order_mutex);
+    locations[transmitter.send(bulk)] = "bulk.bin";
+  }
+  std::this_thread::sleep_for(200ms);
+  const auto urgent_queued = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> guard(order_mutex);
+    locations[transmitter.send(urgent)] = "urgent.bin";
+  }
+
+  auto urgent_future = urgent_promise.get_future();
+  const auto urgent_ready = urgent_future.wait_for(5s);
+  const auto urgent_latency = std::chrono::steady_clock::now() - urgent_queued;
+  session.stop();
+
+  ASSERT_EQ(urgent_ready, std::future_status::ready);
+  const auto file = urgent_future.get();
+  ASSERT_EQ(file->length(), urgent_payload.size());
+  EXPECT_EQ(std::string(file->buffer(), file->length()), std::string(urgent_payload.begin(), urgent_payload.end()));
+  // 30 kB take 12 ms at 20 Mbit/s, in FIFO order the urgent file would wait for the rest of the bulk file
+  EXPECT_LT(urgent_latency, 500ms);
+  std::lock_guard<std::mutex> guard(order_mutex);
+  ASSERT_FALSE(transmitted.empty());
+  EXPECT_EQ(transmitted.front(), "urgent.bin");
+}
+
+TEST(FluteEndToEndTest, CarouselRepeatsFilesForLateReceivers) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18105;
+  constexpr auto kInterval = 200ms;
+  std::vector<char> payload(50000);
+  for (size_t i = 0; i < payload.size(); i++) payload[i] = static_cast<char>(i * 3);
+
+  Session session;
+  session.transmitter = std::make_unique<LibFlute::Transmitter>("239.255.0.15", kPort, 4254, 1400, 0, session.transmitter_io);
+  auto& transmitter = *session.transmitter;
+  std::atomic<unsigned> rounds{0};
+  std::promise<void> first_round_promise;
+  transmitter.register_completion_callback([&rounds, &first_round_promise](uint32_t) {
+    if (rounds++ == 0) first_round_promise.set_value();
+  });
+
+  auto file_description = std::make_shared<LibFlute::Transmitter::FileDescription>("carousel.bin", payload);
+  file_description->set_carousel_interval(kInterval);
+  const auto start = std::chrono::steady_clock::now();
+  const auto toi = transmitter.send(file_description);
+  session.start();
+
+  // A receiver joining after the first round still gets the file from a later one
+  ASSERT_EQ(first_round_promise.get_future().wait_for(2s), std::future_status::ready);
+  session.receiver = std::make_unique<LibFlute::Receiver>("0.0.0.0", "239.255.0.15", kPort, 4254, session.receiver_io);
+  auto received_future = session.first_received_file();
+
+  const auto received_ready = received_future.wait_for(8s);
+  const auto files_queued = transmitter.number_of_files();
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const unsigned rounds_before_remove = rounds;
+
+  EXPECT_TRUE(transmitter.remove(toi));
+  EXPECT_EQ(transmitter.number_of_files(), 0u);
+  std::this_thread::sleep_for(2 * kInterval);
+  const unsigned rounds_after_remove = rounds;
+  session.stop();
+
+  ASSERT_EQ(received_ready, std::future_status::ready);
+  const auto file = received_future.get();
+  ASSERT_EQ(file->length(), payload.size());
+  EXPECT_EQ(std::string(file->buffer(), file->length()), std::string(payload.begin(), payload.end()));
+  EXPECT_EQ(files_queued, 1u);
+
+  // Rounds start no more often than the interval, and not much less often on an otherwise idle transmitter
+  const auto max_rounds = static_cast<unsigned>(elapsed / kInterval) + 1;
+  EXPECT_LE(rounds_before_remove, max_rounds);
+  EXPECT_GE(rounds_before_remove, max_rounds / 2);
+  EXPECT_LE(rounds_after_remove, rounds_before_remove + 1);
+}
+
+TEST(FluteEndToEndTest, MultiplexedSessionsShareAggregateRate) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18106;
+  constexpr uint32_t kRateKbps = 30000;
+  std::vector<char> payload(1024 * 1024);
+  for (size_t i = 0; i < payload.size(); i++) payload[i] = static_cast<char>(i * 5);
+
+  Session session;
+  LibFlute::SessionMultiplexer multiplexer(session.transmitter_io, kRateKbps);
+  std::vector<std::unique_ptr<LibFlute::Transmitter>> sessions;
+  const std::vector<unsigned> weights = {1, 2, 1};
+  for (size_t i = 0; i < weights.size(); i++) {
+    sessions.push_back(std::make_unique<LibFlute::Transmitter>(
+        multiplexer, "239.255.0." + std::to_string(16 + i), kPort, 4255 + i, 1400));
+    sessions.back()->session_weight(weights[i]);
+  }
+  EXPECT_EQ(sessions[1]->session_weight(), 2u);
+  EXPECT_EQ(sessions[0]->rate_limit(), kRateKbps);
+
+  session.receiver = std::make_unique<LibFlute::Receiver>("0.0.0.0", "239.255.0.17", kPort, 4256, session.receiver_io);
+  auto received_future = session.first_received_file();
+
+  // Every session has a file in the carousel, so that all of them always have packets to send
+  for (auto& tsi : sessions) {
+    auto file_description = std::make_shared<LibFlute::Transmitter::FileDescription>("mux.bin", payload);
+    file_description->set_carousel_interval(0ms);
+    tsi->send(file_description);
+  }
+  session.start();
+
+  const auto received_ready = received_future.wait_for(5s);
+
+  std::vector<uint64_t> start_bytes;
+  for (auto& tsi : sessions) start_bytes.push_back(tsi->statistics().bytes_sent);
+  const auto start_total = multiplexer.statistics().bytes_sent;
+  const auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(3s);
+  std::vector<uint64_t> end_bytes;
+  for (auto& tsi : sessions) end_bytes.push_back(tsi->statistics().bytes_sent);
+  const auto end_total = multiplexer.statistics().bytes_sent;
+  const auto end = std::chrono::steady_clock::now();
+
+  for (auto& tsi : sessions) tsi->deactivate();
+  session.stop();
+
+  ASSERT_EQ(received_ready, std::future_status::ready);
+  const auto file = received_future.get();
+  ASSERT_EQ(file->length(), payload.size());
+  EXPECT_EQ(std::string(file->buffer(), file->length()), std::string(payload.begin(), payload.end()));
+
+  // The sessions together are held to the rate limit of the multiplexer, and share it by their weights
+  const double seconds = std::chrono::duration<double>(end - start).count();
+  const double achieved_kbps = (end_total - start_total) * 8.0 / seconds / 1000.0;
+  EXPECT_NEAR(achieved_kbps, kRateKbps, kRateKbps * 0.02);
+  uint64_t session_total = 0;
+  for (size_t i = 0; i < sessions.size(); i++) session_total += end_bytes[i] - start_bytes[i];
+  for (size_t i = 0; i < sessions.size(); i++) {
+    const double share = static_cast<double>(end_bytes[i] - start_bytes[i]) / session_total;
+    EXPECT_NEAR(share, weights[i] / 4.0, 0.02);
+  }
+}
+
+TEST(FluteEndToEndTest, WorkerThreadsKeepObjectOrder) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18107;
+  constexpr size_t kFiles = 6;
+  std::vector<std::vector<char>> payloads;
+  for (size_t f = 0; f < kFiles; f++) {
+    payloads.emplace_back(200000 + f * 1000);
+    for (size_t i = 0; i < payloads[f].size(); i++) payloads[f][i] = static_cast<char>(i * (f + 3));
+  }
+
+  Session session("239.255.0.19", kPort, 4258, 40000);
+  session.transmitter->send_batch_size(8).worker_threads(3);
+  EXPECT_EQ(session.transmitter->worker_threads(), 3u);
+
+  // Record the encoding symbol IDs of every object in the order they arrive
+  std::map<uint64_t, std::vector<uint32_t>> symbol_ids;
+  Sniffer sniffer(session.receiver_io, "239.255.0.19", kPort, [&](const LibFlute::AlcPacket& alc, const char* data) {
+        if (alc.toi() != 0) {
+          const auto fec_payload_id = reinterpret_cast<const uint8_t*>(data + alc.header_length());
+          symbol_ids[alc.toi()].push_back((fec_payload_id[0] << 24) | (fec_payload_id[1] << 16) |
+                                          (fec_payload_id[2] << 8) | fec_payload_id[3]);
+        }
+      });
+
+  std::mutex received_mutex;
+  std::map<std::string, std::string> received;
+  std::promise<void> all_received;
+  session.receiver->register_completion_callback([&](const std::shared_ptr<LibFlute::File>& file) {
+        std::lock_guard<std::mutex> guard(received_mutex);
+        received[file->meta().content_location] = std::string(file->buffer(), file->length());
+        if (received.size() == kFiles) all_received.set_value();
+      });
+
+  std::atomic<size_t> transmitted = 0;
+  session.transmitter->register_completion_callback([&transmitted](uint32_t) { transmitted++; });
+  session.start();
+
+  for (size_t f = 0; f < kFiles; f++) {
+    session.transmitter->send(std::make_shared<LibFlute::Transmitter::FileDescription>(
+        "worker" + std::to_string(f) + ".bin", payloads[f]));
+  }
+
+  auto received_future = all_received.get_future();
+  const auto received_ready = received_future.wait_for(5s);
+  std::this_thread::sleep_for(100ms);
+  session.stop();
+
+  ASSERT_EQ(received_ready, std::future_status::ready);
+  for (size_t f = 0; f < kFiles; f++) {
+    const auto& content = received["worker" + std::to_string(f) + ".bin"];
+    EXPECT_EQ(content, std::string(payloads[f].begin(), payloads[f].end()));
+  }
+  // Completion callbacks are invoked on the io_context thread once the workers have sent the files
+  EXPECT_EQ(transmitted, kFiles);
+
+  // Each object goes out through one worker only, so its symbols arrive in order
+  EXPECT_EQ(symbol_ids.size(), kFiles);
+  for (const auto& object : symbol_ids) {
+    EXPECT_TRUE(std::is_sorted(object.second.begin(), object.second.end())) << "TOI " << object.first;
+  }
+}
+
+TEST(FluteEndToEndTest, CompressesFilesInTheBackground) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18108;
+  std::string text;
+  for (int i = 0; text.size() < 2 * 1024 * 1024; i++) text += "compressible line " + std::to_string(i % 977) + "\n";
+  const std::vector<char> payload(text.begin(), text.end());
+
+  Session session("239.255.0.20", kPort, 4259);
+  auto& transmitter = *session.transmitter;
+
+  std::mutex received_mutex;
+  std::map<std::string, std::shared_ptr<LibFlute::File>> received;
+  std::promise<void> all_received;
+  session.receiver->register_completion_callback([&](const std::shared_ptr<LibFlute::File>& file) {
+        std::lock_guard<std::mutex> guard(received_mutex);
+        received[file->meta().content_location] = file;
+        if (received.size() == 2) all_received.set_value();
+      });
+  session.start();
+
+  auto gzip = std::make_shared<LibFlute::Transmitter::FileDescription>("text.gz", payload);
+  gzip->set_compression(LibFlute::Transmitter::FileDescription::COMPRESSION_GZIP);
+  auto deflate = std::make_shared<LibFlute::Transmitter::FileDescription>("text.zz", payload);
+  deflate->set_compression(LibFlute::Transmitter::FileDescription::COMPRESSION_DEFLATE);
+  boost::asio::post(session.transmitter_io, [&]() {
+        transmitter.send(gzip);
+        transmitter.send(deflate);
+      });
+
+  auto received_future = all_received.get_future();
+  const auto received_ready = received_future.wait_for(5s);
+  const auto stats = transmitter.statistics();
+  session.stop();
+
+  ASSERT_EQ(received_ready, std::future_status::ready);
+  for (const auto& location : {"text.gz", "text.zz"}) {
+    const auto& file = received[location];
+    ASSERT_EQ(file->length(), payload.size()) << location;
+    EXPECT_EQ(std::string(file->buffer(), file->length()), text) << location;
+  }
+  EXPECT_EQ(received["text.gz"]->meta().content_encoding, "gzip");
+  EXPECT_EQ(received["text.zz"]->meta().content_encoding, "deflate");
+  // Only the compressed data went out
+  EXPECT_LT(stats.bytes_sent, payload.size());
+}
+
+TEST(FluteEndToEndTest, AnnouncesBatchInOneFdtInstance) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18109;
+  constexpr size_t kPlainFiles = 40;
+  std::vector<std::vector<char>> payloads;
+  for (size_t f = 0; f < kPlainFiles + 2; f++) {
+    payloads.emplace_back(3000 + f * 100);
+    for (size_t i = 0; i < payloads[f].size(); i++) payloads[f][i] = static_cast<char>('a' + (i * (f + 1)) % 26);
+  }
+
+  Session session("239.255.0.21", kPort, 4260);
+  auto& transmitter = *session.transmitter;
+
+  // Record the FDT instance IDs going out. The files stay in the carousel, so no FDT update removes them.
+  std::mutex sniff_mutex;
+  std::set<uint32_t> fdt_instances;
+  Sniffer sniffer(session.receiver_io, "239.255.0.21", kPort, [&](const LibFlute::AlcPacket& alc, const char*) {
+        if (alc.toi() == 0 && !alc.close_session()) {
+          std::lock_guard<std::mutex> guard(sniff_mutex);
+          fdt_instances.insert(alc.fdt_instance_id());
+        }
+      });
+
+  std::mutex received_mutex;
+  std::map<std::string, std::string> received;
+  std::promise<void> plain_received;
+  std::promise<void> all_received;
+  session.receiver->register_completion_callback([&](const std::shared_ptr<LibFlute::File>& file) {
+        std::lock_guard<std::mutex> guard(received_mutex);
+        if (!received.emplace(file->meta().content_location, std::string(file->buffer(), file->length())).second) {
+          return;
+        }
+        if (received.size() == kPlainFiles) plain_received.set_value();
+        if (received.size() == kPlainFiles + 2) all_received.set_value();
+      });
+  session.start();
+
+  std::vector<std::shared_ptr<LibFlute::Transmitter::FileDescription>> plain;
+  for (size_t f = 0; f < kPlainFiles; f++) {
+    plain.push_back(std::make_shared<LibFlute::Transmitter::FileDescription>(
+        "batch" + std::to_string(f) + ".bin", payloads[f]));
+    plain.back()->set_carousel_interval(10s);
+  }
+  const auto tois = transmitter.send(plain);
+  ASSERT_EQ(tois.size(), kPlainFiles);
+  for (size_t f = 1; f < kPlainFiles; f++) EXPECT_EQ(tois[f], tois[0] + f);
+
+  auto plain_future = plain_received.get_future();
+  const auto plain_ready = plain_future.wait_for(5s);
+  std::set<uint32_t> first_instances;
+  {
+    std::lock_guard<std::mutex> guard(sniff_mutex);
+    first_instances = fdt_instances;
+  }
+
+  // A batch with compressed files is queued once all of them have been compressed
+  std::vector<std::shared_ptr<LibFlute::Transmitter::FileDescription>> compressed;
+  for (size_t f = kPlainFiles; f < kPlainFiles + 2; f++) {
+    compressed.push_back(std::make_shared<LibFlute::Transmitter::FileDescription>(
+        "batch" + std::to_string(f) + ".bin", payloads[f]));
+    compressed.back()->set_compression(f % 2 ? LibFlute::Transmitter::FileDescription::COMPRESSION_GZIP
+                                             : LibFlute::Transmitter::FileDescription::COMPRESSION_DEFLATE);
+    compressed.back()->set_carousel_interval(10s);
+  }
+  EXPECT_EQ(transmitter.send(compressed).size(), 2u);
+
+  auto all_future = all_received.get_future();
+  const auto all_ready = all_future.wait_for(5s);
+  session.stop();
+
+  ASSERT_EQ(plain_ready, std::future_status::ready);
+  ASSERT_EQ(all_ready, std::future_status::ready);
+  for (size_t f = 0; f < kPlainFiles + 2; f++) {
+    EXPECT_EQ(received["batch" + std::to_string(f) + ".bin"], std::string(payloads[f].begin(), payloads[f].end()));
+  }
+  EXPECT_EQ(first_instances.size(), 1u);
+  EXPECT_EQ(fdt_instances.size(), 2u);
+}
+
+TEST(FluteEndToEndTest, SplitsLargeFdtIntoPartialInstances) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18110;
+  constexpr size_t kFiles = 60;
+  std::vector<std::vector<char>> payloads;
+  for (size_t f = 0; f < kFiles; f++) {
+    payloads.emplace_back(2000 + f * 10);
+    for (size_t i = 0; i < payloads[f].size(); i++) payloads[f][i] = static_cast<char>(i * (f + 7));
+  }
+
+  Session session("239.255.0.22", kPort, 4261);
+  session.transmitter->fdt_partition_size(2000);
+  EXPECT_EQ(session.transmitter->fdt_partition_size(), 2000u);
+
+  // Record the size of every FDT instance going out
+  std::mutex sniff_mutex;
+  std::map<uint32_t, uint64_t> fdt_instances;
+  Sniffer sniffer(session.receiver_io, "239.255.0.22", kPort, [&](const LibFlute::AlcPacket& alc, const char*) {
+        if (alc.toi() == 0 && !alc.close_session()) {
+          std::lock_guard<std::mutex> guard(sniff_mutex);
+          fdt_instances[alc.fdt_instance_id()] = alc.fec_oti().transfer_length;
+        }
+      });
+
+  std::mutex received_mutex;
+  std::map<std::string, std::string> received;
+  std::promise<void> all_received;
+  session.receiver->register_completion_callback([&](const std::shared_ptr<LibFlute::File>& file) {
+        std::lock_guard<std::mutex> guard(received_mutex);
+        if (received.emplace(file->meta().content_location, std::string(file->buffer(), file->length())).second &&
+            received.size() == kFiles) {
+          all_received.set_value();
+        }
+      });
+  session.start();
+
+  std::vector<std::shared_ptr<LibFlute::Transmitter::FileDescription>> files;
+  for (size_t f = 0; f < kFiles; f++) {
+    files.push_back(std::make_shared<LibFlute::Transmitter::FileDescription>(
+        "partitioned/file" + std::to_string(f) + ".bin", payloads[f]));
+    files.back()->set_carousel_interval(200ms);
+  }
+  session.transmitter->send(files);
+
+  auto received_future = all_received.get_future();
+  const auto received_ready = received_future.wait_for(5s);
+  session.stop();
+
+  ASSERT_EQ(received_ready, std::future_status::ready);
+  for (size_t f = 0; f < kFiles; f++) {
+    EXPECT_EQ(received["partitioned/file" + std::to_string(f) + ".bin"],
+              std::string(payloads[f].begin(), payloads[f].end()));
+  }
+  // The entries are spread over several partial instances, none much larger than the partition size
+  EXPECT_GT(fdt_instances.size(), 3u);
+  for (const auto& instance : fdt_instances) {
+    EXPECT_LT(instance.second, 2000u + 400u) << "FDT instance " << instance.first;
+  }
+}
+
+TEST(FluteEndToEndTest, ReceivesFromRestartedSenderReusingFdtInstanceIds) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18116;
+  const std::vector<char> payload(3000, 'x');
+  const std::vector<char> new_payload(3000, 'y');
+
+  Session session("239.255.0.29", kPort, 4266);
+  std::mutex received_mutex;
+  std::vector<std::string> received;
+  std::promise<void> first_received;
+  std::promise<void> new_received;
+  session.receiver->register_completion_callback([&](const std::shared_ptr<LibFlute::File>& file) {
+        std::lock_guard<std::mutex> guard(received_mutex);
+        received.emplace_back(file->buffer(), file->length());
+        if (received.size() == 2) first_received.set_value();
+        if (received.size() == 3) new_received.set_value();
+      });
+  session.start();
+
+  // FDT instances 1 and 2, announcing TOIs 1 and 2
+  session.transmitter->send(std::make_shared<LibFlute::Transmitter::FileDescription>("a.bin", payload));
+  session.transmitter->send(std::make_shared<LibFlute::Transmitter::FileDescription>("b.bin", payload));
+  const auto first_ready = first_received.get_future().wait_for(5s);
+
+  // A new sender on the session starts its FDT instance IDs over, with a later expiry. Its instance 1 announces a
+  // TOI that has not been seen yet.
+  std::this_thread::sleep_for(1100ms);
+  LibFlute::Transmitter restarted("239.255.0.29", kPort, 4266, 1400, 0, session.transmitter_io);
+  restarted.send(std::vector<std::shared_ptr<LibFlute::Transmitter::FileDescription>>{
+      std::make_shared<LibFlute::Transmitter::FileDescription>("a.bin", payload),
+      std::make_shared<LibFlute::Transmitter::FileDescription>("b.bin", payload),
+      std::make_shared<LibFlute::Transmitter::FileDescription>("c.bin", new_payload)});
+  const auto new_ready = new_received.get_future().wait_for(5s);
+
+  restarted.deactivate();
+  session.stop();
+
+  ASSERT_EQ(first_ready, std::future_status::ready);
+  ASSERT_EQ(new_ready, std::future_status::ready);
+  EXPECT_EQ(received.size(), 3u);
+  EXPECT_EQ(received[2], std::string(new_payload.begin(), new_payload.end()));
+}
+
+TEST(FluteEndToEndTest, TransmitsGrowingObjectWhileItIsWritten) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18111;
+  constexpr size_t kChunks = 8;
+  constexpr size_t kChunkSize = 5000;
+  constexpr size_t kSymbolLength = 1336;  // Encoding symbol length for an MTU of 1400
+  std::string payload;
+  for (size_t i = 0; i < kChunks * kChunkSize + 123; i++) payload += static_cast<char>('a' + (i * 7) % 26);
+
+  Session session("239.255.0.23", kPort, 4262);
+
+  // Count the packets of the object and note the transfer length signalled in EXT_FTI
+  std::atomic<size_t> object_packets{0};
+  std::atomic<uint64_t> signalled_length{0};
+  Sniffer sniffer(session.receiver_io, "239.255.0.23", kPort, [&](const LibFlute::AlcPacket& alc, const char*) {
+        if (alc.toi() != 0 && !alc.close_object() && !alc.close_session()) {
+          object_packets++;
+          if (alc.fec_oti().transfer_length) signalled_length = alc.fec_oti().transfer_length;
+        }
+      });
+
+  auto received_future = session.first_received_file();
+  session.start();
+
+  auto description = std::make_shared<LibFlute::Transmitter::FileDescription>("live/segment.m4s");
+  description->set_growing(1024 * 1024);
+  session.transmitter->send(description);
+
+  // The chunks go out while the object is still being written
+  for (size_t c = 0; c < kChunks; c++) {
+    description->append(payload.data() + c * kChunkSize, kChunkSize);
+    std::this_thread::sleep_for(20ms);
+  }
+  const auto deadline = std::chrono::steady_clock::now() + 2s;
+  while (object_packets < (kChunks * kChunkSize) / kSymbolLength && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(5ms);
+  }
+  const size_t packets_before_finalize = object_packets;
+  EXPECT_EQ(signalled_length, 0u);
+
+  description->append(payload.data() + kChunks * kChunkSize, 123);
+  description->finalize();
+
+  const auto received_ready = received_future.wait_for(5s);
+  session.stop();
+
+  EXPECT_GE(packets_before_finalize, (kChunks * kChunkSize) / kSymbolLength);
+  ASSERT_EQ(received_ready, std::future_status::ready);
+  const auto file = received_future.get();
+  EXPECT_EQ(std::string(file->buffer(), file->length()), payload);
+  EXPECT_EQ(signalled_length, payload.size());
+}
+
+TEST(FluteEndToEndTest, TransmitsObjectReadFromSocket) {
+  using namespace std::chrono_literals;
+
+  constexpr short kPort = 18112;
+  std::string payload;
+  for (size_t i = 0; i < 600 * 1000 + 321; i++) payload += static_cast<char>('a' + (i * 13) % 26);
+
+  Session session("239.255.0.24", kPort, 4263);
+  session.transmitter->source_read_ahead(2);
+
+  auto received_future = session.first_received_file();
+  session.start();
+
+  // The content only passes through the socket, it is never held by the application as a whole
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  std::thread writer([&payload, fd = fds[1]]() {
+        for (size_t offset = 0; offset < payload.size();) {
+          auto count = send(fd, payload.data() + offset, std::min<size_t>(4096, payload.size() - offset), MSG_NOSIGNAL);
+          if (count <= 0) break;
+          offset += count;
+        }
+        close(fd);
+      });
+  auto description = std::make_shared<LibFlute::Transmitter::FileDescription>(
+      "stream/object.bin", std::make_shared<LibFlute::FdContentSource>(fds[0], true), payload.size());
+  session.transmitter->send(description);
+
+  const auto received_ready = received_future.wait_for(5s);
+  session.stop();
+  // Stops the writer if the transmission did not get to the end
+  shutdown(fds[0], SHUT_RDWR);
+  writer.join();
+
+  ASSERT_EQ(received_ready, std::future_status::ready);
+  const auto file = received_future.get();
+  EXPECT_EQ(std::string(file->buffer(), file->length()), payload);
+}
@@ -0,0 +1,434 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include "ContentSource.h"
+#include "File.h"
+
+using namespace LibFlute;
+
+static FileDeliveryTable::FileEntry make_entry(uint32_t toi, uint64_t length) {
+  FileDeliveryTable::FileEntry entry{};
+  entry.toi = toi;
+  entry.content_location = "test/file.bin";
+  entry.content_length = length;
+  entry.fec_oti = FecOti{
+    .encoding_id = FecScheme::CompactNoCode,
+    .instance_id = 0,
+    .transfer_length = length,
+    .encoding_symbol_length = 1000,
+    .max_source_block_length = 64,
+    .max_number_of_encoding_symbols = 0};
+  return entry;
+}
+
+TEST(FileReceptionTest, BufferAllocatedOnFirstSymbol) {
+  File file(make_entry(1, 2500));
+  EXPECT_FALSE(file.is_allocated());
+  EXPECT_EQ(file.buffer(), nullptr);
+  EXPECT_EQ(file.length(), 2500u);
+
+  std::vector<char> data(2500, 'x');
+  file.put_symbol(EncodingSymbol(0, 0, data.data(), 1000, FecScheme::CompactNoCode));
+  EXPECT_TRUE(file.is_allocated());
+  ASSERT_NE(file.buffer(), nullptr);
+  EXPECT_FALSE(file.complete());
+
+  file.put_symbol(EncodingSymbol(1, 0, data.data() + 1000, 1000, FecScheme::CompactNoCode));
+  file.put_symbol(EncodingSymbol(2, 0, data.data() + 2000, 500, FecScheme::CompactNoCode));
+  EXPECT_TRUE(file.complete());
+  EXPECT_EQ(std::string(file.buffer(), file.length()), std::string(data.begin(), data.end()));
+}
+
+TEST(FileReceptionTest, RejectsUnpartitionableFecOti) {
+  auto entry = make_entry(1, 2500);
+  entry.fec_oti.encoding_symbol_length = 0;
+  EXPECT_ANY_THROW(File file(entry));
+
+  // More symbols than 16 bit SBN and ESI values can address
+  entry = make_entry(1, 0x10000ull * 64 * 1000 + 1);
+  EXPECT_ANY_THROW(File file(entry));
+}
+
+TEST(FileReceptionTest, GrowingFileTrimmedWhenFinalized) {
+  auto entry = make_entry(1, 0);
+  entry.growing = true;
+  File file(entry);
+  EXPECT_TRUE(file.growing());
+
+  // Received into a single source block until the length is known
+  std::vector<char> data(2500, 'g');
+  file.put_symbol(EncodingSymbol(0, 0, data.data(), 1000, FecScheme::CompactNoCode));
+  file.put_symbol(EncodingSymbol(1, 0, data.data() + 1000, 1000, FecScheme::CompactNoCode));
+  EXPECT_FALSE(file.complete());
+  EXPECT_ANY_THROW(file.finalize(64 * 1000 + 1));
+
+  file.finalize(2500);
+  EXPECT_FALSE(file.growing());
+  EXPECT_FALSE(file.complete());
+  EXPECT_ANY_THROW(file.put_symbol(EncodingSymbol(3, 0, data.data(), 1000, FecScheme::CompactNoCode)));
+  file.put_symbol(EncodingSymbol(2, 0, data.data() + 2000, 500, FecScheme::CompactNoCode));
+  EXPECT_TRUE(file.complete());
+  EXPECT_EQ(std::string(file.buffer(), file.length()), std::string(data.begin(), data.end()));
+}
+
+// Exposes the FEC OTI defaults normally merged in by the Transmitter
+struct TestFileDescription : Transmitter::FileDescription {
+  using Transmitter::FileDescription::FileDescription;
+  using Transmitter::FileDescription::merge_fec_oti;
+};
+
+static std::shared_ptr<Transmitter::FileDescription> make_description(const std::vector<char> &data) {
+  auto description = std::make_shared<TestFileDescription>("test/file.bin", data);
+  description->merge_fec_oti(FecOti{
+    .encoding_id = FecScheme::CompactNoCode,
+    .instance_id = 0,
+    .transfer_length = 0,
+    .encoding_symbol_length = 500,
+    .max_source_block_length = 64,
+    .max_number_of_encoding_symbols = 0});
+  return description;
+}
+
+TEST(FileTransmissionTest, SendsFromFileDescriptionContent) {
+  std::vector<char> data(2500, 'd');
+  auto description = make_description(data);
+  File file(description);
+  // No copy of the content is made
+  EXPECT_EQ(file.buffer(), description->data());
+  EXPECT_EQ(file.length(), data.size());
+
+  auto symbols = file.get_next_symbols(1000);
+  ASSERT_EQ(symbols.size(), 2u);
+  EXPECT_EQ(symbols[0].data(), description->data());
+  EXPECT_EQ(symbols[1].data(), description->data() + 500);
+}
+
+TEST(FileTransmissionTest, NextSymbolsFitInMaxSize) {
+  std::vector<char> data(2500, 's');
+  File file(make_description(data));
+
+  // 1336 bytes hold two 500 byte symbols, not three
+  auto symbols = file.get_next_symbols(1336);
+  ASSERT_EQ(symbols.size(), 2u);
+
+  // At least one symbol is returned even if it is larger than max_size
+  symbols = file.get_next_symbols(100);
+  ASSERT_EQ(symbols.size(), 1u);
+  EXPECT_EQ(symbols[0].id(), 2u);
+}
+
+TEST(FileTransmissionTest, FailedSymbolsAreSentAgain) {
+  std::vector<char> data(2500, 'f');
+  File file(make_description(data));
+
+  auto first = file.get_next_symbols(1000);
+  auto second = file.get_next_symbols(1000);
+  ASSERT_EQ(second.size(), 2u);
+  file.mark_completed(second, true);
+  file.mark_completed(first, false);
+  EXPECT_FALSE(file.complete());
+
+  // The failed symbols come before the ones not sent yet
+  auto symbols = file.get_next_symbols(1000);
+  ASSERT_EQ(symbols.size(), 2u);
+  EXPECT_EQ(symbols[0].id(), 0u);
+  EXPECT_EQ(symbols[1].id(), 1u);
+  file.mark_completed(symbols, true);
+
+  symbols = file.get_next_symbols(1000);
+  ASSERT_EQ(symbols.size(), 1u);
+  EXPECT_EQ(symbols[0].id(), 4u);
+  file.mark_completed(symbols, true);
+  EXPECT_TRUE(file.complete());
+  EXPECT_TRUE(file.get_next_symbols(1000).empty());
+
+  file.restart();
+  EXPECT_FALSE(file.complete());
+  EXPECT_EQ(file.get_next_symbols(1000)[0].id(), 0u);
+}
+
+TEST(FileTransmissionTest, PacketsHoldConsecutiveSymbolsOfOneBlock) {
+  // 11 symbols of 500 bytes in source blocks of 4, 4 and 3 symbols
+  std::vector<char> data(5300);
+  for (size_t i = 0; i < data.size(); i++) data[i] = static_cast<char>(i * 7);
+  auto description = std::make_shared<TestFileDescription>("test/file.bin", data);
+  description->merge_fec_oti(FecOti{
+    .encoding_id = FecScheme::CompactNoCode,
+    .instance_id = 0,
+    .transfer_length = 0,
+    .encoding_symbol_length = 500,
+    .max_source_block_length = 4,
+    .max_number_of_encoding_symbols = 0});
+  File file(description);
+  File received(file.meta());
+
+  // Like the Transmitter and the Receiver, the symbols go through the FEC payload ID of the packet
+  auto receive = [&file, &received](const std::vector<EncodingSymbol>& symbols) {
+    std::vector<char> payload(4 + 4000);
+    auto length = EncodingSymbol::to_payload(symbols, payload.data(), payload.size(), file.meta().fec_oti,
+        ContentEncoding::NONE);
+    for (const auto& symbol : EncodingSymbol::from_payload(payload.data(), length, file.meta().fec_oti,
+          ContentEncoding::NONE)) {
+      received.put_symbol(symbol);
+    }
+  };
+
+  // A packet does not run on into the next source block
+  auto first = file.get_next_symbols(4000);
+  ASSERT_EQ(first.size(), 4u);
+  auto second = file.get_next_symbols(4000);
+  EXPECT_EQ(second.front().source_block_number(), first.front().source_block_number() + 1);
+
+  // Failed symbols with sent ones in between are not taken into one packet
+  file.mark_completed({first[0], first[2]}, false);
+  file.mark_completed({first[1], first[3]}, true);
+  receive({first[1]});
+  receive({first[3]});
+  file.mark_completed(second, true);
+  receive(second);
+  auto symbols = file.get_next_symbols(4000);
+  ASSERT_EQ(symbols.size(), 1u);
+  EXPECT_EQ(symbols[0].id(), 0u);
+
+  for (; !symbols.empty(); symbols = file.get_next_symbols(4000)) {
+    for (size_t i = 1; i < symbols.size(); i++) {
+      EXPECT_EQ(symbols[i].source_block_number(), symbols[0].source_block_number());
+      EXPECT_EQ(symbols[i].id(), symbols[0].id() + i);
+    }
+    file.mark_completed(symbols, true);
+    receive(symbols);
+  }
+  EXPECT_TRUE(file.complete());
+  ASSERT_TRUE(received.complete());
+  EXPECT_EQ(std::vector<char>(received.buffer(), received.buffer() + received.length()), data);
+}
+
+TEST(FileTransmissionTest, SendsEverySymbolOfALargeObjectOnce) {
+  // One symbol per packet over many source blocks
+  constexpr size_t kSymbolLength = 1428;
+  std::vector<char> data(4 * 1024 * 1024 + 1, 'b');
+  auto description = std::make_shared<TestFileDescription>("test/file.bin", data);
+  description->merge_fec_oti(FecOti{
+    .encoding_id = FecScheme::CompactNoCode,
+    .instance_id = 0,
+    .transfer_length = 0,
+    .encoding_symbol_length = kSymbolLength,
+    .max_source_block_length = 64,
+    .max_number_of_encoding_symbols = 0});
+  File file(description);
+
+  std::vector<EncodingSymbol> symbols;
+  size_t packets = 0;
+  size_t bytes = 0;
+  for (file.get_next_symbols(kSymbolLength, symbols); !symbols.empty(); file.get_next_symbols(kSymbolLength, symbols)) {
+    ASSERT_EQ(symbols.size(), 1u);
+    bytes += symbols[0].len();
+    file.mark_completed(symbols, true);
+    packets++;
+  }
+  EXPECT_TRUE(file.complete());
+  EXPECT_EQ(packets, (data.size() + kSymbolLength - 1) / kSymbolLength);
+  EXPECT_EQ(bytes, data.size());
+}
+
+TEST(FileTransmissionTest, GrowingObjectSendsFilledSymbols) {
+  auto description = std::make_shared<TestFileDescription>("test/growing.bin");
+  description->set_growing(10000);
+  description->merge_fec_oti(FecOti{
+    .encoding_id = FecScheme::CompactNoCode,
+    .instance_id = 0,
+    .transfer_length = 0,
+    .encoding_symbol_length = 500,
+    .max_source_block_length = 64,
+    .max_number_of_encoding_symbols = 0});
+  File file(description);
+  EXPECT_TRUE(file.growing());
+  EXPECT_EQ(file.meta().fec_oti.max_source_block_length, 20u);
+  EXPECT_TRUE(file.get_next_symbols(1000).empty());
+
+  // Only full symbols are sent while the object grows
+  std::vector<char> data(1700, 'g');
+  description->append(data.data(), 1200);
+  auto symbols = file.get_next_symbols(2000);
+  ASSERT_EQ(symbols.size(), 2u);
+  file.mark_completed(symbols, true);
+  EXPECT_FALSE(file.complete());
+
+  description->append(data.data() + 1200, 500);
+  description->finalize();
+  EXPECT_ANY_THROW(description->append(data.data(), 1));
+  symbols = file.get_next_symbols(2000);
+  ASSERT_EQ(symbols.size(), 2u);
+  EXPECT_EQ(symbols[0].id(), 2u);
+  EXPECT_EQ(symbols[1].len(), 200u);
+  EXPECT_FALSE(file.growing());
+  EXPECT_TRUE(file.ext_fti());
+  EXPECT_EQ(file.meta().fec_oti.transfer_length, 1700u);
+  EXPECT_EQ(file.meta().content_md5, description->file_entry().content_md5);
+  EXPECT_FALSE(file.meta().content_md5.empty());
+  file.mark_completed(symbols, true);
+  EXPECT_TRUE(file.complete());
+}
+
+TEST(FileTransmissionTest, FinalizedGrowingObjectResendsLastSymbol) {
+  auto description = std::make_shared<TestFileDescription>("test/growing.bin");
+  description->set_growing(10000);
+  description->merge_fec_oti(FecOti{
+    .encoding_id = FecScheme::CompactNoCode,
+    .instance_id = 0,
+    .transfer_length = 0,
+    .encoding_symbol_length = 500,
+    .max_source_block_length = 64,
+    .max_number_of_encoding_symbols = 0});
+  File file(description);
+
+  std::vector<char> data(1000, 'g');
+  description->append(data.data(), data.size());
+  auto symbols = file.get_next_symbols(2000);
+  ASSERT_EQ(symbols.size(), 2u);
+  file.mark_completed(symbols, true);
+
+  // Receivers still need a packet with the length in EXT_FTI
+  description->finalize();
+  symbols = file.get_next_symbols(2000);
+  ASSERT_EQ(symbols.size(), 1u);
+  EXPECT_EQ(symbols[0].id(), 1u);
+  EXPECT_FALSE(file.complete());
+  file.mark_completed(symbols, true);
+  EXPECT_TRUE(file.complete());
+}
+
+// Generates content from the offset, like a source that cannot be held in memory
+struct GeneratedSource : ContentSource {
+  explicit GeneratedSource(uint64_t length) : length(length) {}
+  size_t read(uint64_t offset, char *buffer, size_t max) override {
+    auto count = std::min<uint64_t>(max, std::min(length, fail_at) - offset);
+    for (size_t i = 0; i < count; i++) buffer[i] = content(offset + i);
+    bytes_read += count;
+    return count;
+  }
+  static char content(uint64_t offset) { return static_cast<char>('a' + offset * 7 % 26); }
+  uint64_t length;
+  uint64_t fail_at = UINT64_MAX;
+  std::atomic<uint64_t> bytes_read{0};
+};
+
+static std::shared_ptr<Transmitter::FileDescription> make_description(const std::shared_ptr<ContentSource> &source,
+                                                                      size_t length) {
+  auto description = std::make_shared<TestFileDescription>("test/stream.bin", source, length);
+  description->merge_fec_oti(FecOti{
+    .encoding_id = FecScheme::CompactNoCode,
+    .instance_id = 0,
+    .transfer_length = 0,
+    .encoding_symbol_length = 500,
+    .max_source_block_length = 64,
+    .max_number_of_encoding_symbols = 0});
+  return description;
+}
+
+TEST(FileTransmissionTest, StreamedContentIsHeldAFewBlocksAtATime) {
+  // 40 source blocks of up to 64 symbols
+  constexpr uint64_t kLength = 40 * 32000 - 1234;
+  auto source = std::make_shared<GeneratedSource>(kLength);
+  File file(make_description(source, kLength), 3);
+  EXPECT_EQ(file.buffer(), nullptr);
+  EXPECT_EQ(file.length(), kLength);
+
+  for (int round = 0; round < 2; round++) {
+    uint64_t offset = 0;
+    size_t max_buffered = 0;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!file.complete() && std::chrono::steady_clock::now() < deadline) {
+      auto symbols = file.get_next_symbols(1000);
+      max_buffered = std::max(max_buffered, file.buffered_blocks());
+      if (symbols.empty()) {
+        // Waiting for the next block to be read
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        continue;
+      }
+      for (const auto& symbol : symbols) {
+        for (size_t i = 0; i < symbol.len(); i++) {
+          ASSERT_EQ(symbol.data()[i], GeneratedSource::content(offset + i));
+        }
+        offset += symbol.len();
+      }
+      file.mark_completed(symbols, true);
+    }
+    EXPECT_TRUE(file.complete());
+    EXPECT_FALSE(file.failed());
+    EXPECT_EQ(offset, kLength);
+    EXPECT_LE(max_buffered, 3u);
+    EXPECT_EQ(source->bytes_read, (round + 1) * kLength);
+
+    // Another round reads the content again
+    file.restart();
+  }
+}
+
+TEST(FileTransmissionTest, StreamedContentFailsWhenSourceEndsEarly) {
+  constexpr uint64_t kLength = 10 * 32000;
+  auto source = std::make_shared<GeneratedSource>(kLength);
+  source->fail_at = 5 * 32000 + 10;
+  File file(make_description(source, kLength), 2);
+
+  size_t sent = 0;
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!file.failed() && std::chrono::steady_clock::now() < deadline) {
+    auto symbols = file.get_next_symbols(1000);
+    if (symbols.empty()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    file.mark_completed(symbols, true);
+    sent += symbols.size();
+  }
+  EXPECT_TRUE(file.failed());
+  EXPECT_FALSE(file.complete());
+  EXPECT_LE(sent, 5u * 64);
+}
+
+TEST(FileTransmissionTest, MappedFileIsReadAhead) {
+  constexpr size_t kLength = 20 * 32000 + 100;
+  std::string filename = ::testing::TempDir() + "flute_read_ahead.bin";
+  {
+    std::ofstream output(filename, std::ios::binary);
+    for (size_t i = 0; i < kLength; i++) output.put(GeneratedSource::content(i));
+  }
+  auto description = std::make_shared<TestFileDescription>("test/mapped.bin", filename);
+  description->merge_fec_oti(FecOti{
+    .encoding_id = FecScheme::CompactNoCode,
+    .instance_id = 0,
+    .transfer_length = 0,
+    .encoding_symbol_length = 500,
+    .max_source_block_length = 64,
+    .max_number_of_encoding_symbols = 0});
+  auto statistics = std::make_shared<ReadAheadStatistics>();
+  File file(description, 2, statistics);
+
+  uint64_t offset = 0;
+  while (!file.complete()) {
+    auto symbols = file.get_next_symbols(1000);
+    ASSERT_FALSE(symbols.empty());
+    for (const auto& symbol : symbols) {
+      for (size_t i = 0; i < symbol.len(); i++) {
+        ASSERT_EQ(symbol.data()[i], GeneratedSource::content(offset + i));
+      }
+      offset += symbol.len();
+    }
+    file.mark_completed(symbols, true);
+  }
+  EXPECT_EQ(offset, kLength);
+
+  // All of the blocks are read ahead, whether or not the transmission got to them first
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (statistics->prefetched_bytes < kLength && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(statistics->prefetched_bytes, kLength);
+  EXPECT_LE(statistics->prefetch_misses, 21u);
+  std::remove(filename.c_str());
+}
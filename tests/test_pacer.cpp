@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include "Pacer.h"
+
+using namespace LibFlute;
+
+namespace {
+
+constexpr size_t kPacketSize = 1428;
+
+}  // namespace
+
+TEST(PacerTest, HoldsRateWithLateWakeups) {
+  using namespace std::chrono_literals;
+
+  const uint64_t rate = 100'000'000; // 100 Mbit/s
+  auto now = Pacer::clock::time_point{} + 1s;
+  Pacer pacer;
+  pacer.rate(rate, now);
+
+  // Simulate 10 s of transmission where every wakeup comes between 0 and 300 us late
+  const auto end = now + 10s;
+  uint64_t bytes = 0;
+  uint32_t jitter_seed = 1;
+  while (now < end) {
+    while (pacer.ready(now)) {
+      pacer.consume(kPacketSize, now);
+      bytes += kPacketSize;
+    }
+    jitter_seed = jitter_seed * 1103515245 + 12345;
+    now += pacer.wait_time(now) + std::chrono::microseconds((jitter_seed >> 16) % 300);
+  }
+
+  const double achieved = bytes * 8.0 / 10.0;
+  EXPECT_NEAR(achieved, static_cast<double>(rate), rate * 0.01);
+}
+
+TEST(PacerTest, BurstLimitsCatchUp) {
+  using namespace std::chrono_literals;
+
+  auto now = Pacer::clock::time_point{} + 1s;
+  Pacer pacer;
+  pacer.burst(10 * kPacketSize).rate(10'000'000, now);
+
+  // After a long idle period only one burst worth of packets may go out back to back
+  now += 1s;
+  size_t packets = 0;
+  while (pacer.ready(now)) {
+    pacer.consume(kPacketSize, now);
+    packets++;
+  }
+  EXPECT_EQ(packets, 11u);
+  EXPECT_GT(pacer.wait_time(now), Pacer::clock::duration::zero());
+}
+
+TEST(PacerTest, UnlimitedRateNeverWaits) {
+  Pacer pacer;
+  pacer.consume(1'000'000);
+  EXPECT_TRUE(pacer.ready());
+  EXPECT_EQ(pacer.wait_time(), Pacer::clock::duration::zero());
+}
+
+TEST(PacerTest, DepartureTimesAreSpacedAtTheRate) {
+  using namespace std::chrono_literals;
+
+  auto now = Pacer::clock::time_point{} + 1s;
+  Pacer pacer;
+  pacer.rate(8'000'000, now); // 1 byte per microsecond
+
+  auto first = pacer.departure_time(1000, now);
+  auto second = pacer.departure_time(1000, now);
+  auto third = pacer.departure_time(500, now);
+  EXPECT_EQ(first, now);
+  EXPECT_EQ(second - first, std::chrono::duration_cast<Pacer::clock::duration>(1ms));
+  EXPECT_EQ(third - second, std::chrono::duration_cast<Pacer::clock::duration>(1ms));
+}
+
+TEST(PacerTest, LateWakeupsWithPacketsWaitingAreCaughtUp) {
+  using namespace std::chrono_literals;
+
+  const uint64_t rate = 50'000'000;
+  auto now = Pacer::clock::time_point{} + 1s;
+  Pacer pacer;
+  pacer.rate(rate, now);
+
+  // Every 20th wakeup is 10 ms late, far more than the default burst covers
+  const auto end = now + 10s;
+  uint64_t bytes = 0;
+  unsigned wakeups = 0;
+  while (now < end) {
+    while (pacer.ready(now)) {
+      pacer.consume(kPacketSize, now);
+      bytes += kPacketSize;
+    }
+    now += pacer.wait_time(now) + (++wakeups % 20 == 0 ? 10ms : 0ms);
+  }
+
+  const double achieved = bytes * 8.0 / 10.0;
+  EXPECT_NEAR(achieved, static_cast<double>(rate), rate * 0.01);
+}
+
+TEST(PacerTest, IdleSenderIsLimitedToBurst) {
+  using namespace std::chrono_literals;
+
+  auto now = Pacer::clock::time_point{} + 1s;
+  Pacer pacer;
+  pacer.burst(10 * kPacketSize).rate(10'000'000, now);
+  pacer.consume(kPacketSize, now);
+
+  // The sender runs out of packets, the credit built up while it waits for more is not caught up with
+  now += 20ms;
+  pacer.idle(now);
+  now += 20ms;
+  size_t packets = 0;
+  while (pacer.ready(now)) {
+    pacer.consume(kPacketSize, now);
+    packets++;
+  }
+  EXPECT_EQ(packets, 11u);
+}
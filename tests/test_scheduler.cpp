@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <vector>
+#include "Scheduler.h"
+
+using namespace LibFlute;
+
+namespace {
+
+constexpr size_t kPacketSize = 1428;
+
+// Run the scheduler for a number of packets, with every object always having a packet of the given size to send
+auto run(Scheduler &scheduler, const std::map<uint32_t, size_t> &packet_sizes, size_t packets)
+    -> std::map<uint32_t, size_t> {
+  std::map<uint32_t, size_t> bytes;
+  for (size_t i = 0; i < packets; i++) {
+    scheduler.schedule([&](uint32_t toi) -> size_t {
+      auto size = packet_sizes.at(toi);
+      bytes[toi] += size;
+      return size;
+    });
+  }
+  return bytes;
+}
+
+}  // namespace
+
+TEST(SchedulerTest, SharesBytesByWeight) {
+  DeficitRoundRobinScheduler scheduler;
+  scheduler.add(1, 0, 1);
+  scheduler.add(2, 0, 3);
+
+  auto bytes = run(scheduler, {{1, kPacketSize}, {2, kPacketSize}}, 4000);
+  EXPECT_NEAR(static_cast<double>(bytes[2]) / bytes[1], 3.0, 0.01);
+}
+
+TEST(SchedulerTest, SharesBytesWithDifferentPacketSizes) {
+  DeficitRoundRobinScheduler scheduler;
+  scheduler.add(1, 0, 1);
+  scheduler.add(2, 0, 1);
+
+  auto bytes = run(scheduler, {{1, kPacketSize}, {2, 200}}, 20000);
+  EXPECT_NEAR(static_cast<double>(bytes[2]) / bytes[1], 1.0, 0.01);
+}
+
+TEST(SchedulerTest, ServesHigherPriorityFirst) {
+  DeficitRoundRobinScheduler scheduler;
+  scheduler.add(1, 0, 10);
+  scheduler.add(2, 5, 1);
+
+  // The bulk object only gets to send once the urgent one has nothing left
+  size_t urgent_packets = 3;
+  std::vector<uint32_t> order;
+  for (int i = 0; i < 6; i++) {
+    scheduler.schedule([&](uint32_t toi) -> size_t {
+      if (toi == 2) {
+        if (!urgent_packets) return 0;
+        urgent_packets--;
+      }
+      order.push_back(toi);
+      return kPacketSize;
+    });
+  }
+  EXPECT_EQ(order, (std::vector<uint32_t>{2, 2, 2, 1, 1, 1}));
+}
+
+TEST(SchedulerTest, SkipsObjectsWithNothingToSend) {
+  DeficitRoundRobinScheduler scheduler;
+  scheduler.add(1, 0, 1);
+  scheduler.add(2, 0, 1);
+  scheduler.add(3, 0, 1);
+
+  auto bytes = run(scheduler, {{1, 0}, {2, kPacketSize}, {3, 0}}, 10);
+  EXPECT_EQ(bytes[2], 10 * kPacketSize);
+
+  EXPECT_EQ(scheduler.schedule([](uint32_t) -> size_t { return 0; }), 0u);
+}
+
+TEST(SchedulerTest, RemovedObjectsAreNotServed) {
+  DeficitRoundRobinScheduler scheduler;
+  for (uint32_t toi = 1; toi <= 4; toi++) {
+    scheduler.add(toi, toi % 2, 1);
+  }
+  run(scheduler, {{1, kPacketSize}, {2, kPacketSize}, {3, kPacketSize}, {4, kPacketSize}}, 5);
+  scheduler.remove(1);
+  scheduler.remove(3);
+
+  auto bytes = run(scheduler, {{2, kPacketSize}, {4, kPacketSize}}, 10);
+  EXPECT_EQ(bytes[2], 5 * kPacketSize);
+  EXPECT_EQ(bytes[4], 5 * kPacketSize);
+
+  scheduler.remove(2);
+  scheduler.remove(4);
+  EXPECT_EQ(scheduler.schedule([](uint32_t) -> size_t { return kPacketSize; }), 0u);
+}
+
+TEST(SchedulerTest, AddingAgainUpdatesPriority) {
+  DeficitRoundRobinScheduler scheduler;
+  scheduler.add(1, 0, 1);
+  scheduler.add(2, 0, 1);
+  scheduler.add(1, 1, 1);
+
+  auto bytes = run(scheduler, {{1, kPacketSize}, {2, kPacketSize}}, 10);
+  EXPECT_EQ(bytes[1], 10 * kPacketSize);
+  EXPECT_EQ(bytes.count(2), 0u);
+}
@@ -1,5 +1,11 @@
 #include <gtest/gtest.h>
 #include <boost/asio.hpp>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 #include "Transmitter.h"
 
 using namespace LibFlute;
@@ -73,3 +79,125 @@ TEST(TransmitterGetterSetterTest, UdpTunnelAddressSetAndUnset) {
   tx->udp_tunnel_address(std::nullopt);
   EXPECT_FALSE(tx->udp_tunnel_address().has_value());
 }
+
+TEST(TransmitterFdtTest, QueueingManyFilesBuildsOneFdt) {
+  constexpr size_t kFiles = 100;
+  boost::asio::io_context io;
+  auto tx = make_tx(io);
+  std::vector<char> content(100, 'x');
+  std::vector<std::shared_ptr<Transmitter::FileDescription>> files;
+  for (size_t i = 0; i < kFiles; i++) {
+    files.push_back(std::make_shared<Transmitter::FileDescription>("file" + std::to_string(i) + ".bin", content));
+    tx->send(files.back());
+  }
+  // The files wait for the FDT instance, which is built once the io_context runs
+  EXPECT_EQ(tx->number_of_files(), kFiles);
+  while (tx->number_of_files() == kFiles && io.run_one_for(std::chrono::seconds(1))) {}
+  // A single FDT instance announces all of them
+  EXPECT_EQ(tx->number_of_files(), kFiles + 1);
+}
+
+TEST(TransmitterFdtTest, UpdateWindowCollectsChanges) {
+  boost::asio::io_context io;
+  auto tx = make_tx(io);
+  EXPECT_EQ(tx->fdt_update_window(), std::chrono::milliseconds(0));
+  tx->fdt_update_window(std::chrono::milliseconds(200));
+  EXPECT_EQ(tx->fdt_update_window(), std::chrono::milliseconds(200));
+
+  std::vector<char> content(100, 'x');
+  auto first = std::make_shared<Transmitter::FileDescription>("first.bin", content);
+  auto second = std::make_shared<Transmitter::FileDescription>("second.bin", content);
+  auto removed = std::make_shared<Transmitter::FileDescription>("removed.bin", content);
+  tx->send(first);
+  tx->send(removed);
+  io.run_for(std::chrono::milliseconds(50));
+  tx->send(second);
+  EXPECT_TRUE(tx->remove(removed->toi()));
+  // Nothing is announced or sent before the window has passed
+  EXPECT_EQ(tx->number_of_files(), 2u);
+  EXPECT_EQ(tx->statistics().packets_sent, 0u);
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (tx->number_of_files() == 2 && std::chrono::steady_clock::now() < deadline) {
+    io.run_one_for(std::chrono::milliseconds(100));
+  }
+  EXPECT_EQ(tx->number_of_files(), 3u);
+  EXPECT_FALSE(tx->remove(removed->toi()));
+}
+
+TEST(TransmitterFdtTest, BatchIsAnnouncedTogether) {
+  boost::asio::io_context io;
+  auto tx = make_tx(io);
+  std::vector<char> content(100, 'x');
+  std::vector<std::shared_ptr<Transmitter::FileDescription>> batch;
+  for (const auto& location : {"first.bin", "second.bin", "third.bin"}) {
+    batch.push_back(std::make_shared<Transmitter::FileDescription>(location, content));
+  }
+
+  EXPECT_TRUE(tx->send(std::vector<std::shared_ptr<Transmitter::FileDescription>>{}).empty());
+  auto tois = tx->send(batch);
+  ASSERT_EQ(tois.size(), batch.size());
+  for (size_t i = 0; i < batch.size(); i++) {
+    EXPECT_EQ(tois[i], batch[i]->toi());
+    EXPECT_EQ(tois[i], tois[0] + i);
+  }
+
+  // The files wait for one FDT instance, which is queued along with them
+  EXPECT_EQ(tx->number_of_files(), 3u);
+  while (tx->number_of_files() == 3u && io.run_one_for(std::chrono::seconds(1))) {}
+  EXPECT_EQ(tx->number_of_files(), 4u);
+}
+
+TEST(TransmitterWorkerTest, DropsCompletionsOfDestroyedTransmitter) {
+  boost::asio::io_context io;
+  auto tx = make_tx(io);
+  tx->worker_threads(2);
+  std::vector<char> content(100000, 'w');
+  tx->send(std::make_shared<Transmitter::FileDescription>("worker.bin", content));
+
+  // The workers send without the io_context, their completions wait for it to run
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (tx->statistics().packets_sent == 0 && std::chrono::steady_clock::now() < deadline) {
+    io.poll_one();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  tx.reset();
+
+  EXPECT_GT(io.poll(), 0u);
+}
+
+namespace {
+class ZeroSource : public ContentSource {
+  public:
+    size_t read(uint64_t, char *buffer, size_t length) override {
+      std::fill(buffer, buffer + length, 0);
+      return length;
+    }
+};
+}
+
+TEST(TransmitterFdtTest, RefusedBatchIsLeftUnchanged) {
+  boost::asio::io_context io;
+  auto tx = make_tx(io);
+  std::vector<char> content(100, 'x');
+  auto file = std::make_shared<Transmitter::FileDescription>("file.bin", content);
+
+  // Refused when it is checked, and when the files are created
+  auto compressed = std::make_shared<Transmitter::FileDescription>("compressed.bin", std::make_shared<ZeroSource>(), 100);
+  compressed->set_compression(Transmitter::FileDescription::COMPRESSION_GZIP);
+  auto too_long = std::make_shared<Transmitter::FileDescription>("growing.bin");
+  too_long->set_growing(0x10000 * 1400);
+  for (const auto& refused : {compressed, too_long}) {
+    EXPECT_ANY_THROW(tx->send(std::vector<std::shared_ptr<Transmitter::FileDescription>>{file, refused}));
+    EXPECT_EQ(tx->number_of_files(), 0u);
+    EXPECT_FALSE(file->has_tsi());
+    EXPECT_EQ(file->toi(), 0u);
+    EXPECT_EQ(file->file_entry().fec_oti.encoding_symbol_length, 0u);
+    EXPECT_FALSE(refused->has_tsi());
+    EXPECT_EQ(refused->toi(), 0u);
+  }
+
+  // The TOIs of the refused batch are not used up
+  EXPECT_EQ(tx->send(file), 1u);
+}